@@ -48,10 +48,23 @@
     dispatch_once(&onceToken, ^{
         market = [[MKMarket alloc] init];
         [[SKPaymentQueue defaultQueue] addTransactionObserver:market];
+        [[NSNotificationCenter defaultCenter] addObserver:market selector:@selector(receiptChanged:) name:kMKReceiptValidatorReceiptChangedNotification object:nil];
     });
     return market;
 }
 
+- (void)showAlert:(UIAlertView *)alert
+{
+    //Receipt validation completions already run on the main queue, waiting on it from there would never return.
+    if ([NSThread isMainThread]) {
+        [alert show];
+    } else {
+        dispatch_sync(dispatch_get_main_queue(), ^{
+            [alert show];
+        });
+    }
+}
+
 //---------------------------------
 //
 #pragma mark - Loading product list.
@@ -129,9 +142,7 @@
         _productListData = nil;
         _loadingProductList = NO;
         UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Failed to load products list: %@", error.localizedDescription] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-        dispatch_sync(dispatch_get_main_queue(), ^{
-            [alert show];
-        });
+        [self showAlert:alert];
         [[NSNotificationCenter defaultCenter] postNotificationName:kMKMarketProductListUpdateFinishedNoification object:nil];
     }
 }
@@ -147,9 +158,7 @@
     if (error) {
         _loadingProductList = NO;
         UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Failed to load products list: %@", error.localizedDescription] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-        dispatch_sync(dispatch_get_main_queue(), ^{
-            [alert show];
-        });
+        [self showAlert:alert];
         [[NSNotificationCenter defaultCenter] postNotificationName:kMKMarketProductListUpdateFinishedNoification object:nil];
         return;
     }
@@ -157,9 +166,7 @@
     if (!productDictionaries) {
         _loadingProductList = NO;
         UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:@"Failed to load products list: No list to load." delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-        dispatch_sync(dispatch_get_main_queue(), ^{
-            [alert show];
-        });
+        [self showAlert:alert];
         [[NSNotificationCenter defaultCenter] postNotificationName:kMKMarketProductListUpdateFinishedNoification object:nil];
         return;
     }
@@ -196,9 +203,7 @@
     _productsRequest = nil;
     _loadingProductList = NO;
     UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Failed to load products list: %@", error.localizedDescription] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-    dispatch_sync(dispatch_get_main_queue(), ^{
-        [alert show];
-    });
+    [self showAlert:alert];
     [[NSNotificationCenter defaultCenter] postNotificationName:kMKMarketProductListUpdateFinishedNoification object:nil];
 }
 
@@ -210,6 +215,17 @@
         product.skProduct = skProduct;
     }
     
+    //Refresh every product from one validation before sorting them.
+    [[MKReceiptValidator sharedValidator] validateReceiptWithCompletion:^(BOOL validAppReceipt, MKApplicationReceipt *receipt, NSError *error) {
+        if (validAppReceipt && receipt) {
+            [self refreshProducts:_products.allValues withReceipt:receipt];
+        }
+        [self sortProducts];
+    } forceRefresh:NO];
+}
+
+- (void)sortProducts
+{
     //Sort the products
     NSMutableDictionary *tempPurchased = [NSMutableDictionary dictionary];
     NSMutableDictionary *tempPurchaseable = [NSMutableDictionary dictionary];
@@ -358,9 +374,9 @@
     [[NSNotificationCenter defaultCenter] postNotificationName:kMKMarketCompletedRestoringTransactionsNotification object:nil];
     //Update the table, start py updating the receipt.
     [[MKReceiptValidator sharedValidator] validateReceiptWithCompletion:^(BOOL validAppReceipt, MKApplicationReceipt *receipt, NSError *error) {
-        //Need to update the products
-        for (MKProduct *product in _products) {
-            [product refreshProductProperties];
+        //Need to update the products whose transactions changed
+        if (validAppReceipt && receipt) {
+            [self refreshProducts:[self productsUpdatedInReceipt:receipt] withReceipt:receipt];
         }
     } forceRefresh:YES];
 }
@@ -372,9 +388,7 @@
     [[NSNotificationCenter defaultCenter] postNotificationName:kMKMarketCompletedRestoringTransactionsNotification object:nil];
     [[NSNotificationCenter defaultCenter] postNotificationName:kMKMarketProductListChangedNotification object:nil];
     UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Failed to restore tranactions: %@", error.localizedDescription] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-    dispatch_sync(dispatch_get_main_queue(), ^{
-        [alert show];
-    });
+    [self showAlert:alert];
 }
 
 - (void)completeTransaction:(SKPaymentTransaction *)transaction forProduct:(MKProduct *)product
@@ -385,6 +399,13 @@
         if (validAppReceipt && receipt) {
             //Now update the product properties (No consequence for doing this twice as the receipt is cached.
             [product refreshProductProperties];
+            //Along with any other product the new receipt changed.
+            for (NSString *identifier in receipt.updatedProductIdentifiers) {
+                MKProduct *updatedProduct = _products[identifier];
+                if (updatedProduct && updatedProduct != product) {
+                    [updatedProduct refreshProductProperties];
+                }
+            }
             
             if (product.state == MKProductStatePurchasedNeedsUpdate || product.state == MKProductStatePurchasedNotInstalled || product.state == MKProductStatePurchasedUpToDate) {
                 [[NSNotificationCenter defaultCenter] postNotificationName:kMKMarketProductListChangedNotification object:nil];
@@ -399,9 +420,7 @@
             //failure
             NSLog(@"Transaction for product: %@ failed to validate receipt.", product.identifier);
             UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Failed to find receipt for product: %@", product.skProduct.localizedTitle] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-            dispatch_sync(dispatch_get_main_queue(), ^{
-                [alert show];
-            });
+            [self showAlert:alert];
             //Finish the failed transaction.
             [[SKPaymentQueue defaultQueue] finishTransaction:transaction];
             product.purchaseInProgress = NO;
@@ -411,13 +430,49 @@
     } forceRefresh:YES];
 }
 
+- (void)receiptChanged:(NSNotification *)notification
+{
+    //The receipt can change without a transaction of ours, such as a renewal. Refresh the products it touched.
+    [self refreshProducts:[self productsUpdatedInReceipt:notification.object] withReceipt:notification.object];
+}
+
+/**Refreshes the products from a validated receipt, checking which of them it entitles in one pass instead of validating the receipt for each.*/
+- (void)refreshProducts:(NSArray *)products withReceipt:(MKApplicationReceipt *)receipt
+{
+    NSIndexSet *entitled = [receipt indexesOfEntitledProductIdentifiers:[products valueForKey:@"identifier"]];
+    [products enumerateObjectsUsingBlock:^(MKProduct *product, NSUInteger idx, BOOL *stop) {
+        if (entitled) {
+            [product refreshProductPropertiesWithReceipt:receipt entitled:[entitled containsIndex:idx]];
+        } else {
+            //Out of memory for the bulk query.
+            [product refreshProductProperties];
+        }
+    }];
+}
+
+- (NSArray *)productsUpdatedInReceipt:(MKApplicationReceipt *)receipt
+{
+    NSSet *identifiers = receipt.updatedProductIdentifiers;
+    if (!identifiers) {
+        //Nothing to compare the receipt with, every product may have changed.
+        return _products.allValues;
+    }
+    
+    NSMutableArray *products = [NSMutableArray array];
+    for (NSString *identifier in identifiers) {
+        MKProduct *product = _products[identifier];
+        if (product) {
+            [products addObject:product];
+        }
+    }
+    return products;
+}
+
 - (void)failedTransaction:(SKPaymentTransaction *)transaction forProduct:(MKProduct *)product
 {
     NSLog(@"Transaction for product: %@ failed: %@", product.identifier, transaction.error.localizedDescription);
     UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Failed to process transaction for %@: %@", product.skProduct.localizedTitle, transaction.error.localizedDescription] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-    dispatch_sync(dispatch_get_main_queue(), ^{
-        [alert show];
-    });
+    [self showAlert:alert];
     //Finish the failed transaction.
     [[SKPaymentQueue defaultQueue] finishTransaction:transaction];
 }
@@ -589,9 +644,7 @@
     if (error) {
         NSLog(@"Unable to create temporary storage directory: %@", error.localizedDescription);
         UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Unable to create temporary storage directory: %@", error.localizedDescription] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-        dispatch_sync(dispatch_get_main_queue(), ^{
-            [alert show];
-        });
+        [self showAlert:alert];
         return;
     }
     
@@ -607,9 +660,7 @@
     if (!copied || error) {
         NSLog(@"Unable to copy download: %@", error.localizedDescription);
         UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Unable to copy download: %@", error.localizedDescription] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-        dispatch_sync(dispatch_get_main_queue(), ^{
-            [alert show];
-        });
+        [self showAlert:alert];
         return;
     }
     
@@ -651,9 +702,7 @@
         product.instalationProgress = 0.0;
         
         UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Unable to download %@. %@", product.skProduct.localizedTitle, error.localizedDescription] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-        dispatch_sync(dispatch_get_main_queue(), ^{
-            [alert show];
-        });
+        [self showAlert:alert];
     }
 }
 
@@ -729,36 +778,18 @@
             //Unzip the file to the location
             NSLog(@"Decompressing to: %@", installPath);
             
-            NSFileManager* fileManager = [NSFileManager defaultManager];
+            //Inflate and write several entries at once, content packs hold thousands of assets.
             NSURL* pathURL = [NSURL fileURLWithPath:installPath];
             ZZArchive* archive = [ZZArchive archiveWithContentsOfURL:[NSURL fileURLWithPath:path]];
-            for (ZZArchiveEntry* entry in archive.entries)
-            {
-                NSURL* targetPath = [pathURL URLByAppendingPathComponent:entry.fileName];
-                
-                if (entry.fileMode & S_IFDIR) {
-                    // check if directory bit is set
-                    NSError *dirError;
-                    [fileManager createDirectoryAtURL:targetPath withIntermediateDirectories:YES attributes:nil error:&dirError];
-                    if (dirError) {
-                        NSLog(@"Failed to create directory.");
-                    }
-                } else {
-                    // Some archives don't have a separate entry for each directory and just
-                    // include the directory's name in the filename. Make sure that directory exists
-                    // before writing a file into it.
-                    NSError *dirError;
-                    [fileManager createDirectoryAtURL:[targetPath URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:&dirError];
-                    if (dirError) {
-                        NSLog(@"Failed to create directory.");
-                    }
-                    
-                    [[entry newDataWithError:&error] writeToURL:targetPath atomically:NO];
-                    
-                    if (error) {
-                        NSLog(@"Error creating file: %@", error);
-                    }
-                }
+            BOOL extracted = [archive extractToURL:pathURL maxConcurrentEntries:0 progressBlock:^(unsigned long long completedBytes, unsigned long long totalBytes) {
+                float progress = totalBytes > 0 ? (float)((double)completedBytes / (double)totalBytes) : 1.0f;
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    product.instalationProgress = progress;
+                });
+            } error:&error];
+            
+            if (!extracted) {
+                NSLog(@"Error extracting content: %@", error);
             }
             
             if (!error) {
@@ -773,9 +804,7 @@
             //Failure
             NSLog(@"Failed to install: %@: %@", product.identifier, error.localizedDescription);
             UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Failed to install %@: %@", product.skProduct.localizedTitle, error.localizedDescription] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-            dispatch_sync(dispatch_get_main_queue(), ^{
-                [alert show];
-            });
+            [self showAlert:alert];
         }
         //Finish the failed transaction.
         if (transaction) {
@@ -791,9 +820,7 @@
         //Something is wrong. No file to install
         NSLog(@"Failed to install %@: No content to install.", product.identifier);
         UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Failed to install %@: No content to install.", product.skProduct.localizedTitle] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-        dispatch_sync(dispatch_get_main_queue(), ^{
-            [alert show];
-        });
+        [self showAlert:alert];
         //Finish the failed transaction.
         if (transaction) {
             [[SKPaymentQueue defaultQueue] finishTransaction:transaction];
@@ -812,9 +839,7 @@
     NSLog(@"SKDownload for product %@ failed: %@", download.transaction.payment.productIdentifier, download.error.localizedDescription);
     MKProduct *product = _products[download.transaction.payment.productIdentifier];
     UIAlertView *alert = [[UIAlertView alloc] initWithTitle:@"Error" message:[NSString stringWithFormat:@"Failed to download content for %@: %@", product.skProduct.localizedTitle, download.error.localizedDescription] delegate:nil cancelButtonTitle:@"OK" otherButtonTitles:nil];
-    dispatch_sync(dispatch_get_main_queue(), ^{
-        [alert show];
-    });
+    [self showAlert:alert];
     //Finish the failed transaction.
     [[SKPaymentQueue defaultQueue] finishTransaction:download.transaction];
     product.purchaseInProgress = NO;
@@ -17,6 +17,7 @@
 
 @class MKProduct;
 @class SKProduct;
+@class MKApplicationReceipt;
 
 /** The type of product the MKProduct represents*/
 typedef enum : NSUInteger {
@@ -144,6 +145,11 @@ typedef enum : NSUInteger {
  Call this method to refresh the internal cached properties. This should be run on product purchase, deletion, and install.
  */
 - (void)refreshProductProperties;
+/**Refreshes the internal cached properties from a receipt that was already validated, without validating it again. Use it to refresh many products from one validation.
+ @param receipt The validated application receipt.
+ @param entitled Wether or not the receipt entitles the product now, as answered by indexesOfEntitledProductIdentifiers:.
+ */
+- (void)refreshProductPropertiesWithReceipt:(MKApplicationReceipt *)receipt entitled:(BOOL)entitled;
 
 
 @end
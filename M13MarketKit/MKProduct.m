@@ -27,6 +27,10 @@
 @property (nonatomic, assign, readonly) BOOL isUpToDate;
 /**The receipt for the product.*/
 @property (nonatomic, strong, readonly) MKInAppPurchaseReceipt *receipt;
+/**The application receipt the product receipt was found in.*/
+@property (nonatomic, strong, readonly) MKApplicationReceipt *applicationReceipt;
+/**Wether or not the receipt has been validated since launch.*/
+@property (nonatomic, assign, readonly) BOOL hasCheckedReceipt;
 
 @end
 
@@ -53,6 +57,33 @@
 }
 
 - (void)refreshProductProperties
+{
+    [self refreshLocalProperties];
+    
+    //Check for a receipt
+    [[MKReceiptValidator sharedValidator] validateReceiptWithCompletion:^(BOOL validAppReceipt, MKApplicationReceipt *receipt, NSError *error) {
+        if (validAppReceipt && receipt) {
+            [self applyReceipt:receipt entitled:[receipt isProductIdentifier:_identifier entitledAtDate:[NSDate date]]];
+        } else {
+            _hasCheckedReceipt = YES;
+        }
+        if ([_delegate respondsToSelector:@selector(productInformationUpdated:)]) {
+            [_delegate productInformationUpdated:self];
+        }
+    } forceRefresh:NO];
+}
+
+- (void)refreshProductPropertiesWithReceipt:(MKApplicationReceipt *)receipt entitled:(BOOL)entitled
+{
+    [self refreshLocalProperties];
+    [self applyReceipt:receipt entitled:entitled];
+    if ([_delegate respondsToSelector:@selector(productInformationUpdated:)]) {
+        [_delegate productInformationUpdated:self];
+    }
+}
+
+/**Refreshes the properties that do not depend on the receipt.*/
+- (void)refreshLocalProperties
 {
     //Check the minimum application version.
     NSString *productVersion = [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleShortVersionString"];
@@ -76,21 +107,20 @@
             _isUpToDate = NO;
         }
     }
-    
-    //Check for a receipt
-    [[MKReceiptValidator sharedValidator] validateReceiptWithCompletion:^(BOOL validAppReceipt, MKApplicationReceipt *receipt, NSError *error) {
-        if (validAppReceipt && receipt) {
-            for (MKInAppPurchaseReceipt *iapReceipt in receipt.inAppPurchaseReceipts) {
-                if ([iapReceipt.productIdentifier isEqualToString:_identifier]) {
-                    _receipt = iapReceipt;
-                    _isPurchased = YES;
-                }
-            }
-        }
-        if ([_delegate respondsToSelector:@selector(productInformationUpdated:)]) {
-            [_delegate productInformationUpdated:self];
-        }
-    } forceRefresh:NO];
+}
+
+/**Records the product's receipts from a validated application receipt.
+ @param entitled Wether or not the receipt entitles the product now. A subscription that expired, or a purchase that was canceled, is not.
+ */
+- (void)applyReceipt:(MKApplicationReceipt *)receipt entitled:(BOOL)entitled
+{
+    NSArray *iapReceipts = [receipt inAppPurchaseReceiptsForProductIdentifier:_identifier];
+    if (iapReceipts.count > 0) {
+        _receipt = iapReceipts.lastObject;
+        _applicationReceipt = receipt;
+    }
+    _isPurchased = entitled;
+    _hasCheckedReceipt = YES;
 }
 
 - (NSComparisonResult)compareVersionString:(NSString *)string1 toString:(NSString *)string2
@@ -132,8 +162,19 @@
         return MKProductStatePurchaseInProgress;
     }
     
+    //Until the receipt is validated, answer from the entitlements recorded by the previous validation.
+    BOOL isPurchased = _isPurchased;
+    BOOL hasReceipt = _receipt != nil;
+    if (!_hasCheckedReceipt) {
+        MKCachedEntitlement cachedEntitlement = [[MKReceiptValidator sharedValidator] cachedEntitlementOfProductIdentifier:_identifier];
+        if (cachedEntitlement == MKCachedEntitlementNotEntitled) {
+            return MKProductStateAvailableToPurchase;
+        }
+        isPurchased = hasReceipt = (cachedEntitlement == MKCachedEntitlementEntitled);
+    }
+    
     //Available
-    if (_availableForPurchase && _skProduct && !_isPurchased) {
+    if (_availableForPurchase && _skProduct && !isPurchased) {
         return MKProductStateAvailableToPurchase;
     }
     
@@ -141,19 +182,24 @@
         return MKProductStateAvailableToPurchase;
     }
     
-    //Was the purchased canceled by apple?
-    if (_receipt.cancelationDate) {
+    //Has the subscription lapsed? Every renewal has its own receipt, so all of them are checked, not only the last one.
+    if (_type == MKProductTypeAutoRenewableSubscription && _applicationReceipt) {
+        if (![_applicationReceipt isProductIdentifier:_identifier entitledAtDate:[NSDate date]]) {
+            return MKProductStateAvailableToPurchase;
+        }
+    } else if (_receipt.cancelationDate) {
+        //Was the purchased canceled by apple?
         if ([[NSDate date] compare:_receipt.cancelationDate] == NSOrderedDescending) {
             return MKProductStateAvailableToPurchase;
         }
     }
     
     //Purchased
-    if (_isPurchased && _isInstalled && _isUpToDate && _receipt) {
+    if (isPurchased && _isInstalled && _isUpToDate && hasReceipt) {
         return MKProductStatePurchasedUpToDate;
-    } else if (_isPurchased && _isInstalled && _receipt) {
+    } else if (isPurchased && _isInstalled && hasReceipt) {
         return MKProductStatePurchasedNeedsUpdate;
-    } else if (_isPurchased && _receipt) {
+    } else if (isPurchased && hasReceipt) {
         return MKProductStatePurchasedNotInstalled;
     }
     
@@ -0,0 +1,199 @@
+//
+//  MKReceiptArena.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKReceiptArena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**Every allocation is aligned to this, enough for any type the decoder stores.*/
+#define kMKReceiptArenaAlignment 16
+
+#define kMKReceiptArenaMinimumChunk 4096
+
+/**A chunk of memory allocations are carved from. The allocations follow the header.*/
+typedef struct MKReceiptArenaChunk {
+    struct MKReceiptArenaChunk *previous;
+    size_t size;
+    size_t used;
+} MKReceiptArenaChunk;
+
+struct MKReceiptArena {
+    /**The chunk allocations are made from, it links to the older ones.*/
+    MKReceiptArenaChunk *chunk;
+    /**The most recent allocation, the only one that can grow in place.*/
+    uint8_t *last;
+    size_t bytesAllocated;
+};
+
+static size_t MKReceiptArenaAlign(size_t size)
+{
+    return (size + kMKReceiptArenaAlignment - 1) & ~(size_t)(kMKReceiptArenaAlignment - 1);
+}
+
+/**The first byte of a chunk that can be allocated.*/
+static uint8_t *MKReceiptArenaChunkStart(MKReceiptArenaChunk *chunk)
+{
+    return (uint8_t *)chunk + MKReceiptArenaAlign(sizeof(MKReceiptArenaChunk));
+}
+
+static MKReceiptArenaChunk *MKReceiptArenaChunkCreate(size_t size, MKReceiptArenaChunk *previous)
+{
+    MKReceiptArenaChunk *chunk = malloc(MKReceiptArenaAlign(sizeof(MKReceiptArenaChunk)) + size);
+    if (chunk) {
+        chunk->previous = previous;
+        chunk->size = size;
+        chunk->used = 0;
+    }
+    return chunk;
+}
+
+MKReceiptArena *MKReceiptArenaCreate(size_t capacity)
+{
+    //The arena itself is the first allocation of its first chunk.
+    size_t size = MKReceiptArenaAlign(capacity) + MKReceiptArenaAlign(sizeof(MKReceiptArena));
+    if (size < kMKReceiptArenaMinimumChunk) {
+        size = kMKReceiptArenaMinimumChunk;
+    }
+    MKReceiptArenaChunk *chunk = MKReceiptArenaChunkCreate(size, NULL);
+    if (!chunk) {
+        return NULL;
+    }
+    MKReceiptArena *arena = (MKReceiptArena *)MKReceiptArenaChunkStart(chunk);
+    chunk->used = MKReceiptArenaAlign(sizeof(MKReceiptArena));
+    arena->chunk = chunk;
+    arena->last = NULL;
+    arena->bytesAllocated = 0;
+    return arena;
+}
+
+void MKReceiptArenaFree(MKReceiptArena *arena)
+{
+    if (!arena) {
+        return;
+    }
+    MKReceiptArenaChunk *chunk = arena->chunk;
+    while (chunk) {
+        MKReceiptArenaChunk *previous = chunk->previous;
+        free(chunk);
+        chunk = previous;
+    }
+}
+
+void *MKReceiptArenaAllocate(MKReceiptArena *arena, size_t size)
+{
+    size_t alignedSize = MKReceiptArenaAlign(size ? size : 1);
+    if (alignedSize < size) {
+        return NULL;
+    }
+
+    MKReceiptArenaChunk *chunk = arena->chunk;
+    if (chunk->size - chunk->used < alignedSize) {
+        size_t chunkSize = chunk->size * 2;
+        if (chunkSize < alignedSize) {
+            chunkSize = alignedSize;
+        }
+        chunk = MKReceiptArenaChunkCreate(chunkSize, arena->chunk);
+        if (!chunk) {
+            return NULL;
+        }
+        arena->chunk = chunk;
+    }
+
+    uint8_t *pointer = MKReceiptArenaChunkStart(chunk) + chunk->used;
+    chunk->used += alignedSize;
+    arena->last = pointer;
+    arena->bytesAllocated += alignedSize;
+    return pointer;
+}
+
+void *MKReceiptArenaResize(MKReceiptArena *arena, void *pointer, size_t size, size_t newSize)
+{
+    if (!pointer) {
+        return MKReceiptArenaAllocate(arena, newSize);
+    }
+
+    //The newest allocation ends where the chunk's free space begins, so it can take more of it.
+    MKReceiptArenaChunk *chunk = arena->chunk;
+    if (pointer == arena->last) {
+        size_t offset = (size_t)((uint8_t *)pointer - MKReceiptArenaChunkStart(chunk));
+        size_t alignedSize = MKReceiptArenaAlign(newSize ? newSize : 1);
+        if (alignedSize >= newSize && alignedSize <= chunk->size - offset) {
+            size_t previousSize = chunk->used - offset;
+            chunk->used = offset + alignedSize;
+            arena->bytesAllocated = arena->bytesAllocated - previousSize + alignedSize;
+            return pointer;
+        }
+    }
+
+    void *resized = MKReceiptArenaAllocate(arena, newSize);
+    if (resized) {
+        memcpy(resized, pointer, size < newSize ? size : newSize);
+    }
+    return resized;
+}
+
+size_t MKReceiptArenaBytesAllocated(const MKReceiptArena *arena)
+{
+    return arena->bytesAllocated;
+}
+
+int MKReceiptInternTableInit(MKReceiptInternTable *table, MKReceiptArena *arena, const uint8_t *bytes, size_t capacity)
+{
+    memset(table, 0, sizeof(MKReceiptInternTable));
+    table->bytes = bytes;
+
+    //Keep the load factor at or below one half.
+    size_t slotCount = 16;
+    while (slotCount < capacity * 2) {
+        slotCount *= 2;
+    }
+
+    table->slots = MKReceiptArenaAllocate(arena, slotCount * 3 * sizeof(uint32_t));
+    if (!table->slots) {
+        return 0;
+    }
+    table->slotCount = slotCount;
+    for (size_t slot = 0; slot < slotCount; slot++) {
+        table->slots[slot * 3 + 1] = UINT32_MAX;
+    }
+    return 1;
+}
+
+uint32_t MKReceiptInternTableIntern(MKReceiptInternTable *table, uint32_t offset, uint32_t length, int *added)
+{
+    *added = 0;
+    const uint8_t *key = table->bytes + offset;
+    size_t mask = table->slotCount - 1;
+    size_t slot = MKReceiptHashBytes(key, length) & mask;
+
+    for (;;) {
+        uint32_t *entry = &table->slots[slot * 3];
+        if (entry[1] == UINT32_MAX) {
+            if ((table->count + 1) * 2 > table->slotCount) {
+                return MKReceiptInternNotFound;
+            }
+            entry[0] = offset;
+            entry[1] = length;
+            entry[2] = (uint32_t)table->count++;
+            *added = 1;
+            return entry[2];
+        }
+        if (entry[1] == length && memcmp(table->bytes + entry[0], key, length) == 0) {
+            return entry[2];
+        }
+        slot = (slot + 1) & mask;
+    }
+}
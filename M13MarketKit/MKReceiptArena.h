@@ -0,0 +1,99 @@
+//
+//  MKReceiptArena.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptArena_h
+#define M13MarketKit_MKReceiptArena_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**A bump allocator. Allocations are carved out of large chunks and are only released all at once, when the arena is freed.*/
+typedef struct MKReceiptArena MKReceiptArena;
+
+/**Creates an arena.
+ @param capacity The size of the first chunk. Later chunks double in size, so a good estimate saves chunks but is not required.
+ @return The arena, or NULL if memory could not be allocated. Must be freed with MKReceiptArenaFree.
+ */
+MKReceiptArena *MKReceiptArenaCreate(size_t capacity);
+
+/**Frees the arena and every allocation made from it.
+ @param arena The arena, may be NULL.
+ */
+void MKReceiptArenaFree(MKReceiptArena *arena);
+
+/**Allocates memory aligned for any type. The memory is not cleared.
+ @return The memory, or NULL if it could not be allocated.
+ */
+void *MKReceiptArenaAllocate(MKReceiptArena *arena, size_t size);
+
+/**Resizes an allocation. The most recent allocation grows in place while its chunk has room, any other is copied.
+ @param pointer The allocation, may be NULL.
+ @param size The current size of the allocation.
+ @param newSize The new size.
+ @return The resized allocation, or NULL if memory could not be allocated, in which case the allocation is unchanged.
+ */
+void *MKReceiptArenaResize(MKReceiptArena *arena, void *pointer, size_t size, size_t newSize);
+
+/**The number of bytes handed out by the arena.*/
+size_t MKReceiptArenaBytesAllocated(const MKReceiptArena *arena);
+
+/**FNV-1a, the hash of every table keyed by receipt values. The keys are short identifiers and dates, so this is cheaper than anything fancier.*/
+static inline uint32_t MKReceiptHashBytes(const uint8_t *bytes, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**Returned by MKReceiptInternTableIntern when there is no value for a key.*/
+#define MKReceiptInternNotFound UINT32_MAX
+
+/**Maps byte strings of a buffer to small integers, so equal values (product identifiers, dates) are only converted to objects once. The table lives in an arena.*/
+typedef struct {
+    /**The buffer the keys are read from.*/
+    const uint8_t *bytes;
+    /**Open addressed slots holding the offset, length and value of each key. A length of UINT32_MAX marks an empty slot.*/
+    uint32_t *slots;
+    /**The number of slots, always a power of two.*/
+    size_t slotCount;
+    /**The number of keys in the table.*/
+    size_t count;
+} MKReceiptInternTable;
+
+/**Creates an intern table for at most the given number of keys.
+ @return 1 on success, 0 if memory could not be allocated.
+ */
+int MKReceiptInternTableInit(MKReceiptInternTable *table, MKReceiptArena *arena, const uint8_t *bytes, size_t capacity);
+
+/**Looks up a key, adding it if it is new. New keys are numbered 0, 1, 2... in the order they are added.
+ @param offset The offset of the key in the buffer.
+ @param length The length of the key.
+ @param added Receives 1 if the key is new, 0 if it was already in the table.
+ @return The number of the key, or MKReceiptInternNotFound if the table is full.
+ */
+uint32_t MKReceiptInternTableIntern(MKReceiptInternTable *table, uint32_t offset, uint32_t length, int *added);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
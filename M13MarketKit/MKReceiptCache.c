@@ -0,0 +1,246 @@
+//
+//  MKReceiptCache.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKReceiptCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+
+#define kMKReceiptCacheMagic 0x43524B4D // "MKRC"
+#define kMKReceiptCacheVersion 2
+
+/**Cache files larger than this are not read. Receipts are far smaller.*/
+#define kMKReceiptCacheMaximumLength (64 * 1024 * 1024)
+
+/**The fixed size header of the cache file. It is followed by the signed content, then the transaction records. The authentication code covers everything after itself.*/
+typedef struct {
+    uint8_t mac[MKReceiptCacheSecretLength];
+    uint32_t magic;
+    uint32_t version;
+    /**The size of a transaction record, so files written by a build with a different layout are ignored.*/
+    uint32_t recordSize;
+    uint8_t key[MKReceiptCacheKeyLength];
+    uint32_t contentLength;
+    uint32_t transactionCount;
+    MKReceiptRange bundleIdentifier;
+    MKReceiptRange bundleIdentifierData;
+    MKReceiptRange applicationVersion;
+    MKReceiptRange opaqueValue;
+    MKReceiptRange sha1Hash;
+    MKReceiptRange originalApplicationVersion;
+    MKReceiptRange receiptExpirationDate;
+} MKReceiptCacheHeader;
+
+static void MKReceiptCacheDigestComponent(SHA256_CTX *context, const void *bytes, size_t length)
+{
+    //Prefix each component with its length so no two inputs produce the same stream.
+    uint64_t prefix = length;
+    SHA256_Update(context, &prefix, sizeof(prefix));
+    if (length) {
+        SHA256_Update(context, bytes, length);
+    }
+}
+
+void MKReceiptCacheComputeKey(const uint8_t *receipt, size_t receiptLength, const char *applicationVersion, const uint8_t *deviceIdentifierHash, size_t deviceIdentifierHashLength, uint8_t key[MKReceiptCacheKeyLength])
+{
+    SHA256_CTX context;
+    SHA256_Init(&context);
+    MKReceiptCacheDigestComponent(&context, receipt, receiptLength);
+    MKReceiptCacheDigestComponent(&context, applicationVersion, applicationVersion ? strlen(applicationVersion) : 0);
+    MKReceiptCacheDigestComponent(&context, deviceIdentifierHash, deviceIdentifierHashLength);
+    SHA256_Final(key, &context);
+}
+
+/**Computes the authentication code of a cache file.*/
+static void MKReceiptCacheComputeMAC(const uint8_t secret[MKReceiptCacheSecretLength], const uint8_t *file, size_t length, uint8_t mac[MKReceiptCacheSecretLength])
+{
+    unsigned int macLength = MKReceiptCacheSecretLength;
+    HMAC(EVP_sha256(), secret, MKReceiptCacheSecretLength, file + MKReceiptCacheSecretLength, length - MKReceiptCacheSecretLength, mac, &macLength);
+}
+
+static int MKReceiptCacheRangesAreValid(const MKReceiptRange *ranges, size_t count, size_t contentLength)
+{
+    for (size_t i = 0; i < count; i++) {
+        if ((uint64_t)ranges[i].offset + ranges[i].length > contentLength) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**Checks that no range of the payload points outside of the content, whatever is on disk.*/
+static int MKReceiptCachePayloadIsValid(const MKReceiptPayload *payload, size_t contentLength)
+{
+    const MKReceiptRange ranges[] = {payload->bundleIdentifier, payload->bundleIdentifierData, payload->applicationVersion, payload->opaqueValue, payload->sha1Hash, payload->originalApplicationVersion, payload->receiptExpirationDate};
+    if (!MKReceiptCacheRangesAreValid(ranges, sizeof(ranges) / sizeof(ranges[0]), contentLength)) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < payload->transactionCount; i++) {
+        const MKReceiptTransaction *transaction = &payload->transactions[i];
+        const MKReceiptRange transactionRanges[] = {transaction->productIdentifier, transaction->transactionIdentifier, transaction->originalTransactionIdentifier, transaction->purchaseDate, transaction->originalPurchaseDate, transaction->subscriptionExpirationDate, transaction->cancellationDate};
+        if (!MKReceiptCacheRangesAreValid(transactionRanges, sizeof(transactionRanges) / sizeof(transactionRanges[0]), contentLength)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int MKReceiptCacheRead(const char *path, const uint8_t key[MKReceiptCacheKeyLength], const uint8_t secret[MKReceiptCacheSecretLength], MKReceiptCacheEntry *entry)
+{
+    memset(entry, 0, sizeof(MKReceiptCacheEntry));
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return 0;
+    }
+
+    //The whole file is read so it can be authenticated, its length bounds every allocation.
+    long fileLength = -1;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        fileLength = ftell(fp);
+    }
+    if (fileLength < (long)sizeof(MKReceiptCacheHeader) || fileLength > kMKReceiptCacheMaximumLength || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return 0;
+    }
+    size_t length = (size_t)fileLength;
+    uint8_t *file = malloc(length);
+    int valid = file && fread(file, 1, length, fp) == length;
+    fclose(fp);
+
+    //The sizes are checked before anything is allocated from them, the authentication code before anything is returned.
+    MKReceiptCacheHeader header;
+    if (valid) {
+        memcpy(&header, file, sizeof(header));
+        valid = header.magic == kMKReceiptCacheMagic && header.version == kMKReceiptCacheVersion && header.recordSize == sizeof(MKReceiptTransaction) && memcmp(header.key, key, MKReceiptCacheKeyLength) == 0 && (uint64_t)sizeof(header) + header.contentLength + (uint64_t)header.transactionCount * sizeof(MKReceiptTransaction) == length;
+    }
+    if (valid) {
+        uint8_t mac[MKReceiptCacheSecretLength];
+        MKReceiptCacheComputeMAC(secret, file, length, mac);
+        valid = CRYPTO_memcmp(mac, header.mac, MKReceiptCacheSecretLength) == 0;
+    }
+    if (!valid) {
+        free(file);
+        return 0;
+    }
+
+    entry->contentLength = header.contentLength;
+    entry->content = malloc(header.contentLength ? header.contentLength : 1);
+    entry->payload.transactionCount = header.transactionCount;
+    entry->payload.transactionCapacity = header.transactionCount;
+    entry->payload.transactions = malloc((header.transactionCount ? header.transactionCount : 1) * sizeof(MKReceiptTransaction));
+    valid = entry->content && entry->payload.transactions;
+    if (valid) {
+        memcpy(entry->content, file + sizeof(header), header.contentLength);
+        memcpy(entry->payload.transactions, file + sizeof(header) + header.contentLength, header.transactionCount * sizeof(MKReceiptTransaction));
+    }
+    free(file);
+
+    entry->payload.bundleIdentifier = header.bundleIdentifier;
+    entry->payload.bundleIdentifierData = header.bundleIdentifierData;
+    entry->payload.applicationVersion = header.applicationVersion;
+    entry->payload.opaqueValue = header.opaqueValue;
+    entry->payload.sha1Hash = header.sha1Hash;
+    entry->payload.originalApplicationVersion = header.originalApplicationVersion;
+    entry->payload.receiptExpirationDate = header.receiptExpirationDate;
+
+    valid = valid && MKReceiptCachePayloadIsValid(&entry->payload, entry->contentLength);
+
+    if (!valid) {
+        MKReceiptCacheEntryFree(entry);
+        return 0;
+    }
+    return 1;
+}
+
+int MKReceiptCacheWrite(const char *path, const uint8_t key[MKReceiptCacheKeyLength], const uint8_t secret[MKReceiptCacheSecretLength], const uint8_t *content, size_t contentLength, const MKReceiptPayload *payload)
+{
+    if ((uint64_t)contentLength > UINT32_MAX || (uint64_t)payload->transactionCount > UINT32_MAX) {
+        return 0;
+    }
+
+    size_t transactionsLength = payload->transactionCount * sizeof(MKReceiptTransaction);
+    size_t length = sizeof(MKReceiptCacheHeader) + contentLength + transactionsLength;
+    uint8_t *file = calloc(1, length);
+    if (!file) {
+        return 0;
+    }
+
+    MKReceiptCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kMKReceiptCacheMagic;
+    header.version = kMKReceiptCacheVersion;
+    header.recordSize = sizeof(MKReceiptTransaction);
+    memcpy(header.key, key, MKReceiptCacheKeyLength);
+    header.contentLength = (uint32_t)contentLength;
+    header.transactionCount = (uint32_t)payload->transactionCount;
+    header.bundleIdentifier = payload->bundleIdentifier;
+    header.bundleIdentifierData = payload->bundleIdentifierData;
+    header.applicationVersion = payload->applicationVersion;
+    header.opaqueValue = payload->opaqueValue;
+    header.sha1Hash = payload->sha1Hash;
+    header.originalApplicationVersion = payload->originalApplicationVersion;
+    header.receiptExpirationDate = payload->receiptExpirationDate;
+
+    memcpy(file, &header, sizeof(header));
+    if (contentLength) {
+        memcpy(file + sizeof(header), content, contentLength);
+    }
+    if (transactionsLength) {
+        memcpy(file + sizeof(header) + contentLength, payload->transactions, transactionsLength);
+    }
+    MKReceiptCacheComputeMAC(secret, file, length, file);
+
+    //Write to a temporary file and rename it over the cache, so readers never see a partial file.
+    size_t pathLength = strlen(path);
+    char *temporaryPath = malloc(pathLength + 5);
+    if (!temporaryPath) {
+        free(file);
+        return 0;
+    }
+    memcpy(temporaryPath, path, pathLength);
+    memcpy(temporaryPath + pathLength, ".tmp", 5);
+
+    FILE *fp = fopen(temporaryPath, "wb");
+    int written = fp && fwrite(file, 1, length, fp) == length;
+    if (fp) {
+        written = (fclose(fp) == 0) && written;
+    }
+    free(file);
+
+    if (written) {
+        written = rename(temporaryPath, path) == 0;
+    }
+    if (!written) {
+        remove(temporaryPath);
+    }
+
+    free(temporaryPath);
+    return written;
+}
+
+void MKReceiptCacheEntryFree(MKReceiptCacheEntry *entry)
+{
+    free(entry->content);
+    MKReceiptPayloadFree(&entry->payload);
+    memset(entry, 0, sizeof(MKReceiptCacheEntry));
+}
@@ -0,0 +1,79 @@
+//
+//  MKReceiptCache.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptCache_h
+#define M13MarketKit_MKReceiptCache_h
+
+#include "MKReceiptDecoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**The length of a cache key (SHA-256).*/
+#define MKReceiptCacheKeyLength 32
+
+/**The length of the secret that authenticates cache files (HMAC-SHA256).*/
+#define MKReceiptCacheSecretLength 32
+
+/**A verified receipt loaded from the cache.*/
+typedef struct {
+    /**The signed content of the receipt. Allocated with malloc.*/
+    uint8_t *content;
+    /**The length of the signed content.*/
+    size_t contentLength;
+    /**The decoded payload, the ranges point into content.*/
+    MKReceiptPayload payload;
+} MKReceiptCacheEntry;
+
+/**Computes the cache key of a receipt: a digest of the receipt file, the application version and the device identifier hash. Any change to one of them misses the cache.
+ @param receipt The bytes of the receipt file.
+ @param receiptLength The length of the receipt file.
+ @param applicationVersion The NUL terminated application version.
+ @param deviceIdentifierHash A hash of the device identifier.
+ @param deviceIdentifierHashLength The length of the device identifier hash.
+ @param key Receives the key.
+ */
+void MKReceiptCacheComputeKey(const uint8_t *receipt, size_t receiptLength, const char *applicationVersion, const uint8_t *deviceIdentifierHash, size_t deviceIdentifierHashLength, uint8_t key[MKReceiptCacheKeyLength]);
+
+/**Loads the cached receipt for the given key.
+ @param path The path of the cache file.
+ @param key The key of the receipt.
+ @param secret The secret the cache file was written with. Files written without it are ignored.
+ @param entry Receives the receipt. Must be freed with MKReceiptCacheEntryFree if the load succeeds.
+ @return 1 if the cache holds the receipt for the key, 0 if not, or if the cache file is damaged or does not authenticate.
+ */
+int MKReceiptCacheRead(const char *path, const uint8_t key[MKReceiptCacheKeyLength], const uint8_t secret[MKReceiptCacheSecretLength], MKReceiptCacheEntry *entry);
+
+/**Stores a receipt that passed signature verification, replacing any previous receipt. The file is replaced atomically.
+ @note Only verified receipts are stored. A failure may be temporary, recording it would keep it until the receipt changes.
+ @param path The path of the cache file.
+ @param key The key of the receipt.
+ @param secret The secret that authenticates the cache file. It must not be readable by anyone able to write the file.
+ @param content The signed content.
+ @param contentLength The length of the signed content.
+ @param payload The decoded payload.
+ @return 1 on success, 0 if the file could not be written.
+ */
+int MKReceiptCacheWrite(const char *path, const uint8_t key[MKReceiptCacheKeyLength], const uint8_t secret[MKReceiptCacheSecretLength], const uint8_t *content, size_t contentLength, const MKReceiptPayload *payload);
+
+/**Frees the memory held by a cache entry.*/
+void MKReceiptCacheEntryFree(MKReceiptCacheEntry *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
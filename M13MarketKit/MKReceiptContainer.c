@@ -0,0 +1,378 @@
+//
+//  MKReceiptContainer.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKReceiptContainer.h"
+
+#include <string.h>
+
+#define kBERTagInteger 0x02
+#define kBERTagOctetString 0x04
+#define kBERTagObjectIdentifier 0x06
+#define kBERTagConstructedOctetString 0x24
+#define kBERTagSequence 0x30
+#define kBERTagSet 0x31
+#define kBERTagContextZero 0xA0
+#define kBERTagContextOne 0xA1
+
+//Nesting is shallow in a receipt container, anything deeper is malformed.
+#define kBERMaximumDepth 32
+
+// 1.2.840.113549.1.7.2 and 1.2.840.113549.1.7.1
+static const uint8_t MKPKCS7SignedDataOID[] = {0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x07, 0x02};
+static const uint8_t MKPKCS7DataOID[] = {0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x07, 0x01};
+
+/**A BER element. For an indefinite length element, the end is the offset after its end-of-contents octets.*/
+typedef struct {
+    uint8_t tag;
+    size_t contentOffset;
+    size_t contentLength;
+    size_t end;
+} MKBERElement;
+
+static int MKBERReadElement(const uint8_t *bytes, size_t offset, size_t limit, int depth, MKBERElement *element);
+
+/**Finds the end-of-contents octets closing an indefinite length element whose contents start at offset.*/
+static int MKBERFindEndOfContents(const uint8_t *bytes, size_t offset, size_t limit, int depth, size_t *end)
+{
+    while (offset + 2 <= limit) {
+        if (bytes[offset] == 0x00 && bytes[offset + 1] == 0x00) {
+            *end = offset;
+            return 1;
+        }
+        MKBERElement child;
+        if (!MKBERReadElement(bytes, offset, limit, depth + 1, &child)) {
+            return 0;
+        }
+        offset = child.end;
+    }
+    return 0;
+}
+
+static int MKBERReadElement(const uint8_t *bytes, size_t offset, size_t limit, int depth, MKBERElement *element)
+{
+    if (depth > kBERMaximumDepth || limit < offset || limit - offset < 2) {
+        return 0;
+    }
+
+    element->tag = bytes[offset++];
+    //High tag numbers are not used in receipts.
+    if ((element->tag & 0x1F) == 0x1F) {
+        return 0;
+    }
+
+    size_t length = bytes[offset++];
+    if (length == 0x80) {
+        //Indefinite length, only allowed for constructed elements.
+        size_t contentEnd;
+        if (!(element->tag & 0x20) || !MKBERFindEndOfContents(bytes, offset, limit, depth, &contentEnd)) {
+            return 0;
+        }
+        element->contentOffset = offset;
+        element->contentLength = contentEnd - offset;
+        element->end = contentEnd + 2;
+        return 1;
+    }
+
+    if (length & 0x80) {
+        size_t count = length & 0x7F;
+        if (count > 4 || limit - offset < count) {
+            return 0;
+        }
+        length = 0;
+        while (count--) {
+            length = (length << 8) | bytes[offset++];
+        }
+    }
+    if (length > limit - offset) {
+        return 0;
+    }
+
+    element->contentOffset = offset;
+    element->contentLength = length;
+    element->end = offset + length;
+    return 1;
+}
+
+static int MKBERElementIsObjectIdentifier(const uint8_t *bytes, const MKBERElement *element, const uint8_t *identifier, size_t length)
+{
+    return element->tag == kBERTagObjectIdentifier && element->contentLength == length && memcmp(bytes + element->contentOffset, identifier, length) == 0;
+}
+
+/**Walks to the signed content. On success, next is the offset of the element after the encapsulated content info and limit is the end of the SignedData contents.*/
+static int MKReceiptContainerReadContent(const uint8_t *bytes, size_t length, MKReceiptRange *content, MKBERElement *digestAlgorithms, size_t *next, size_t *signedDataLimit)
+{
+    MKBERElement contentInfo, contentType, explicitContent, signedData, element;
+
+    //ContentInfo ::= SEQUENCE { contentType signedData, content [0] EXPLICIT SignedData }
+    if (!bytes || !MKBERReadElement(bytes, 0, length, 0, &contentInfo) || contentInfo.tag != kBERTagSequence) {
+        return 0;
+    }
+    size_t limit = contentInfo.contentOffset + contentInfo.contentLength;
+    if (!MKBERReadElement(bytes, contentInfo.contentOffset, limit, 1, &contentType) || !MKBERElementIsObjectIdentifier(bytes, &contentType, MKPKCS7SignedDataOID, sizeof(MKPKCS7SignedDataOID))) {
+        return 0;
+    }
+    if (!MKBERReadElement(bytes, contentType.end, limit, 1, &explicitContent) || explicitContent.tag != kBERTagContextZero) {
+        return 0;
+    }
+    limit = explicitContent.contentOffset + explicitContent.contentLength;
+    if (!MKBERReadElement(bytes, explicitContent.contentOffset, limit, 2, &signedData) || signedData.tag != kBERTagSequence) {
+        return 0;
+    }
+
+    //SignedData ::= SEQUENCE { version INTEGER, digestAlgorithms SET, contentInfo ContentInfo, ... }
+    limit = signedData.contentOffset + signedData.contentLength;
+    *signedDataLimit = limit;
+    if (!MKBERReadElement(bytes, signedData.contentOffset, limit, 3, &element)) {
+        return 0;
+    }
+    if (!MKBERReadElement(bytes, element.end, limit, 3, digestAlgorithms) || digestAlgorithms->tag != kBERTagSet) {
+        return 0;
+    }
+    if (!MKBERReadElement(bytes, digestAlgorithms->end, limit, 3, &contentInfo) || contentInfo.tag != kBERTagSequence) {
+        return 0;
+    }
+    *next = contentInfo.end;
+
+    //ContentInfo ::= SEQUENCE { contentType data, content [0] EXPLICIT OCTET STRING }
+    limit = contentInfo.contentOffset + contentInfo.contentLength;
+    if (!MKBERReadElement(bytes, contentInfo.contentOffset, limit, 4, &contentType) || !MKBERElementIsObjectIdentifier(bytes, &contentType, MKPKCS7DataOID, sizeof(MKPKCS7DataOID))) {
+        return 0;
+    }
+    if (!MKBERReadElement(bytes, contentType.end, limit, 4, &explicitContent) || explicitContent.tag != kBERTagContextZero) {
+        return 0;
+    }
+    limit = explicitContent.contentOffset + explicitContent.contentLength;
+    if (!MKBERReadElement(bytes, explicitContent.contentOffset, limit, 5, &element)) {
+        return 0;
+    }
+
+    if (element.tag == kBERTagConstructedOctetString) {
+        //A constructed octet string is only usable in place if it holds a single chunk.
+        size_t chunksEnd = element.contentOffset + element.contentLength;
+        if (!MKBERReadElement(bytes, element.contentOffset, chunksEnd, 6, &element) || element.tag != kBERTagOctetString || element.end != chunksEnd) {
+            return 0;
+        }
+    } else if (element.tag != kBERTagOctetString) {
+        return 0;
+    }
+
+    if (element.contentOffset > UINT32_MAX || element.contentLength > UINT32_MAX) {
+        return 0;
+    }
+    content->offset = (uint32_t)element.contentOffset;
+    content->length = (uint32_t)element.contentLength;
+    return 1;
+}
+
+int MKReceiptContainerLocateContent(const uint8_t *bytes, size_t length, MKReceiptRange *content)
+{
+    MKBERElement digestAlgorithms;
+    size_t next, limit;
+    return MKReceiptContainerReadContent(bytes, length, content, &digestAlgorithms, &next, &limit);
+}
+
+/**The range of a whole element, header included.*/
+static int MKBERElementRange(const MKBERElement *element, size_t offset, MKReceiptRange *range)
+{
+    if (element->end > UINT32_MAX) {
+        return 0;
+    }
+    range->offset = (uint32_t)offset;
+    range->length = (uint32_t)(element->end - offset);
+    return 1;
+}
+
+/**Finds the issuer and serial number of a certificate, both as whole elements.*/
+static int MKReceiptContainerReadCertificateIssuer(const uint8_t *bytes, MKReceiptRange certificate, MKReceiptRange *issuer, MKReceiptRange *serialNumber)
+{
+    MKBERElement element, tbsCertificate;
+
+    //Certificate ::= SEQUENCE { tbsCertificate SEQUENCE { version [0] OPTIONAL, serialNumber, signature, issuer, ... }, ... }
+    size_t limit = (size_t)certificate.offset + certificate.length;
+    if (!MKBERReadElement(bytes, certificate.offset, limit, 0, &element) || element.tag != kBERTagSequence) {
+        return 0;
+    }
+    limit = element.contentOffset + element.contentLength;
+    if (!MKBERReadElement(bytes, element.contentOffset, limit, 1, &tbsCertificate) || tbsCertificate.tag != kBERTagSequence) {
+        return 0;
+    }
+    limit = tbsCertificate.contentOffset + tbsCertificate.contentLength;
+    size_t offset = tbsCertificate.contentOffset;
+    if (!MKBERReadElement(bytes, offset, limit, 2, &element)) {
+        return 0;
+    }
+    if (element.tag == kBERTagContextZero) {
+        offset = element.end;
+        if (!MKBERReadElement(bytes, offset, limit, 2, &element)) {
+            return 0;
+        }
+    }
+    if (element.tag != kBERTagInteger || !MKBERElementRange(&element, offset, serialNumber)) {
+        return 0;
+    }
+    if (!MKBERReadElement(bytes, element.end, limit, 2, &element) || element.tag != kBERTagSequence) {
+        return 0;
+    }
+    offset = element.end;
+    if (!MKBERReadElement(bytes, offset, limit, 2, &element) || element.tag != kBERTagSequence) {
+        return 0;
+    }
+    return MKBERElementRange(&element, offset, issuer);
+}
+
+/**Checks that the signer's digest algorithm is one of the SignedData digest algorithms, as OpenSSL only digests the content with those.*/
+static int MKReceiptContainerListsDigestAlgorithm(const uint8_t *bytes, const MKBERElement *digestAlgorithms, MKReceiptRange digestAlgorithm)
+{
+    size_t offset = digestAlgorithms->contentOffset;
+    size_t limit = digestAlgorithms->contentOffset + digestAlgorithms->contentLength;
+    int listed = 0;
+    while (offset < limit) {
+        MKBERElement algorithm, identifier;
+        if (!MKBERReadElement(bytes, offset, limit, 4, &algorithm) || algorithm.tag != kBERTagSequence) {
+            return 0;
+        }
+        size_t algorithmLimit = algorithm.contentOffset + algorithm.contentLength;
+        if (!MKBERReadElement(bytes, algorithm.contentOffset, algorithmLimit, 5, &identifier) || identifier.tag != kBERTagObjectIdentifier) {
+            return 0;
+        }
+        //The parameters, if present, must fill the rest of the algorithm identifier.
+        MKBERElement parameters;
+        if (identifier.end != algorithmLimit && (!MKBERReadElement(bytes, identifier.end, algorithmLimit, 5, &parameters) || parameters.end != algorithmLimit)) {
+            return 0;
+        }
+        if (identifier.contentLength == digestAlgorithm.length && memcmp(bytes + identifier.contentOffset, bytes + digestAlgorithm.offset, digestAlgorithm.length) == 0) {
+            listed = 1;
+        }
+        offset = algorithm.end;
+    }
+    return listed;
+}
+
+int MKReceiptContainerParse(const uint8_t *bytes, size_t length, MKReceiptContainer *container)
+{
+    memset(container, 0, sizeof(MKReceiptContainer));
+
+    MKBERElement digestAlgorithms;
+    size_t offset, limit;
+    if (!MKReceiptContainerReadContent(bytes, length, &container->content, &digestAlgorithms, &offset, &limit)) {
+        return 0;
+    }
+
+    //SignedData ::= SEQUENCE { ..., certificates [0] IMPLICIT OPTIONAL, crls [1] IMPLICIT OPTIONAL, signerInfos SET }
+    MKBERElement element;
+    if (!MKBERReadElement(bytes, offset, limit, 3, &element)) {
+        return 0;
+    }
+    if (element.tag == kBERTagContextZero) {
+        size_t certificatesEnd = element.contentOffset + element.contentLength;
+        size_t certificateOffset = element.contentOffset;
+        while (certificateOffset < certificatesEnd) {
+            MKBERElement certificate;
+            if (container->certificateCount == MKReceiptContainerMaximumCertificates || !MKBERReadElement(bytes, certificateOffset, certificatesEnd, 4, &certificate) || certificate.tag != kBERTagSequence) {
+                return 0;
+            }
+            if (!MKBERElementRange(&certificate, certificateOffset, &container->certificates[container->certificateCount])) {
+                return 0;
+            }
+            container->certificateCount++;
+            certificateOffset = certificate.end;
+        }
+        offset = element.end;
+        if (!MKBERReadElement(bytes, offset, limit, 3, &element)) {
+            return 0;
+        }
+    }
+    if (element.tag == kBERTagContextOne) {
+        offset = element.end;
+        if (!MKBERReadElement(bytes, offset, limit, 3, &element)) {
+            return 0;
+        }
+    }
+    if (element.tag != kBERTagSet) {
+        return 0;
+    }
+
+    //Receipts have a single signer, anything else is left to OpenSSL.
+    MKBERElement signerInfo;
+    size_t signerInfosEnd = element.contentOffset + element.contentLength;
+    if (!MKBERReadElement(bytes, element.contentOffset, signerInfosEnd, 4, &signerInfo) || signerInfo.tag != kBERTagSequence || signerInfo.end != signerInfosEnd) {
+        return 0;
+    }
+
+    //SignerInfo ::= SEQUENCE { version, issuerAndSerialNumber SEQUENCE { issuer, serialNumber }, digestAlgorithm,
+    //                          authenticatedAttributes [0] IMPLICIT OPTIONAL, digestEncryptionAlgorithm, encryptedDigest, ... }
+    limit = signerInfo.contentOffset + signerInfo.contentLength;
+    if (!MKBERReadElement(bytes, signerInfo.contentOffset, limit, 5, &element) || element.tag != kBERTagInteger) {
+        return 0;
+    }
+    MKBERElement issuerAndSerialNumber;
+    if (!MKBERReadElement(bytes, element.end, limit, 5, &issuerAndSerialNumber) || issuerAndSerialNumber.tag != kBERTagSequence) {
+        return 0;
+    }
+    size_t issuerLimit = issuerAndSerialNumber.contentOffset + issuerAndSerialNumber.contentLength;
+    MKReceiptRange issuer, serialNumber;
+    if (!MKBERReadElement(bytes, issuerAndSerialNumber.contentOffset, issuerLimit, 6, &element) || element.tag != kBERTagSequence || !MKBERElementRange(&element, issuerAndSerialNumber.contentOffset, &issuer)) {
+        return 0;
+    }
+    offset = element.end;
+    if (!MKBERReadElement(bytes, offset, issuerLimit, 6, &element) || element.tag != kBERTagInteger || !MKBERElementRange(&element, offset, &serialNumber)) {
+        return 0;
+    }
+
+    MKBERElement algorithm;
+    if (!MKBERReadElement(bytes, issuerAndSerialNumber.end, limit, 5, &algorithm) || algorithm.tag != kBERTagSequence) {
+        return 0;
+    }
+    if (!MKBERReadElement(bytes, algorithm.contentOffset, algorithm.contentOffset + algorithm.contentLength, 6, &element) || element.tag != kBERTagObjectIdentifier) {
+        return 0;
+    }
+    container->digestAlgorithm.offset = (uint32_t)element.contentOffset;
+    container->digestAlgorithm.length = (uint32_t)element.contentLength;
+    if (!MKReceiptContainerListsDigestAlgorithm(bytes, &digestAlgorithms, container->digestAlgorithm)) {
+        return 0;
+    }
+
+    offset = algorithm.end;
+    if (!MKBERReadElement(bytes, offset, limit, 5, &element)) {
+        return 0;
+    }
+    if (element.tag == kBERTagContextZero) {
+        if (!MKBERElementRange(&element, offset, &container->signedAttributes)) {
+            return 0;
+        }
+        if (!MKBERReadElement(bytes, element.end, limit, 5, &element)) {
+            return 0;
+        }
+    }
+    if (element.tag != kBERTagSequence) {
+        return 0;
+    }
+    if (!MKBERReadElement(bytes, element.end, limit, 5, &element) || element.tag != kBERTagOctetString) {
+        return 0;
+    }
+    container->encryptedDigest.offset = (uint32_t)element.contentOffset;
+    container->encryptedDigest.length = (uint32_t)element.contentLength;
+
+    //Match the signer against the embedded certificates by the encoded issuer and serial number.
+    for (size_t i = 0; i < container->certificateCount; i++) {
+        MKReceiptRange certificateIssuer, certificateSerialNumber;
+        if (MKReceiptContainerReadCertificateIssuer(bytes, container->certificates[i], &certificateIssuer, &certificateSerialNumber) && MKReceiptRangesAreEqual(bytes, issuer, bytes, certificateIssuer) && MKReceiptRangesAreEqual(bytes, serialNumber, bytes, certificateSerialNumber)) {
+            container->signerCertificate = container->certificates[i];
+            break;
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,68 @@
+//
+//  MKReceiptContainer.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptContainer_h
+#define M13MarketKit_MKReceiptContainer_h
+
+#include "MKReceiptDecoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**Finds the signed content (the receipt payload) inside a PKCS #7 receipt container, without copying or allocating.
+ @note Both DER and the indefinite length BER Apple uses are accepted. Content split over more than one octet string chunk is not, callers should fall back to the copy OpenSSL makes.
+ @param bytes The receipt container, for example the mapped receipt file.
+ @param length The length of the container.
+ @param content Receives the range of the content within the container.
+ @return 1 if the content was found, 0 otherwise.
+ */
+int MKReceiptContainerLocateContent(const uint8_t *bytes, size_t length, MKReceiptRange *content);
+
+/**The most certificates a container may embed, Apple's receipts carry three.*/
+#define MKReceiptContainerMaximumCertificates 8
+
+/**The pieces of a PKCS #7 receipt container the signature check needs, as ranges within the container.*/
+typedef struct {
+    /**The signed content.*/
+    MKReceiptRange content;
+    /**The embedded certificates, each a whole DER element.*/
+    MKReceiptRange certificates[MKReceiptContainerMaximumCertificates];
+    /**The number of embedded certificates.*/
+    size_t certificateCount;
+    /**The embedded certificate whose issuer and serial number match the signer, or an empty range if there is none.*/
+    MKReceiptRange signerCertificate;
+    /**The contents of the digest algorithm object identifier.*/
+    MKReceiptRange digestAlgorithm;
+    /**The authenticated attributes, as a whole element including the [0] tag, or an empty range if there are none.*/
+    MKReceiptRange signedAttributes;
+    /**The contents of the signature.*/
+    MKReceiptRange encryptedDigest;
+} MKReceiptContainer;
+
+/**Finds the signed content, the embedded certificates and the signer info of a receipt container, without copying or allocating.
+ @note Fails for the same content MKReceiptContainerLocateContent does not handle, for more than MKReceiptContainerMaximumCertificates certificates and for more than one signer.
+ @param bytes The receipt container.
+ @param length The length of the container.
+ @param container Receives the ranges.
+ @return 1 if the container was parsed, 0 otherwise.
+ */
+int MKReceiptContainerParse(const uint8_t *bytes, size_t length, MKReceiptContainer *container);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+//
+//  MKReceiptDate.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKReceiptDate.h"
+
+/**Reads a fixed number of decimal digits.*/
+static int MKReceiptDateReadDigits(const uint8_t *bytes, size_t count, int *value)
+{
+    int result = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (bytes[i] < '0' || bytes[i] > '9') {
+            return 0;
+        }
+        result = result * 10 + (bytes[i] - '0');
+    }
+    *value = result;
+    return 1;
+}
+
+static int MKReceiptDateDaysInMonth(int year, int month)
+{
+    static const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month == 2 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))) {
+        return 29;
+    }
+    return days[month - 1];
+}
+
+/**The number of days from 1970-01-01 to the given civil date, in the proleptic Gregorian calendar.*/
+static int64_t MKReceiptDateDaysFromCivil(int year, int month, int day)
+{
+    //Count years from March so the leap day is the last day of the year.
+    int64_t y = year - (month <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yearOfEra = y - era * 400;
+    int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+int MKReceiptDateParse(const uint8_t *bytes, size_t length, double *seconds)
+{
+    int year, month, day, hour, minute, second;
+
+    //YYYY-MM-DDTHH:MM:SS
+    if (!bytes || length < 19) {
+        return 0;
+    }
+    if (bytes[4] != '-' || bytes[7] != '-' || (bytes[10] != 'T' && bytes[10] != 't' && bytes[10] != ' ') || bytes[13] != ':' || bytes[16] != ':') {
+        return 0;
+    }
+    if (!MKReceiptDateReadDigits(bytes, 4, &year) || !MKReceiptDateReadDigits(bytes + 5, 2, &month) || !MKReceiptDateReadDigits(bytes + 8, 2, &day) || !MKReceiptDateReadDigits(bytes + 11, 2, &hour) || !MKReceiptDateReadDigits(bytes + 14, 2, &minute) || !MKReceiptDateReadDigits(bytes + 17, 2, &second)) {
+        return 0;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > MKReceiptDateDaysInMonth(year, month) || hour > 23 || minute > 59 || second > 60) {
+        return 0;
+    }
+
+    size_t position = 19;
+
+    //Fraction of a second.
+    double fraction = 0.0;
+    if (position < length && bytes[position] == '.') {
+        position++;
+        double scale = 0.1;
+        size_t start = position;
+        while (position < length && bytes[position] >= '0' && bytes[position] <= '9') {
+            fraction += (bytes[position] - '0') * scale;
+            scale *= 0.1;
+            position++;
+        }
+        if (position == start) {
+            return 0;
+        }
+    }
+
+    //Time zone offset, none means UTC.
+    int offset = 0;
+    if (position < length) {
+        uint8_t designator = bytes[position];
+        if (designator == 'Z' || designator == 'z') {
+            position++;
+        } else if (designator == '+' || designator == '-') {
+            int offsetHours, offsetMinutes = 0;
+            position++;
+            if (length - position < 2 || !MKReceiptDateReadDigits(bytes + position, 2, &offsetHours)) {
+                return 0;
+            }
+            position += 2;
+            if (position < length && bytes[position] == ':') {
+                position++;
+            }
+            if (position < length) {
+                if (length - position < 2 || !MKReceiptDateReadDigits(bytes + position, 2, &offsetMinutes)) {
+                    return 0;
+                }
+                position += 2;
+            }
+            if (offsetHours > 23 || offsetMinutes > 59) {
+                return 0;
+            }
+            offset = (offsetHours * 60 + offsetMinutes) * 60;
+            if (designator == '-') {
+                offset = -offset;
+            }
+        } else {
+            return 0;
+        }
+    }
+    if (position != length) {
+        return 0;
+    }
+
+    int64_t days = MKReceiptDateDaysFromCivil(year, month, day);
+    int64_t total = days * 86400 + hour * 3600 + minute * 60 + second - offset;
+    *seconds = (double)total + fraction;
+    return 1;
+}
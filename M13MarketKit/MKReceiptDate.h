@@ -0,0 +1,39 @@
+//
+//  MKReceiptDate.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptDate_h
+#define M13MarketKit_MKReceiptDate_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**Parses a receipt timestamp into seconds since 1970-01-01T00:00:00Z. Nothing is allocated and the bytes do not need to be NUL terminated.
+ @note Accepts "YYYY-MM-DDTHH:MM:SS", optionally followed by a fraction of a second, then "Z", "+HH:MM", "+HHMM", "+HH", or nothing (UTC). The "T" and "Z" may be lower case.
+ @param bytes The IA5String contents of the date.
+ @param length The length of the date.
+ @param seconds Receives the number of seconds since the epoch.
+ @return 1 on success, 0 if the date is malformed or out of range.
+ */
+int MKReceiptDateParse(const uint8_t *bytes, size_t length, double *seconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
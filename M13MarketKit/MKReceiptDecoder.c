@@ -0,0 +1,381 @@
+//
+//  MKReceiptDecoder.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKReceiptDecoder.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ASN.1 tags used in the App Store receipt
+#define kDERTagInteger 0x02
+#define kDERTagOctetString 0x04
+#define kDERTagUTF8String 0x0C
+#define kDERTagIA5String 0x16
+#define kDERTagSequence 0x30
+#define kDERTagSet 0x31
+
+// ASN.1 values for the App Store receipt
+#define kBundleIdentifierField 2
+#define kVersionField 3
+#define kOpaqueValueField 4
+#define kHashField 5
+#define kInAppPurchasesField 17
+#define kOriginalVersionField 19
+#define kExpirationDateField 21
+
+// ASN.1 values for In-App Purchase values
+#define kIAPFirstField                          1701
+#define kIAPQuantityField                       1701
+#define kIAPProductIdentifierField              1702
+#define kIAPTransactionIdentifierField          1703
+#define kIAPPurchaseDateField                   1704
+#define kIAPOriginalTransactionIdentifierField  1705
+#define kIAPOriginalPurchaseDateField           1706
+#define kIAPSubscriptionExpirationDateField     1708
+#define kIAPWebOrderLineItemIdentifierField     1711
+#define kIAPCancelationDateField                1712
+
+#define kInitialTransactionCapacity 16
+
+/**How the value of an attribute is kept.*/
+typedef enum {
+    /**The attribute is skipped. Types missing from a schema get this kind.*/
+    MKReceiptFieldIgnored = 0,
+    /**The range of the contents of a UTF8String.*/
+    MKReceiptFieldUTF8String,
+    /**The range of the contents of an IA5String.*/
+    MKReceiptFieldIA5String,
+    /**An INTEGER, as a uint64_t.*/
+    MKReceiptFieldInteger,
+    /**The range of the whole attribute value.*/
+    MKReceiptFieldOctets,
+    /**The in app purchase receipts, each decoded into a new transaction.*/
+    MKReceiptFieldInAppPurchases
+} MKReceiptFieldKind;
+
+/**Where and how an attribute is stored in the record being decoded.*/
+typedef struct {
+    /**The MKReceiptFieldKind.*/
+    uint8_t kind;
+    /**Whether or not the range of the whole attribute value is also kept, at octetsOffset.*/
+    uint8_t keepsOctets;
+    /**The offset of the MKReceiptRange or uint64_t in the record.*/
+    uint16_t offset;
+    /**The offset of the MKReceiptRange that receives the whole attribute value.*/
+    uint16_t octetsOffset;
+} MKReceiptField;
+
+/**A set of attributes, indexed by attribute type minus the first type so lookup is a bounds check and a load.*/
+typedef struct {
+    const MKReceiptField *fields;
+    uint64_t firstType;
+    size_t count;
+} MKReceiptSchema;
+
+#define MKReceiptFieldEntry(kind, record, member) {kind, 0, offsetof(record, member), 0}
+
+/**The attributes of the application receipt, kept in an MKReceiptPayload.*/
+static const MKReceiptField MKReceiptApplicationFields[] = {
+    //The raw value is included for hash generation
+    [kBundleIdentifierField] = {MKReceiptFieldUTF8String, 1, offsetof(MKReceiptPayload, bundleIdentifier), offsetof(MKReceiptPayload, bundleIdentifierData)},
+    [kVersionField] = MKReceiptFieldEntry(MKReceiptFieldUTF8String, MKReceiptPayload, applicationVersion),
+    [kOpaqueValueField] = MKReceiptFieldEntry(MKReceiptFieldOctets, MKReceiptPayload, opaqueValue),
+    [kHashField] = MKReceiptFieldEntry(MKReceiptFieldOctets, MKReceiptPayload, sha1Hash),
+    [kInAppPurchasesField] = {MKReceiptFieldInAppPurchases, 0, 0, 0},
+    [kOriginalVersionField] = MKReceiptFieldEntry(MKReceiptFieldUTF8String, MKReceiptPayload, originalApplicationVersion),
+    [kExpirationDateField] = MKReceiptFieldEntry(MKReceiptFieldIA5String, MKReceiptPayload, receiptExpirationDate),
+};
+
+/**The attributes of an in app purchase receipt, kept in an MKReceiptTransaction.*/
+static const MKReceiptField MKReceiptInAppPurchaseFields[] = {
+    [kIAPQuantityField - kIAPFirstField] = MKReceiptFieldEntry(MKReceiptFieldInteger, MKReceiptTransaction, quantity),
+    [kIAPProductIdentifierField - kIAPFirstField] = MKReceiptFieldEntry(MKReceiptFieldUTF8String, MKReceiptTransaction, productIdentifier),
+    [kIAPTransactionIdentifierField - kIAPFirstField] = MKReceiptFieldEntry(MKReceiptFieldUTF8String, MKReceiptTransaction, transactionIdentifier),
+    [kIAPPurchaseDateField - kIAPFirstField] = MKReceiptFieldEntry(MKReceiptFieldIA5String, MKReceiptTransaction, purchaseDate),
+    [kIAPOriginalTransactionIdentifierField - kIAPFirstField] = MKReceiptFieldEntry(MKReceiptFieldUTF8String, MKReceiptTransaction, originalTransactionIdentifier),
+    [kIAPOriginalPurchaseDateField - kIAPFirstField] = MKReceiptFieldEntry(MKReceiptFieldIA5String, MKReceiptTransaction, originalPurchaseDate),
+    [kIAPSubscriptionExpirationDateField - kIAPFirstField] = MKReceiptFieldEntry(MKReceiptFieldIA5String, MKReceiptTransaction, subscriptionExpirationDate),
+    [kIAPWebOrderLineItemIdentifierField - kIAPFirstField] = MKReceiptFieldEntry(MKReceiptFieldInteger, MKReceiptTransaction, webOrderLineItemIdentifier),
+    [kIAPCancelationDateField - kIAPFirstField] = MKReceiptFieldEntry(MKReceiptFieldIA5String, MKReceiptTransaction, cancellationDate),
+};
+
+static const MKReceiptSchema MKReceiptApplicationSchema = {MKReceiptApplicationFields, 0, sizeof(MKReceiptApplicationFields) / sizeof(MKReceiptApplicationFields[0])};
+static const MKReceiptSchema MKReceiptInAppPurchaseSchema = {MKReceiptInAppPurchaseFields, kIAPFirstField, sizeof(MKReceiptInAppPurchaseFields) / sizeof(MKReceiptInAppPurchaseFields[0])};
+
+/**Reads the identifier and length octets of a DER element. On success, p points to the contents of the element.*/
+static int MKDERReadElement(const uint8_t **p, const uint8_t *end, uint8_t *tag, size_t *length)
+{
+    const uint8_t *cursor = *p;
+    if (end - cursor < 2) {
+        return 0;
+    }
+
+    *tag = *cursor++;
+    //High tag numbers are not used in receipts.
+    if ((*tag & 0x1F) == 0x1F) {
+        return 0;
+    }
+
+    size_t len = *cursor++;
+    if (len & 0x80) {
+        size_t count = len & 0x7F;
+        if (count == 0 || count > 4 || (size_t)(end - cursor) < count) {
+            return 0;
+        }
+        len = 0;
+        while (count--) {
+            len = (len << 8) | *cursor++;
+        }
+    }
+
+    if (len > (size_t)(end - cursor)) {
+        return 0;
+    }
+
+    *p = cursor;
+    *length = len;
+    return 1;
+}
+
+/**Reads the contents of a DER INTEGER as an unsigned value.*/
+static int MKDERReadUnsigned(const uint8_t *bytes, size_t length, uint64_t *value)
+{
+    //Skip the sign padding byte.
+    while (length > 1 && bytes[0] == 0) {
+        bytes++;
+        length--;
+    }
+    if (length == 0 || length > sizeof(uint64_t)) {
+        return 0;
+    }
+
+    uint64_t result = 0;
+    for (size_t i = 0; i < length; i++) {
+        result = (result << 8) | bytes[i];
+    }
+    *value = result;
+    return 1;
+}
+
+static MKReceiptRange MKReceiptRangeMake(const uint8_t *base, const uint8_t *p, size_t length)
+{
+    MKReceiptRange range;
+    range.offset = (uint32_t)(p - base);
+    range.length = (uint32_t)length;
+    return range;
+}
+
+/**Sets the range to the contents of the string wrapped in the attribute value, if the string has the expected type.*/
+static void MKReceiptReadString(const uint8_t *base, const uint8_t *value, size_t valueLength, uint8_t expectedTag, MKReceiptRange *range)
+{
+    uint8_t tag = 0;
+    size_t length = 0;
+    const uint8_t *p = value;
+    if (MKDERReadElement(&p, value + valueLength, &tag, &length) && tag == expectedTag) {
+        *range = MKReceiptRangeMake(base, p, length);
+    }
+}
+
+/**Reads the integer wrapped in the attribute value.*/
+static void MKReceiptReadInteger(const uint8_t *value, size_t valueLength, uint64_t *result)
+{
+    uint8_t tag = 0;
+    size_t length = 0;
+    const uint8_t *p = value;
+    if (MKDERReadElement(&p, value + valueLength, &tag, &length) && tag == kDERTagInteger) {
+        MKDERReadUnsigned(p, length, result);
+    }
+}
+
+/**Reads a receipt attribute: SEQUENCE { type INTEGER, version INTEGER, value OCTET STRING }. On success p points past the attribute.*/
+static int MKReceiptReadAttribute(const uint8_t **p, const uint8_t *end, uint64_t *type, const uint8_t **value, size_t *valueLength)
+{
+    uint8_t tag = 0;
+    size_t length = 0;
+
+    if (!MKDERReadElement(p, end, &tag, &length) || tag != kDERTagSequence) {
+        return 0;
+    }
+    const uint8_t *seqEnd = *p + length;
+    const uint8_t *cursor = *p;
+
+    //Attribute type
+    if (!MKDERReadElement(&cursor, seqEnd, &tag, &length) || tag != kDERTagInteger || !MKDERReadUnsigned(cursor, length, type)) {
+        return 0;
+    }
+    cursor += length;
+
+    //Attribute version (unused)
+    if (!MKDERReadElement(&cursor, seqEnd, &tag, &length) || tag != kDERTagInteger) {
+        return 0;
+    }
+    cursor += length;
+
+    //Attribute value
+    if (!MKDERReadElement(&cursor, seqEnd, &tag, &length) || tag != kDERTagOctetString) {
+        return 0;
+    }
+    *value = cursor;
+    *valueLength = length;
+
+    //Skip any remaining fields in this SEQUENCE
+    *p = seqEnd;
+    return 1;
+}
+
+static MKReceiptTransaction *MKReceiptPayloadAppendTransaction(MKReceiptPayload *payload)
+{
+    if (payload->transactionCount == payload->transactionCapacity) {
+        size_t capacity = payload->transactionCapacity ? payload->transactionCapacity * 2 : kInitialTransactionCapacity;
+        MKReceiptTransaction *transactions;
+        if (payload->arena) {
+            transactions = MKReceiptArenaResize(payload->arena, payload->transactions, payload->transactionCapacity * sizeof(MKReceiptTransaction), capacity * sizeof(MKReceiptTransaction));
+        } else {
+            transactions = realloc(payload->transactions, capacity * sizeof(MKReceiptTransaction));
+        }
+        if (!transactions) {
+            return NULL;
+        }
+        payload->transactions = transactions;
+        payload->transactionCapacity = capacity;
+    }
+
+    MKReceiptTransaction *transaction = &payload->transactions[payload->transactionCount++];
+    memset(transaction, 0, sizeof(MKReceiptTransaction));
+    return transaction;
+}
+
+static MKReceiptDecodeStatus MKReceiptDecodeInAppPurchases(const uint8_t *base, const uint8_t *p, const uint8_t *end, MKReceiptPayload *payload);
+
+/**Decodes a set of attributes into the record, keeping the ones the schema lists.*/
+static MKReceiptDecodeStatus MKReceiptDecodeAttributes(const MKReceiptSchema *schema, const uint8_t *base, const uint8_t *p, const uint8_t *end, void *record, MKReceiptPayload *payload)
+{
+    uint8_t *fields = record;
+
+    //While we have data to process
+    while (p < end) {
+        uint64_t type = 0;
+        const uint8_t *value = NULL;
+        size_t valueLength = 0;
+        if (!MKReceiptReadAttribute(&p, end, &type, &value, &valueLength)) {
+            return MKReceiptDecodeStatusMalformed;
+        }
+
+        //Types outside the schema wrap around to large indexes and are skipped with the ones it leaves out.
+        uint64_t index = type - schema->firstType;
+        if (index >= schema->count) {
+            continue;
+        }
+        const MKReceiptField *field = &schema->fields[index];
+        if (field->keepsOctets) {
+            *(MKReceiptRange *)(fields + field->octetsOffset) = MKReceiptRangeMake(base, value, valueLength);
+        }
+
+        switch ((MKReceiptFieldKind)field->kind) {
+            case MKReceiptFieldUTF8String:
+                MKReceiptReadString(base, value, valueLength, kDERTagUTF8String, (MKReceiptRange *)(fields + field->offset));
+                break;
+            case MKReceiptFieldIA5String:
+                MKReceiptReadString(base, value, valueLength, kDERTagIA5String, (MKReceiptRange *)(fields + field->offset));
+                break;
+            case MKReceiptFieldInteger:
+                MKReceiptReadInteger(value, valueLength, (uint64_t *)(fields + field->offset));
+                break;
+            case MKReceiptFieldOctets:
+                *(MKReceiptRange *)(fields + field->offset) = MKReceiptRangeMake(base, value, valueLength);
+                break;
+            case MKReceiptFieldInAppPurchases: {
+                MKReceiptDecodeStatus status = MKReceiptDecodeInAppPurchases(base, value, value + valueLength, payload);
+                if (status != MKReceiptDecodeStatusSuccess) {
+                    return status;
+                }
+                break;
+            }
+            case MKReceiptFieldIgnored:
+                break;
+        }
+    }
+
+    return MKReceiptDecodeStatusSuccess;
+}
+
+/**Decodes the in app purchase receipts contained in the value of an in app purchase attribute.*/
+static MKReceiptDecodeStatus MKReceiptDecodeInAppPurchases(const uint8_t *base, const uint8_t *p, const uint8_t *end, MKReceiptPayload *payload)
+{
+    uint8_t tag = 0;
+    size_t length = 0;
+
+    //While we have data to process
+    while (p < end) {
+        //This should be a set of attributes, if not a set, we have a problem.
+        if (!MKDERReadElement(&p, end, &tag, &length) || tag != kDERTagSet) {
+            return MKReceiptDecodeStatusMalformed;
+        }
+        const uint8_t *setEnd = p + length;
+
+        MKReceiptTransaction *transaction = MKReceiptPayloadAppendTransaction(payload);
+        if (!transaction) {
+            return MKReceiptDecodeStatusOutOfMemory;
+        }
+
+        //The in app purchase schema has no nested purchases, so the transaction array does not move while it is filled.
+        MKReceiptDecodeStatus status = MKReceiptDecodeAttributes(&MKReceiptInAppPurchaseSchema, base, p, setEnd, transaction, payload);
+        if (status != MKReceiptDecodeStatusSuccess) {
+            return status;
+        }
+        p = setEnd;
+    }
+
+    return MKReceiptDecodeStatusSuccess;
+}
+
+MKReceiptDecodeStatus MKReceiptPayloadDecode(const uint8_t *bytes, size_t length, MKReceiptPayload *payload)
+{
+    return MKReceiptPayloadDecodeInArena(bytes, length, NULL, payload);
+}
+
+MKReceiptDecodeStatus MKReceiptPayloadDecodeInArena(const uint8_t *bytes, size_t length, MKReceiptArena *arena, MKReceiptPayload *payload)
+{
+    memset(payload, 0, sizeof(MKReceiptPayload));
+    payload->arena = arena;
+
+    //Ranges are stored as 32 bit values.
+    if ((uint64_t)length > UINT32_MAX) {
+        return MKReceiptDecodeStatusTooLarge;
+    }
+
+    const uint8_t *p = bytes;
+    const uint8_t *end = bytes + length;
+    uint8_t tag = 0;
+    size_t setLength = 0;
+
+    //Get the receipt object
+    if (!MKDERReadElement(&p, end, &tag, &setLength) || tag != kDERTagSet) {
+        return MKReceiptDecodeStatusMalformed;
+    }
+
+    return MKReceiptDecodeAttributes(&MKReceiptApplicationSchema, bytes, p, p + setLength, payload, payload);
+}
+
+void MKReceiptPayloadFree(MKReceiptPayload *payload)
+{
+    if (payload->arena) {
+        MKReceiptArenaFree(payload->arena);
+    } else {
+        free(payload->transactions);
+    }
+    memset(payload, 0, sizeof(MKReceiptPayload));
+}
@@ -0,0 +1,127 @@
+//
+//  MKReceiptDecoder.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptDecoder_h
+#define M13MarketKit_MKReceiptDecoder_h
+
+#include <string.h>
+
+#include "MKReceiptArena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**A view into the decoded buffer. Values are never copied, a range only records where the value lives in the receipt payload.
+ @note A length of 0 means the value was not present in the receipt.
+ */
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} MKReceiptRange;
+
+/**A single in app purchase transaction. All string values are ranges into the payload buffer.*/
+typedef struct {
+    /**The product identifier (UTF8String contents).*/
+    MKReceiptRange productIdentifier;
+    /**The transaction identifier (UTF8String contents).*/
+    MKReceiptRange transactionIdentifier;
+    /**The original transaction identifier (UTF8String contents).*/
+    MKReceiptRange originalTransactionIdentifier;
+    /**The purchase date (IA5String contents, RFC 3339).*/
+    MKReceiptRange purchaseDate;
+    /**The original purchase date (IA5String contents, RFC 3339).*/
+    MKReceiptRange originalPurchaseDate;
+    /**The subscription expiration date (IA5String contents, RFC 3339).*/
+    MKReceiptRange subscriptionExpirationDate;
+    /**The cancellation date (IA5String contents, RFC 3339).*/
+    MKReceiptRange cancellationDate;
+    /**The number of items purchased.*/
+    uint64_t quantity;
+    /**The primary key for identifying subscription purchases.*/
+    uint64_t webOrderLineItemIdentifier;
+} MKReceiptTransaction;
+
+/**The decoded application receipt payload (the signed content of the PKCS #7 container).*/
+typedef struct {
+    /**The bundle identifier (UTF8String contents).*/
+    MKReceiptRange bundleIdentifier;
+    /**The raw bundle identifier attribute value, used to compute the receipt hash.*/
+    MKReceiptRange bundleIdentifierData;
+    /**The application version (UTF8String contents).*/
+    MKReceiptRange applicationVersion;
+    /**The opaque value used to compute the receipt hash.*/
+    MKReceiptRange opaqueValue;
+    /**The SHA-1 hash of the receipt.*/
+    MKReceiptRange sha1Hash;
+    /**The originally purchased application version (UTF8String contents).*/
+    MKReceiptRange originalApplicationVersion;
+    /**The receipt expiration date (IA5String contents, RFC 3339).*/
+    MKReceiptRange receiptExpirationDate;
+    /**The in app purchase transactions, in receipt order.*/
+    MKReceiptTransaction *transactions;
+    /**The number of transactions.*/
+    size_t transactionCount;
+    /**The number of transactions the transaction array can hold.*/
+    size_t transactionCapacity;
+    /**The arena the payload was decoded into, NULL if the transactions were allocated with malloc. Indexes built from the payload allocate from it too.*/
+    MKReceiptArena *arena;
+} MKReceiptPayload;
+
+/**The result of decoding a receipt payload.*/
+typedef enum {
+    MKReceiptDecodeStatusSuccess = 0,
+    MKReceiptDecodeStatusMalformed,
+    MKReceiptDecodeStatusOutOfMemory,
+    MKReceiptDecodeStatusTooLarge
+} MKReceiptDecodeStatus;
+
+/**Decodes the ASN.1 receipt payload without copying any of its values.
+ @param bytes The signed content of the receipt. Must outlive the payload, as all ranges point into it.
+ @param length The length of the content.
+ @param payload The payload to fill. Must be freed with MKReceiptPayloadFree, even on failure.
+ @return The decode status.
+ */
+MKReceiptDecodeStatus MKReceiptPayloadDecode(const uint8_t *bytes, size_t length, MKReceiptPayload *payload);
+
+/**Decodes the receipt payload like MKReceiptPayloadDecode, allocating from an arena instead of the heap.
+ @param bytes The signed content of the receipt. Must outlive the payload, as all ranges point into it.
+ @param length The length of the content.
+ @param arena The arena to allocate from. The payload takes ownership of it, even on failure.
+ @param payload The payload to fill. Must be freed with MKReceiptPayloadFree, even on failure.
+ @return The decode status.
+ */
+MKReceiptDecodeStatus MKReceiptPayloadDecodeInArena(const uint8_t *bytes, size_t length, MKReceiptArena *arena, MKReceiptPayload *payload);
+
+/**Frees the memory held by a decoded payload, and its arena if it has one, so everything allocated for the payload is released at once. Indexes built from the payload must be freed first. The payload is reset and can be reused.*/
+void MKReceiptPayloadFree(MKReceiptPayload *payload);
+
+/**Returns a pointer to the bytes of the given range.*/
+static inline const uint8_t *MKReceiptRangeBytes(const uint8_t *bytes, MKReceiptRange range)
+{
+    return bytes + range.offset;
+}
+
+/**Compares the values of two ranges, which may point into different buffers.*/
+static inline int MKReceiptRangesAreEqual(const uint8_t *aBytes, MKReceiptRange a, const uint8_t *bBytes, MKReceiptRange b)
+{
+    return a.length == b.length && (a.length == 0 || memcmp(MKReceiptRangeBytes(aBytes, a), MKReceiptRangeBytes(bBytes, b), a.length) == 0);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+//
+//  MKReceiptDelta.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKReceiptDelta.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define kMKReceiptDeltaEmptySlot UINT32_MAX
+
+static MKReceiptChange MKReceiptDeltaCompareTransactions(const uint8_t *previousBytes, const MKReceiptTransaction *previous, const uint8_t *currentBytes, const MKReceiptTransaction *current)
+{
+    if (previous->cancellationDate.length == 0 && current->cancellationDate.length != 0) {
+        return MKReceiptChangeCancelled;
+    }
+    if (previous->quantity != current->quantity || previous->webOrderLineItemIdentifier != current->webOrderLineItemIdentifier ||
+        !MKReceiptRangesAreEqual(previousBytes, previous->productIdentifier, currentBytes, current->productIdentifier) ||
+        !MKReceiptRangesAreEqual(previousBytes, previous->originalTransactionIdentifier, currentBytes, current->originalTransactionIdentifier) ||
+        !MKReceiptRangesAreEqual(previousBytes, previous->purchaseDate, currentBytes, current->purchaseDate) ||
+        !MKReceiptRangesAreEqual(previousBytes, previous->originalPurchaseDate, currentBytes, current->originalPurchaseDate) ||
+        !MKReceiptRangesAreEqual(previousBytes, previous->subscriptionExpirationDate, currentBytes, current->subscriptionExpirationDate) ||
+        !MKReceiptRangesAreEqual(previousBytes, previous->cancellationDate, currentBytes, current->cancellationDate)) {
+        return MKReceiptChangeModified;
+    }
+    return MKReceiptChangeNone;
+}
+
+int MKReceiptDeltaCompute(const uint8_t *previousBytes, const MKReceiptPayload *previous, const uint8_t *currentBytes, const MKReceiptPayload *current, uint8_t *changes, uint8_t *removed)
+{
+    //Hash the previous transactions by identifier, with the load factor at or below one half.
+    size_t slotCount = 16;
+    while (slotCount < previous->transactionCount * 2) {
+        slotCount *= 2;
+    }
+    uint32_t *slots = malloc(slotCount * sizeof(uint32_t));
+    if (!slots) {
+        return 0;
+    }
+    memset(slots, 0xFF, slotCount * sizeof(uint32_t));
+    size_t mask = slotCount - 1;
+
+    for (size_t i = 0; i < previous->transactionCount; i++) {
+        MKReceiptRange identifier = previous->transactions[i].transactionIdentifier;
+        removed[i] = 1;
+        if (identifier.length == 0) {
+            continue;
+        }
+        size_t slot = MKReceiptHashBytes(MKReceiptRangeBytes(previousBytes, identifier), identifier.length) & mask;
+        while (slots[slot] != kMKReceiptDeltaEmptySlot && !MKReceiptRangesAreEqual(previousBytes, previous->transactions[slots[slot]].transactionIdentifier, previousBytes, identifier)) {
+            slot = (slot + 1) & mask;
+        }
+        //Identifiers are unique, if one repeats the first transaction is kept.
+        if (slots[slot] == kMKReceiptDeltaEmptySlot) {
+            slots[slot] = (uint32_t)i;
+        }
+    }
+
+    for (size_t i = 0; i < current->transactionCount; i++) {
+        const MKReceiptTransaction *transaction = &current->transactions[i];
+        changes[i] = MKReceiptChangeAdded;
+        if (transaction->transactionIdentifier.length == 0) {
+            continue;
+        }
+        size_t slot = MKReceiptHashBytes(MKReceiptRangeBytes(currentBytes, transaction->transactionIdentifier), transaction->transactionIdentifier.length) & mask;
+        while (slots[slot] != kMKReceiptDeltaEmptySlot) {
+            const MKReceiptTransaction *candidate = &previous->transactions[slots[slot]];
+            if (MKReceiptRangesAreEqual(previousBytes, candidate->transactionIdentifier, currentBytes, transaction->transactionIdentifier)) {
+                changes[i] = (uint8_t)MKReceiptDeltaCompareTransactions(previousBytes, candidate, currentBytes, transaction);
+                removed[slots[slot]] = 0;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    free(slots);
+    return 1;
+}
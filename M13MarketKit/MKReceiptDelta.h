@@ -0,0 +1,52 @@
+//
+//  MKReceiptDelta.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptDelta_h
+#define M13MarketKit_MKReceiptDelta_h
+
+#include "MKReceiptDecoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**How a transaction differs from the previously validated receipt.*/
+typedef enum {
+    /**The transaction is the same in both receipts.*/
+    MKReceiptChangeNone = 0,
+    /**The transaction is new.*/
+    MKReceiptChangeAdded = 1,
+    /**The transaction exists in both receipts, but its values differ (for example a renewed subscription expiration date).*/
+    MKReceiptChangeModified = 2,
+    /**The transaction has been canceled since the previous receipt.*/
+    MKReceiptChangeCancelled = 3
+} MKReceiptChange;
+
+/**Compares two receipts by transaction identifier.
+ @param previousBytes The payload buffer of the previously validated receipt.
+ @param previous The previously validated receipt.
+ @param currentBytes The payload buffer of the new receipt.
+ @param current The new receipt.
+ @param changes Receives the change of each transaction of the new receipt, must hold current->transactionCount entries.
+ @param removed Receives 1 for each transaction of the previous receipt that is missing from the new one, 0 otherwise. Must hold previous->transactionCount entries.
+ @return 1 on success, 0 if memory could not be allocated.
+ */
+int MKReceiptDeltaCompute(const uint8_t *previousBytes, const MKReceiptPayload *previous, const uint8_t *currentBytes, const MKReceiptPayload *current, uint8_t *changes, uint8_t *removed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,234 @@
+//
+//  MKReceiptEntitlement.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKReceiptEntitlement.h"
+#include "MKReceiptDate.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int MKReceiptEntitlementIntervalCompare(const void *a, const void *b)
+{
+    double first = ((const MKReceiptEntitlementInterval *)a)->start;
+    double second = ((const MKReceiptEntitlementInterval *)b)->start;
+    return (first > second) - (first < second);
+}
+
+size_t MKReceiptEntitlementIntervalsMerge(MKReceiptEntitlementInterval *intervals, size_t count)
+{
+    if (count == 0) {
+        return 0;
+    }
+    qsort(intervals, count, sizeof(MKReceiptEntitlementInterval), MKReceiptEntitlementIntervalCompare);
+
+    size_t merged = 0;
+    for (size_t i = 1; i < count; i++) {
+        if (intervals[i].start <= intervals[merged].end) {
+            if (intervals[i].end > intervals[merged].end) {
+                intervals[merged].end = intervals[i].end;
+            }
+        } else {
+            intervals[++merged] = intervals[i];
+        }
+    }
+    merged++;
+
+    //Only the last interval can be open ended, so every sum stays finite.
+    double entitledBefore = 0;
+    for (size_t i = 0; i < merged; i++) {
+        intervals[i].entitledBefore = entitledBefore;
+        entitledBefore += intervals[i].end - intervals[i].start;
+    }
+    return merged;
+}
+
+/**Returns the index of the last interval starting at or before time, or count if there is none.*/
+static size_t MKReceiptEntitlementIntervalsFind(const MKReceiptEntitlementInterval *intervals, size_t count, double time)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (intervals[middle].start <= time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low == 0 ? count : low - 1;
+}
+
+int MKReceiptEntitlementIntervalsEntitledAt(const MKReceiptEntitlementInterval *intervals, size_t count, double time, double *until)
+{
+    size_t i = MKReceiptEntitlementIntervalsFind(intervals, count, time);
+    if (i == count || time >= intervals[i].end) {
+        return 0;
+    }
+    if (until) {
+        *until = intervals[i].end;
+    }
+    return 1;
+}
+
+/**The entitled time before the given time.*/
+static double MKReceiptEntitlementIntervalsEntitledBefore(const MKReceiptEntitlementInterval *intervals, size_t count, double time)
+{
+    size_t i = MKReceiptEntitlementIntervalsFind(intervals, count, time);
+    if (i == count) {
+        return 0;
+    }
+    double end = time < intervals[i].end ? time : intervals[i].end;
+    return intervals[i].entitledBefore + (end - intervals[i].start);
+}
+
+double MKReceiptEntitlementIntervalsEntitledDuration(const MKReceiptEntitlementInterval *intervals, size_t count, double start, double end)
+{
+    if (!(end > start)) {
+        return 0;
+    }
+    return MKReceiptEntitlementIntervalsEntitledBefore(intervals, count, end) - MKReceiptEntitlementIntervalsEntitledBefore(intervals, count, start);
+}
+
+/**Parses a date of the payload. Returns 0 if it is missing or malformed.*/
+static int MKReceiptEntitlementDate(const uint8_t *bytes, MKReceiptRange range, double *seconds)
+{
+    return range.length != 0 && MKReceiptDateParse(MKReceiptRangeBytes(bytes, range), range.length, seconds);
+}
+
+/**Computes the entitlement interval of a transaction. Returns 0 if the transaction never entitles.*/
+static int MKReceiptEntitlementTransactionInterval(const uint8_t *bytes, const MKReceiptTransaction *transaction, MKReceiptEntitlementInterval *interval)
+{
+    double start;
+    if (!MKReceiptEntitlementDate(bytes, transaction->purchaseDate, &start)) {
+        return 0;
+    }
+
+    double end = INFINITY;
+    double date;
+    if (MKReceiptEntitlementDate(bytes, transaction->subscriptionExpirationDate, &date)) {
+        end = date;
+    }
+    if (transaction->cancellationDate.length != 0) {
+        //A cancellation that can not be read revokes the whole transaction.
+        if (!MKReceiptEntitlementDate(bytes, transaction->cancellationDate, &date)) {
+            return 0;
+        }
+        if (date < end) {
+            end = date;
+        }
+    }
+
+    if (!(end > start)) {
+        return 0;
+    }
+    interval->start = start;
+    interval->end = end;
+    interval->entitledBefore = 0;
+    return 1;
+}
+
+int MKReceiptEntitlementIndexBuild(MKReceiptEntitlementIndex *entitlements, const MKReceiptIndex *index)
+{
+    memset(entitlements, 0, sizeof(MKReceiptEntitlementIndex));
+    entitlements->index = index;
+
+    const MKReceiptPayload *payload = index->payload;
+    size_t capacity = payload->transactionCount ? payload->transactionCount : 1;
+    if (payload->arena) {
+        entitlements->intervals = MKReceiptArenaAllocate(payload->arena, capacity * sizeof(MKReceiptEntitlementInterval));
+        entitlements->first = MKReceiptArenaAllocate(payload->arena, capacity * sizeof(uint32_t));
+        entitlements->count = MKReceiptArenaAllocate(payload->arena, capacity * sizeof(uint32_t));
+    } else {
+        entitlements->intervals = malloc(capacity * sizeof(MKReceiptEntitlementInterval));
+        entitlements->first = malloc(capacity * sizeof(uint32_t));
+        entitlements->count = malloc(capacity * sizeof(uint32_t));
+    }
+    if (!entitlements->intervals || !entitlements->first || !entitlements->count) {
+        MKReceiptEntitlementIndexFree(entitlements);
+        return 0;
+    }
+    if (!index->slots) {
+        return 1;
+    }
+
+    //Each product's transactions are collected through its chain, then merged in place.
+    size_t used = 0;
+    for (size_t slot = 0; slot < index->slotCount; slot++) {
+        uint32_t head = index->slots[slot];
+        if (head == MKReceiptIndexNotFound) {
+            continue;
+        }
+
+        size_t first = used;
+        for (uint32_t transaction = head; transaction != MKReceiptIndexNotFound; transaction = index->next[transaction]) {
+            if (MKReceiptEntitlementTransactionInterval(index->bytes, &payload->transactions[transaction], &entitlements->intervals[used])) {
+                used++;
+            }
+        }
+
+        size_t count = MKReceiptEntitlementIntervalsMerge(&entitlements->intervals[first], used - first);
+        entitlements->first[head] = (uint32_t)first;
+        entitlements->count[head] = (uint32_t)count;
+        used = first + count;
+    }
+
+    return 1;
+}
+
+void MKReceiptEntitlementIndexFree(MKReceiptEntitlementIndex *entitlements)
+{
+    //Memory from the payload's arena is released with the payload.
+    if (!entitlements->index || !entitlements->index->payload || !entitlements->index->payload->arena) {
+        free(entitlements->intervals);
+        free(entitlements->first);
+        free(entitlements->count);
+    }
+    memset(entitlements, 0, sizeof(MKReceiptEntitlementIndex));
+}
+
+int MKReceiptEntitlementIndexEntitledAt(const MKReceiptEntitlementIndex *entitlements, const uint8_t *identifier, size_t length, double time, double *until)
+{
+    if (!entitlements->intervals) {
+        return 0;
+    }
+    uint32_t head = MKReceiptIndexFirstTransaction(entitlements->index, identifier, length);
+    if (head == MKReceiptIndexNotFound) {
+        return 0;
+    }
+    return MKReceiptEntitlementIntervalsEntitledAt(&entitlements->intervals[entitlements->first[head]], entitlements->count[head], time, until);
+}
+
+void MKReceiptEntitlementIndexEntitledSetAt(const MKReceiptEntitlementIndex *entitlements, const uint8_t *const *identifiers, const size_t *lengths, size_t count, double time, uint64_t *bitset)
+{
+    memset(bitset, 0, ((count + 63) / 64) * sizeof(uint64_t));
+    for (size_t i = 0; i < count; i++) {
+        if (identifiers[i] && MKReceiptEntitlementIndexEntitledAt(entitlements, identifiers[i], lengths[i], time, NULL)) {
+            bitset[i / 64] |= (uint64_t)1 << (i % 64);
+        }
+    }
+}
+
+double MKReceiptEntitlementIndexEntitledDuration(const MKReceiptEntitlementIndex *entitlements, const uint8_t *identifier, size_t length, double start, double end)
+{
+    if (!entitlements->intervals) {
+        return 0;
+    }
+    uint32_t head = MKReceiptIndexFirstTransaction(entitlements->index, identifier, length);
+    if (head == MKReceiptIndexNotFound) {
+        return 0;
+    }
+    return MKReceiptEntitlementIntervalsEntitledDuration(&entitlements->intervals[entitlements->first[head]], entitlements->count[head], start, end);
+}
@@ -0,0 +1,113 @@
+//
+//  MKReceiptEntitlement.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptEntitlement_h
+#define M13MarketKit_MKReceiptEntitlement_h
+
+#include "MKReceiptIndex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**A span of time a product is entitled. Times are seconds since 1970-01-01T00:00:00Z.*/
+typedef struct {
+    /**When the entitlement starts, the purchase date.*/
+    double start;
+    /**When the entitlement ends: the subscription expiration date, or the cancellation date if that is earlier. INFINITY if neither is present.*/
+    double end;
+    /**The total entitled time before start. Filled in by MKReceiptEntitlementIntervalsMerge.*/
+    double entitledBefore;
+} MKReceiptEntitlementInterval;
+
+/**Sorts intervals by start and merges the ones that overlap or touch, so every renewal of a subscription collapses into as few intervals as possible. Fills in entitledBefore.
+ @param intervals The intervals, merged in place.
+ @param count The number of intervals.
+ @return The number of merged intervals.
+ */
+size_t MKReceiptEntitlementIntervalsMerge(MKReceiptEntitlementInterval *intervals, size_t count);
+
+/**Checks whether merged intervals cover a point in time, in O(log n).
+ @param intervals The intervals, as returned by MKReceiptEntitlementIntervalsMerge.
+ @param count The number of intervals.
+ @param time The time to check.
+ @param until Receives the end of the entitlement covering time, if entitled. May be NULL.
+ @return 1 if entitled at time, 0 otherwise.
+ */
+int MKReceiptEntitlementIntervalsEntitledAt(const MKReceiptEntitlementInterval *intervals, size_t count, double time, double *until);
+
+/**Computes how much of a range merged intervals cover, in O(log n).
+ @param intervals The intervals, as returned by MKReceiptEntitlementIntervalsMerge.
+ @param count The number of intervals.
+ @param start The start of the range.
+ @param end The end of the range.
+ @return The entitled time within the range: end - start if entitled throughout, 0 if never entitled.
+ */
+double MKReceiptEntitlementIntervalsEntitledDuration(const MKReceiptEntitlementInterval *intervals, size_t count, double start, double end);
+
+/**The entitlement intervals of each product of a receipt, for queries such as "was this subscription active at this time".
+ @note A transaction entitles from its purchase date until its subscription expiration date, or its cancellation date if that is earlier. Transactions without either never stop entitling, those without a valid purchase date never entitle.
+ */
+typedef struct {
+    /**The product index the intervals are built from.*/
+    const MKReceiptIndex *index;
+    /**The merged intervals, grouped by product.*/
+    MKReceiptEntitlementInterval *intervals;
+    /**For the first transaction of each product, the index of the product's first interval.*/
+    uint32_t *first;
+    /**For the first transaction of each product, the number of intervals of the product.*/
+    uint32_t *count;
+} MKReceiptEntitlementIndex;
+
+/**Builds the entitlement intervals of every product in a receipt. The product index must outlive the entitlement index.
+ @return 1 on success, 0 if memory could not be allocated.
+ */
+int MKReceiptEntitlementIndexBuild(MKReceiptEntitlementIndex *entitlements, const MKReceiptIndex *index);
+
+/**Frees the memory held by the entitlement index.*/
+void MKReceiptEntitlementIndexFree(MKReceiptEntitlementIndex *entitlements);
+
+/**Checks whether a product is entitled at a point in time, in O(log n) in the number of transactions of the product.
+ @param identifier The product identifier.
+ @param length The length of the product identifier.
+ @param time The time to check, in seconds since 1970.
+ @param until Receives the end of the entitlement covering time, if entitled. May be NULL.
+ @return 1 if entitled at time, 0 otherwise.
+ */
+int MKReceiptEntitlementIndexEntitledAt(const MKReceiptEntitlementIndex *entitlements, const uint8_t *identifier, size_t length, double time, double *until);
+
+/**Checks which of the given products are entitled at a point in time, in one pass over them. See MKReceiptEntitlementIndexEntitledAt.
+ @param identifiers The product identifiers.
+ @param lengths The length of each product identifier.
+ @param count The number of product identifiers.
+ @param time The time to check, in seconds since 1970.
+ @param bitset Receives bit i set if product i is entitled at time. Must hold (count + 63) / 64 words.
+ */
+void MKReceiptEntitlementIndexEntitledSetAt(const MKReceiptEntitlementIndex *entitlements, const uint8_t *const *identifiers, const size_t *lengths, size_t count, double time, uint64_t *bitset);
+
+/**Computes how long a product is entitled within a range, in O(log n) in the number of transactions of the product.
+ @param identifier The product identifier.
+ @param length The length of the product identifier.
+ @param start The start of the range, in seconds since 1970.
+ @param end The end of the range, in seconds since 1970.
+ @return The entitled time within the range: end - start if entitled throughout, 0 if never entitled.
+ */
+double MKReceiptEntitlementIndexEntitledDuration(const MKReceiptEntitlementIndex *entitlements, const uint8_t *identifier, size_t length, double start, double end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
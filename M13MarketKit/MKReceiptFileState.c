@@ -0,0 +1,117 @@
+//
+//  MKReceiptFileState.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __APPLE__
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "MKReceiptFileState.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+
+/**Fills in the metadata of a state from the result of stat.*/
+static void MKReceiptFileStateSetStatus(MKReceiptFileState *state, const struct stat *status)
+{
+    state->exists = 1;
+    state->device = (uint64_t)status->st_dev;
+    state->inode = (uint64_t)status->st_ino;
+    state->size = (uint64_t)status->st_size;
+#ifdef __APPLE__
+    state->modifiedSeconds = (int64_t)status->st_mtimespec.tv_sec;
+    state->modifiedNanoseconds = (int64_t)status->st_mtimespec.tv_nsec;
+#else
+    state->modifiedSeconds = (int64_t)status->st_mtim.tv_sec;
+    state->modifiedNanoseconds = (int64_t)status->st_mtim.tv_nsec;
+#endif
+}
+
+/**Compares the metadata of a state with the result of stat.*/
+static int MKReceiptFileStateStatusMatches(const MKReceiptFileState *state, const struct stat *status)
+{
+    MKReceiptFileState current;
+    MKReceiptFileStateSetStatus(&current, status);
+    return state->exists && state->device == current.device && state->inode == current.inode && state->size == current.size && state->modifiedSeconds == current.modifiedSeconds && state->modifiedNanoseconds == current.modifiedNanoseconds;
+}
+
+/**Digests the contents of a file.*/
+static int MKReceiptFileStateDigest(const char *path, uint8_t digest[MKReceiptFileStateDigestLength])
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return 0;
+    }
+
+    EVP_MD_CTX *context = EVP_MD_CTX_create();
+    int digested = context && EVP_DigestInit_ex(context, EVP_sha256(), NULL);
+
+    uint8_t buffer[16384];
+    size_t length;
+    while (digested && (length = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        digested = EVP_DigestUpdate(context, buffer, length);
+    }
+    digested = digested && !ferror(fp) && EVP_DigestFinal_ex(context, digest, NULL);
+
+    if (context) {
+        EVP_MD_CTX_destroy(context);
+    }
+    fclose(fp);
+    return digested;
+}
+
+int MKReceiptFileStateCapture(const char *path, MKReceiptFileState *state)
+{
+    memset(state, 0, sizeof(MKReceiptFileState));
+
+    struct stat status;
+    if (stat(path, &status) != 0) {
+        return errno == ENOENT;
+    }
+    MKReceiptFileStateSetStatus(state, &status);
+    if (!MKReceiptFileStateDigest(path, state->digest)) {
+        memset(state, 0, sizeof(MKReceiptFileState));
+        return 0;
+    }
+    return 1;
+}
+
+int MKReceiptFileStateHasChanged(const char *path, MKReceiptFileState *state)
+{
+    struct stat status;
+    if (stat(path, &status) != 0) {
+        int existed = state->exists;
+        memset(state, 0, sizeof(MKReceiptFileState));
+        return existed || errno != ENOENT;
+    }
+    if (MKReceiptFileStateStatusMatches(state, &status)) {
+        return 0;
+    }
+
+    //The metadata changed, only the contents tell whether the receipt did: a rewrite of the same bytes is not a change.
+    int existed = state->exists;
+    uint8_t digest[MKReceiptFileStateDigestLength];
+    if (!MKReceiptFileStateDigest(path, digest)) {
+        memset(state, 0, sizeof(MKReceiptFileState));
+        return 1;
+    }
+    int changed = !existed || memcmp(digest, state->digest, MKReceiptFileStateDigestLength) != 0;
+    MKReceiptFileStateSetStatus(state, &status);
+    memcpy(state->digest, digest, MKReceiptFileStateDigestLength);
+    return changed;
+}
@@ -0,0 +1,63 @@
+//
+//  MKReceiptFileState.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptFileState_h
+#define M13MarketKit_MKReceiptFileState_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**The length of the digest of a receipt file (SHA-256).*/
+#define MKReceiptFileStateDigestLength 32
+
+/**What is known about the contents of a receipt file, to tell whether it changed without validating it again.*/
+typedef struct {
+    /**Whether or not the file existed.*/
+    int exists;
+    /**The device and inode of the file. A file replaced by a rename gets a new inode.*/
+    uint64_t device;
+    uint64_t inode;
+    /**The size of the file.*/
+    uint64_t size;
+    /**The modification time of the file.*/
+    int64_t modifiedSeconds;
+    int64_t modifiedNanoseconds;
+    /**The digest of the contents.*/
+    uint8_t digest[MKReceiptFileStateDigestLength];
+} MKReceiptFileState;
+
+/**Records the current state of a file, reading its contents.
+ @param path The path of the file.
+ @param state Receives the state. If the file does not exist the state records that.
+ @return 1 on success, 0 if the file exists but could not be read.
+ */
+int MKReceiptFileStateCapture(const char *path, MKReceiptFileState *state);
+
+/**Checks whether the contents of a file differ from a recorded state. The file is only read when its inode, size or modification time changed, so an unchanged file costs a single stat.
+ @param path The path of the file.
+ @param state The recorded state. Updated to the current state of the file.
+ @return 1 if the contents changed, appeared or disappeared, 0 if they are the same. A file that can not be read counts as changed.
+ */
+int MKReceiptFileStateHasChanged(const char *path, MKReceiptFileState *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
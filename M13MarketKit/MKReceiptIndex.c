@@ -0,0 +1,101 @@
+//
+//  MKReceiptIndex.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKReceiptIndex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**Returns the slot holding the product identifier, or the empty slot it would be inserted into.*/
+static size_t MKReceiptIndexFindSlot(const MKReceiptIndex *index, const uint8_t *identifier, size_t length)
+{
+    size_t mask = index->slotCount - 1;
+    size_t slot = MKReceiptHashBytes(identifier, length) & mask;
+
+    while (index->slots[slot] != MKReceiptIndexNotFound) {
+        MKReceiptRange range = index->payload->transactions[index->slots[slot]].productIdentifier;
+        if (range.length == length && memcmp(MKReceiptRangeBytes(index->bytes, range), identifier, length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+int MKReceiptIndexBuild(MKReceiptIndex *index, const uint8_t *bytes, const MKReceiptPayload *payload)
+{
+    memset(index, 0, sizeof(MKReceiptIndex));
+    index->bytes = bytes;
+    index->payload = payload;
+
+    //Keep the load factor at or below one half.
+    size_t slotCount = 16;
+    while (slotCount < payload->transactionCount * 2) {
+        slotCount *= 2;
+    }
+
+    index->slotCount = slotCount;
+    size_t nextCount = payload->transactionCount ? payload->transactionCount : 1;
+    if (payload->arena) {
+        index->slots = MKReceiptArenaAllocate(payload->arena, slotCount * sizeof(uint32_t));
+        index->next = MKReceiptArenaAllocate(payload->arena, nextCount * sizeof(uint32_t));
+    } else {
+        index->slots = malloc(slotCount * sizeof(uint32_t));
+        index->next = malloc(nextCount * sizeof(uint32_t));
+    }
+    if (!index->slots || !index->next) {
+        MKReceiptIndexFree(index);
+        return 0;
+    }
+    memset(index->slots, 0xFF, slotCount * sizeof(uint32_t));
+
+    //Insert in reverse so each chain ends up in receipt order.
+    for (size_t i = payload->transactionCount; i-- > 0;) {
+        const MKReceiptTransaction *transaction = &payload->transactions[i];
+        index->next[i] = MKReceiptIndexNotFound;
+        if (transaction->productIdentifier.length == 0) {
+            continue;
+        }
+
+        size_t slot = MKReceiptIndexFindSlot(index, MKReceiptRangeBytes(bytes, transaction->productIdentifier), transaction->productIdentifier.length);
+        index->next[i] = index->slots[slot];
+        index->slots[slot] = (uint32_t)i;
+    }
+
+    return 1;
+}
+
+void MKReceiptIndexFree(MKReceiptIndex *index)
+{
+    //Memory from the payload's arena is released with the payload.
+    if (!index->payload || !index->payload->arena) {
+        free(index->slots);
+        free(index->next);
+    }
+    memset(index, 0, sizeof(MKReceiptIndex));
+}
+
+uint32_t MKReceiptIndexFirstTransaction(const MKReceiptIndex *index, const uint8_t *identifier, size_t length)
+{
+    if (!index->slots || length == 0) {
+        return MKReceiptIndexNotFound;
+    }
+    return index->slots[MKReceiptIndexFindSlot(index, identifier, length)];
+}
+
+uint32_t MKReceiptIndexNextTransaction(const MKReceiptIndex *index, uint32_t transaction)
+{
+    return index->next[transaction];
+}
@@ -0,0 +1,60 @@
+//
+//  MKReceiptIndex.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptIndex_h
+#define M13MarketKit_MKReceiptIndex_h
+
+#include "MKReceiptDecoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**Returned when there is no (further) transaction for a product identifier.*/
+#define MKReceiptIndexNotFound UINT32_MAX
+
+/**A hash index from product identifier to the transactions of a decoded payload.*/
+typedef struct {
+    /**The payload buffer the product identifiers are read from.*/
+    const uint8_t *bytes;
+    /**The indexed payload.*/
+    const MKReceiptPayload *payload;
+    /**Open addressed slots holding the first transaction of each product, MKReceiptIndexNotFound if empty.*/
+    uint32_t *slots;
+    /**The number of slots, always a power of two.*/
+    size_t slotCount;
+    /**The next transaction with the same product identifier, for each transaction.*/
+    uint32_t *next;
+} MKReceiptIndex;
+
+/**Builds the index for a decoded payload. The bytes and payload must outlive the index.
+ @return 1 on success, 0 if memory could not be allocated.
+ */
+int MKReceiptIndexBuild(MKReceiptIndex *index, const uint8_t *bytes, const MKReceiptPayload *payload);
+
+/**Frees the memory held by the index.*/
+void MKReceiptIndexFree(MKReceiptIndex *index);
+
+/**Returns the index of the first transaction, in receipt order, for the product identifier, or MKReceiptIndexNotFound.*/
+uint32_t MKReceiptIndexFirstTransaction(const MKReceiptIndex *index, const uint8_t *identifier, size_t length);
+
+/**Returns the index of the next transaction for the same product, or MKReceiptIndexNotFound.*/
+uint32_t MKReceiptIndexNextTransaction(const MKReceiptIndex *index, uint32_t transaction);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+//
+//  MKReceiptMetrics.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __APPLE__
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "MKReceiptMetrics.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+struct MKReceiptMetrics {
+    /**Guards the snapshot. Stages are short and recorded a handful of times per validation, so a lock is cheap enough.*/
+    pthread_mutex_t lock;
+    MKReceiptMetricsSnapshot snapshot;
+};
+
+static const char *const MKReceiptStageNames[MKReceiptStageCount] = {
+    "load",
+    "parse",
+    "trust-store",
+    "verify",
+    "decode",
+    "construct"
+};
+
+MKReceiptMetrics *MKReceiptMetricsCreate(void)
+{
+    MKReceiptMetrics *metrics = calloc(1, sizeof(MKReceiptMetrics));
+    if (!metrics) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&metrics->lock, NULL) != 0) {
+        free(metrics);
+        return NULL;
+    }
+    return metrics;
+}
+
+void MKReceiptMetricsFree(MKReceiptMetrics *metrics)
+{
+    if (!metrics) {
+        return;
+    }
+    pthread_mutex_destroy(&metrics->lock);
+    free(metrics);
+}
+
+uint64_t MKReceiptMetricsNow(void)
+{
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+/**The histogram bucket of a duration.*/
+static unsigned MKReceiptMetricsBucket(uint64_t nanoseconds)
+{
+    uint64_t microseconds = nanoseconds / 1000;
+    unsigned bucket = 0;
+    while (microseconds != 0 && bucket < MKReceiptMetricsBucketCount - 1) {
+        microseconds >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+uint64_t MKReceiptMetricsRecordStage(MKReceiptMetrics *metrics, MKReceiptStage stage, uint64_t start)
+{
+    uint64_t end = MKReceiptMetricsNow();
+    if (!metrics || stage >= MKReceiptStageCount) {
+        return end;
+    }
+    
+    uint64_t duration = end > start ? end - start : 0;
+    unsigned bucket = MKReceiptMetricsBucket(duration);
+    
+    pthread_mutex_lock(&metrics->lock);
+    MKReceiptStageMetrics *stageMetrics = &metrics->snapshot.stages[stage];
+    stageMetrics->count++;
+    stageMetrics->totalNanoseconds += duration;
+    if (duration > stageMetrics->maximumNanoseconds) {
+        stageMetrics->maximumNanoseconds = duration;
+    }
+    stageMetrics->buckets[bucket]++;
+    pthread_mutex_unlock(&metrics->lock);
+    
+    return end;
+}
+
+void MKReceiptMetricsRecordValidation(MKReceiptMetrics *metrics, uint64_t bytes, uint64_t transactions)
+{
+    if (!metrics) {
+        return;
+    }
+    pthread_mutex_lock(&metrics->lock);
+    metrics->snapshot.validations++;
+    metrics->snapshot.bytesProcessed += bytes;
+    metrics->snapshot.transactionsDecoded += transactions;
+    pthread_mutex_unlock(&metrics->lock);
+}
+
+void MKReceiptMetricsGetSnapshot(MKReceiptMetrics *metrics, MKReceiptMetricsSnapshot *snapshot)
+{
+    pthread_mutex_lock(&metrics->lock);
+    *snapshot = metrics->snapshot;
+    pthread_mutex_unlock(&metrics->lock);
+}
+
+void MKReceiptMetricsReset(MKReceiptMetrics *metrics)
+{
+    pthread_mutex_lock(&metrics->lock);
+    memset(&metrics->snapshot, 0, sizeof(MKReceiptMetricsSnapshot));
+    pthread_mutex_unlock(&metrics->lock);
+}
+
+const char *MKReceiptStageName(MKReceiptStage stage)
+{
+    return stage < MKReceiptStageCount ? MKReceiptStageNames[stage] : "unknown";
+}
@@ -0,0 +1,125 @@
+//
+//  MKReceiptMetrics.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptMetrics_h
+#define M13MarketKit_MKReceiptMetrics_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**The stages of a receipt validation that are timed.*/
+typedef enum {
+    /**Reading or mapping the receipt file, and looking it up in the validation cache.*/
+    MKReceiptStageLoad = 0,
+    /**Parsing the PKCS #7 container.*/
+    MKReceiptStageParse = 1,
+    /**Loading the root certificate and creating the trust store. Happens once per process.*/
+    MKReceiptStageTrustStore = 2,
+    /**Checking the signature and the certificate chain.*/
+    MKReceiptStageVerify = 3,
+    /**Decoding the receipt payload.*/
+    MKReceiptStageDecode = 4,
+    /**Building the receipt objects from the decoded payload.*/
+    MKReceiptStageConstruct = 5,
+    /**The number of stages.*/
+    MKReceiptStageCount = 6
+} MKReceiptStage;
+
+/**The number of buckets in a stage histogram. Bucket 0 counts durations under 1 microsecond, bucket k durations from 2^(k - 1) up to 2^k microseconds. The last bucket also counts everything longer.*/
+#define MKReceiptMetricsBucketCount 24
+
+/**The durations recorded for one stage.*/
+typedef struct {
+    /**The number of times the stage ran.*/
+    uint64_t count;
+    /**The sum of the durations, in nanoseconds.*/
+    uint64_t totalNanoseconds;
+    /**The longest duration, in nanoseconds.*/
+    uint64_t maximumNanoseconds;
+    /**The histogram of the durations, see MKReceiptMetricsBucketCount.*/
+    uint64_t buckets[MKReceiptMetricsBucketCount];
+} MKReceiptStageMetrics;
+
+/**A consistent copy of the recorded metrics.*/
+typedef struct {
+    /**The durations of each stage, indexed by MKReceiptStage.*/
+    MKReceiptStageMetrics stages[MKReceiptStageCount];
+    /**The number of receipts validated.*/
+    uint64_t validations;
+    /**The number of receipt bytes validated.*/
+    uint64_t bytesProcessed;
+    /**The number of in app purchase transactions in the validated receipts.*/
+    uint64_t transactionsDecoded;
+} MKReceiptMetricsSnapshot;
+
+/**Collects validation metrics. All functions are thread safe.*/
+typedef struct MKReceiptMetrics MKReceiptMetrics;
+
+/**Creates an empty metrics collector.
+ @return The collector, or NULL if memory could not be allocated. Must be freed with MKReceiptMetricsFree.
+ */
+MKReceiptMetrics *MKReceiptMetricsCreate(void);
+
+/**Frees a metrics collector.
+ @param metrics The collector to free, may be NULL.
+ */
+void MKReceiptMetricsFree(MKReceiptMetrics *metrics);
+
+/**The current time of a monotonic clock.
+ @return The time in nanoseconds, from an arbitrary origin.
+ */
+uint64_t MKReceiptMetricsNow(void);
+
+/**Records one run of a stage.
+ @param metrics The collector, may be NULL in which case nothing is recorded.
+ @param stage The stage that ran.
+ @param start The value of MKReceiptMetricsNow when the stage started. The stage ends now.
+ @return The end of the stage, so consecutive stages can be timed without reading the clock twice.
+ */
+uint64_t MKReceiptMetricsRecordStage(MKReceiptMetrics *metrics, MKReceiptStage stage, uint64_t start);
+
+/**Records a completed validation.
+ @param metrics The collector, may be NULL in which case nothing is recorded.
+ @param bytes The length of the receipt file.
+ @param transactions The number of in app purchase transactions in the receipt.
+ */
+void MKReceiptMetricsRecordValidation(MKReceiptMetrics *metrics, uint64_t bytes, uint64_t transactions);
+
+/**Copies the recorded metrics.
+ @param metrics The collector.
+ @param snapshot Receives the metrics.
+ */
+void MKReceiptMetricsGetSnapshot(MKReceiptMetrics *metrics, MKReceiptMetricsSnapshot *snapshot);
+
+/**Discards the recorded metrics.
+ @param metrics The collector.
+ */
+void MKReceiptMetricsReset(MKReceiptMetrics *metrics);
+
+/**The name of a stage, for logs and exported metrics.
+ @param stage The stage.
+ @return A static, lower case name such as "verify".
+ */
+const char *MKReceiptStageName(MKReceiptStage stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
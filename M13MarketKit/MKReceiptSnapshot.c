@@ -0,0 +1,232 @@
+//
+//  MKReceiptSnapshot.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __APPLE__
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "MKReceiptSnapshot.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#define kMKReceiptSnapshotMagic 0x53454B4D // "MKES"
+#define kMKReceiptSnapshotVersion 1
+
+/**The fixed size header of the snapshot file. It is followed by the records, then the identifier strings. The authentication code covers everything after itself.*/
+typedef struct {
+    uint8_t mac[MKReceiptSnapshotKeyLength];
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t stringsLength;
+    double writtenAt;
+} MKReceiptSnapshotHeader;
+
+/**Computes the authentication code of a snapshot file.*/
+static void MKReceiptSnapshotComputeMAC(const uint8_t key[MKReceiptSnapshotKeyLength], const uint8_t *file, size_t length, uint8_t mac[MKReceiptSnapshotKeyLength])
+{
+    unsigned int macLength = MKReceiptSnapshotKeyLength;
+    HMAC(EVP_sha256(), key, MKReceiptSnapshotKeyLength, file + MKReceiptSnapshotKeyLength, length - MKReceiptSnapshotKeyLength, mac, &macLength);
+}
+
+/**Orders product identifiers by their bytes, then by length.*/
+static int MKReceiptSnapshotCompareIdentifiers(const uint8_t *first, size_t firstLength, const uint8_t *second, size_t secondLength)
+{
+    int order = memcmp(first, second, firstLength < secondLength ? firstLength : secondLength);
+    if (order != 0) {
+        return order;
+    }
+    return (firstLength > secondLength) - (firstLength < secondLength);
+}
+
+/**A record being written, with its identifier.*/
+typedef struct {
+    const uint8_t *identifier;
+    MKReceiptSnapshotRecord record;
+} MKReceiptSnapshotProduct;
+
+static int MKReceiptSnapshotProductCompare(const void *a, const void *b)
+{
+    const MKReceiptSnapshotProduct *first = a;
+    const MKReceiptSnapshotProduct *second = b;
+    return MKReceiptSnapshotCompareIdentifiers(first->identifier, first->record.identifierLength, second->identifier, second->record.identifierLength);
+}
+
+int MKReceiptSnapshotWrite(const char *path, const uint8_t key[MKReceiptSnapshotKeyLength], const MKReceiptEntitlementIndex *entitlements, double now)
+{
+    const MKReceiptIndex *index = entitlements->index;
+    size_t capacity = index->payload->transactionCount ? index->payload->transactionCount : 1;
+    MKReceiptSnapshotProduct *products = malloc(capacity * sizeof(MKReceiptSnapshotProduct));
+    if (!products) {
+        return 0;
+    }
+
+    //One record per product, keyed by the first transaction of its chain.
+    size_t count = 0;
+    uint64_t stringsLength = 0;
+    for (size_t slot = 0; index->slots && slot < index->slotCount; slot++) {
+        uint32_t head = index->slots[slot];
+        if (head == MKReceiptIndexNotFound) {
+            continue;
+        }
+        MKReceiptRange identifier = index->payload->transactions[head].productIdentifier;
+        MKReceiptSnapshotProduct *product = &products[count++];
+        memset(product, 0, sizeof(MKReceiptSnapshotProduct));
+        product->identifier = MKReceiptRangeBytes(index->bytes, identifier);
+        product->record.identifierLength = identifier.length;
+        product->record.entitled = (uint32_t)MKReceiptEntitlementIndexEntitledAt(entitlements, product->identifier, identifier.length, now, &product->record.until);
+        stringsLength += identifier.length;
+    }
+    qsort(products, count, sizeof(MKReceiptSnapshotProduct), MKReceiptSnapshotProductCompare);
+
+    size_t length = sizeof(MKReceiptSnapshotHeader) + count * sizeof(MKReceiptSnapshotRecord) + (size_t)stringsLength;
+    uint8_t *file = stringsLength <= UINT32_MAX ? calloc(1, length) : NULL;
+    if (!file) {
+        free(products);
+        return 0;
+    }
+
+    MKReceiptSnapshotHeader *header = (MKReceiptSnapshotHeader *)file;
+    header->magic = kMKReceiptSnapshotMagic;
+    header->version = kMKReceiptSnapshotVersion;
+    header->count = (uint32_t)count;
+    header->stringsLength = (uint32_t)stringsLength;
+    header->writtenAt = now;
+
+    MKReceiptSnapshotRecord *records = (MKReceiptSnapshotRecord *)(file + sizeof(MKReceiptSnapshotHeader));
+    uint8_t *strings = (uint8_t *)(records + count);
+    uint32_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        records[i] = products[i].record;
+        records[i].identifierOffset = offset;
+        memcpy(strings + offset, products[i].identifier, products[i].record.identifierLength);
+        offset += products[i].record.identifierLength;
+    }
+    free(products);
+    MKReceiptSnapshotComputeMAC(key, file, length, header->mac);
+
+    //Write to a temporary file and rename it over the snapshot, so readers never see a partial file.
+    size_t pathLength = strlen(path);
+    char *temporaryPath = malloc(pathLength + 5);
+    if (!temporaryPath) {
+        free(file);
+        return 0;
+    }
+    memcpy(temporaryPath, path, pathLength);
+    memcpy(temporaryPath + pathLength, ".tmp", 5);
+
+    FILE *fp = fopen(temporaryPath, "wb");
+    int written = fp && fwrite(file, 1, length, fp) == length;
+    if (fp) {
+        written = (fclose(fp) == 0) && written;
+    }
+    free(file);
+
+    if (written) {
+        written = rename(temporaryPath, path) == 0;
+    }
+    if (!written) {
+        remove(temporaryPath);
+    }
+
+    free(temporaryPath);
+    return written;
+}
+
+int MKReceiptSnapshotOpen(MKReceiptSnapshot *snapshot, const char *path, const uint8_t key[MKReceiptSnapshotKeyLength])
+{
+    memset(snapshot, 0, sizeof(MKReceiptSnapshot));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < (off_t)sizeof(MKReceiptSnapshotHeader)) {
+        close(fd);
+        return 0;
+    }
+    size_t length = (size_t)status.st_size;
+    void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return 0;
+    }
+
+    //The sizes are checked before the records are trusted, the authentication code before anything is returned.
+    const MKReceiptSnapshotHeader *header = mapping;
+    const MKReceiptSnapshotRecord *records = (const MKReceiptSnapshotRecord *)((const uint8_t *)mapping + sizeof(MKReceiptSnapshotHeader));
+    int valid = header->magic == kMKReceiptSnapshotMagic && header->version == kMKReceiptSnapshotVersion && (uint64_t)sizeof(MKReceiptSnapshotHeader) + (uint64_t)header->count * sizeof(MKReceiptSnapshotRecord) + header->stringsLength == length;
+
+    if (valid) {
+        uint8_t mac[MKReceiptSnapshotKeyLength];
+        MKReceiptSnapshotComputeMAC(key, mapping, length, mac);
+        valid = CRYPTO_memcmp(mac, header->mac, MKReceiptSnapshotKeyLength) == 0;
+    }
+    for (uint32_t i = 0; valid && i < header->count; i++) {
+        valid = (uint64_t)records[i].identifierOffset + records[i].identifierLength <= header->stringsLength;
+    }
+
+    if (!valid) {
+        munmap(mapping, length);
+        return 0;
+    }
+
+    snapshot->mapping = mapping;
+    snapshot->length = length;
+    snapshot->writtenAt = header->writtenAt;
+    snapshot->records = records;
+    snapshot->count = header->count;
+    snapshot->strings = (const uint8_t *)(records + header->count);
+    return 1;
+}
+
+void MKReceiptSnapshotClose(MKReceiptSnapshot *snapshot)
+{
+    if (snapshot->mapping) {
+        munmap(snapshot->mapping, snapshot->length);
+    }
+    memset(snapshot, 0, sizeof(MKReceiptSnapshot));
+}
+
+MKReceiptSnapshotEntitlement MKReceiptSnapshotLookup(const MKReceiptSnapshot *snapshot, const uint8_t *identifier, size_t length, double time)
+{
+    size_t low = 0;
+    size_t high = snapshot->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const MKReceiptSnapshotRecord *record = &snapshot->records[middle];
+        int order = MKReceiptSnapshotCompareIdentifiers(snapshot->strings + record->identifierOffset, record->identifierLength, identifier, length);
+        if (order == 0) {
+            return (record->entitled && time < record->until) ? MKReceiptSnapshotEntitlementEntitled : MKReceiptSnapshotEntitlementNotEntitled;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return MKReceiptSnapshotEntitlementUnknown;
+}
@@ -0,0 +1,99 @@
+//
+//  MKReceiptSnapshot.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptSnapshot_h
+#define M13MarketKit_MKReceiptSnapshot_h
+
+#include "MKReceiptEntitlement.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**The length of a snapshot key (HMAC-SHA256).*/
+#define MKReceiptSnapshotKeyLength 32
+
+/**The entitlement of a product, as recorded in a snapshot.*/
+typedef enum {
+    /**The product was not in the receipt the snapshot was taken from.*/
+    MKReceiptSnapshotEntitlementUnknown = 0,
+    /**The product was purchased, but is not entitled at the requested time.*/
+    MKReceiptSnapshotEntitlementNotEntitled = 1,
+    /**The product is entitled at the requested time.*/
+    MKReceiptSnapshotEntitlementEntitled = 2
+} MKReceiptSnapshotEntitlement;
+
+/**The entitlement of one product in a snapshot file.*/
+typedef struct {
+    /**The offset of the product identifier in the identifier strings.*/
+    uint32_t identifierOffset;
+    /**The length of the product identifier.*/
+    uint32_t identifierLength;
+    /**Whether or not the product was entitled when the snapshot was taken.*/
+    uint32_t entitled;
+    uint32_t reserved;
+    /**When the entitlement ends, in seconds since 1970. INFINITY if it does not expire.*/
+    double until;
+} MKReceiptSnapshotRecord;
+
+/**A snapshot file mapped into memory. The records are sorted by product identifier.*/
+typedef struct {
+    /**The mapping of the file.*/
+    void *mapping;
+    /**The length of the mapping.*/
+    size_t length;
+    /**When the snapshot was taken, in seconds since 1970.*/
+    double writtenAt;
+    /**The product records.*/
+    const MKReceiptSnapshotRecord *records;
+    /**The number of records.*/
+    size_t count;
+    /**The product identifier strings, not NUL terminated.*/
+    const uint8_t *strings;
+} MKReceiptSnapshot;
+
+/**Writes the entitlement of every product of a validated receipt, replacing any previous snapshot. The file is replaced atomically, so mappings of the previous snapshot stay valid.
+ @param path The path of the snapshot file.
+ @param key The key that authenticates the snapshot. It must be secret: random, and not readable by anyone able to write the file.
+ @param entitlements The entitlement index of the validated receipt.
+ @param now The current time, in seconds since 1970. Products are recorded as entitled if they are entitled at this time.
+ @return 1 on success, 0 if the file could not be written.
+ */
+int MKReceiptSnapshotWrite(const char *path, const uint8_t key[MKReceiptSnapshotKeyLength], const MKReceiptEntitlementIndex *entitlements, double now);
+
+/**Maps a snapshot file and checks its authentication code. Nothing is copied, lookups read the mapping.
+ @param snapshot Receives the snapshot. Must be closed with MKReceiptSnapshotClose if the open succeeds.
+ @param path The path of the snapshot file.
+ @param key The key that authenticates the snapshot.
+ @return 1 on success, 0 if there is no snapshot, or it is damaged or was not written with the key.
+ */
+int MKReceiptSnapshotOpen(MKReceiptSnapshot *snapshot, const char *path, const uint8_t key[MKReceiptSnapshotKeyLength]);
+
+/**Unmaps a snapshot.*/
+void MKReceiptSnapshotClose(MKReceiptSnapshot *snapshot);
+
+/**Looks up the entitlement of a product, in O(log n).
+ @param identifier The product identifier.
+ @param length The length of the product identifier.
+ @param time The time to check, in seconds since 1970. A product entitled when the snapshot was taken stays entitled until its entitlement ends.
+ @return The entitlement of the product.
+ */
+MKReceiptSnapshotEntitlement MKReceiptSnapshotLookup(const MKReceiptSnapshot *snapshot, const uint8_t *identifier, size_t length, double time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
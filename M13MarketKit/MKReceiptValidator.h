@@ -24,10 +24,44 @@
  */
 typedef void (^ReceiptValidationCompletionBlock)(BOOL validAppReceipt, MKApplicationReceipt *receipt, NSError *error);
 
+/**Posted on the main queue when the validator revalidated a changed receipt by itself, and it differs from the previously validated one. The object is the new receipt, its added, changed and cancelled product identifiers say which products need updating.
+ @note Validations a caller asked for are not announced, their completion receives the receipt and its changes.
+ */
+#define kMKReceiptValidatorReceiptChangedNotification @"MKReceiptValidatorReceiptChanged"
+
+/**The entitlement of a product recorded by the previous successful validation.*/
+typedef enum : NSUInteger {
+    /**There is no snapshot, or the product was not in the receipt.*/
+    MKCachedEntitlementUnknown,
+    /**The product was purchased, but its entitlement has ended.*/
+    MKCachedEntitlementNotEntitled,
+    /**The product is entitled.*/
+    MKCachedEntitlementEntitled
+} MKCachedEntitlement;
+
+//Validation metrics keys
+/**The number of receipts validated, an NSNumber.*/
+#define kMKReceiptMetricsValidations @"validations"
+/**The number of receipt bytes validated, an NSNumber.*/
+#define kMKReceiptMetricsBytesProcessed @"bytesProcessed"
+/**The number of in app purchase transactions in the validated receipts, an NSNumber.*/
+#define kMKReceiptMetricsTransactionsDecoded @"transactionsDecoded"
+/**A dictionary of stage metrics keyed by stage name: "load", "parse", "trust-store", "verify", "decode" and "construct".*/
+#define kMKReceiptMetricsStages @"stages"
+/**The number of times a stage ran, an NSNumber.*/
+#define kMKReceiptMetricsStageCount @"count"
+/**The total duration of a stage in seconds, an NSNumber.*/
+#define kMKReceiptMetricsStageTotalDuration @"totalSeconds"
+/**The longest duration of a stage in seconds, an NSNumber.*/
+#define kMKReceiptMetricsStageMaximumDuration @"maximumSeconds"
+/**The duration histogram of a stage, an array of NSNumber counts. Entry 0 counts runs under 1 microsecond, entry k runs from 2^(k - 1) up to 2^k microseconds, the last entry also counts everything longer.*/
+#define kMKReceiptMetricsStageHistogram @"histogram"
+
 //Error Codes
 #define kMKReceiptValidationErrorCodeNoReceipt 1
 #define kMKReceiptValidationErrorCodeInvalidBundleIdentifier 2
 #define kMKReceiptValidationErrorCodeInvalidVersion 3
+#define kMKReceiptValidationErrorCodeInvalidDeviceHash 4
 #define kMKReceiptValidationErrorCodeFailure 10
 
 /**The object that represents the receipt of the application*/
@@ -58,6 +92,41 @@ typedef void (^ReceiptValidationCompletionBlock)(BOOL validAppReceipt, MKApplica
  @note This key is present only for apps purchased through the Volume Purchase Program. If this key is not present, the receipt does not expire. When validating a receipt, compare this date to the current date to determine whether the receipt is expired. Do not try to use this date to calculate any other information, such as the time remaining before expiration.
  */
 @property (nonatomic, strong, readonly) NSDate *receiptExpirationDate;
+
+/**@name Querying*/
+/**The receipts for the in-app purchases of the given product, in receipt order.
+ @param productIdentifier The identifier of the product.
+ @return The receipts for the product, an empty array if the product was never purchased.
+ */
+- (NSArray *)inAppPurchaseReceiptsForProductIdentifier:(NSString *)productIdentifier;
+/**Checks which of the given products are entitled now in a single pass, see isProductIdentifier:entitledAtDate:. An expired subscription is not entitled.
+ @param productIdentifiers The identifiers of the products to check.
+ @return The indexes in the given array of the entitled products.
+ */
+- (NSIndexSet *)indexesOfEntitledProductIdentifiers:(NSArray *)productIdentifiers;
+/**Checks whether a product was entitled at a point in time. A transaction entitles from its purchase date until its subscription expiration date, or its cancellation date if that is earlier, so every renewal of an auto-renewable subscription counts. Takes O(log n) in the number of transactions of the product.
+ @param productIdentifier The identifier of the product.
+ @param date The date to check.
+ @return Wether or not the product was entitled at the date.
+ */
+- (BOOL)isProductIdentifier:(NSString *)productIdentifier entitledAtDate:(NSDate *)date;
+/**How long a product was entitled between two dates, see isProductIdentifier:entitledAtDate:. Takes O(log n) in the number of transactions of the product.
+ @param productIdentifier The identifier of the product.
+ @param startDate The start of the range.
+ @param endDate The end of the range.
+ @return The entitled time within the range: the length of the range if the product was entitled throughout, 0 if it never was.
+ */
+- (NSTimeInterval)entitledDurationOfProductIdentifier:(NSString *)productIdentifier fromDate:(NSDate *)startDate toDate:(NSDate *)endDate;
+
+/**@name Changes*/
+/**The identifiers of the products with transactions that are new since the previously validated receipt. nil if there was no previous receipt to compare with.*/
+@property (nonatomic, strong, readonly) NSSet *addedProductIdentifiers;
+/**The identifiers of the products with transactions that changed or disappeared since the previously validated receipt. nil if there was no previous receipt to compare with.*/
+@property (nonatomic, strong, readonly) NSSet *changedProductIdentifiers;
+/**The identifiers of the products with transactions that were canceled since the previously validated receipt. nil if there was no previous receipt to compare with.*/
+@property (nonatomic, strong, readonly) NSSet *cancelledProductIdentifiers;
+/**The union of the added, changed and cancelled product identifiers: the products that need to be updated. nil if every product needs to be updated.*/
+- (NSSet *)updatedProductIdentifiers;
  
 @end
 
@@ -99,12 +168,29 @@ typedef void (^ReceiptValidationCompletionBlock)(BOOL validAppReceipt, MKApplica
 
 /**The shared instance of the validator.*/
 + (instancetype)sharedValidator;
-/**Validate the receipt with the given completion.
- @param completion The completion block to run upon validation of the receipt.
- @param force Wether or not to force the application to revalidate the receipt.
+/**Validate the receipt with the given completion. Validation runs on a background queue, and only one runs at a time: calls made while a validation is in flight receive its result.
+ @param completion The completion block to run upon validation of the receipt. It is called on the main queue.
+ @param force Wether or not to force the application to revalidate the receipt. A receipt that passed validation is only validated again if its bytes changed since.
+ @note Once a receipt passes validation, the validator watches it and revalidates it by itself when it changes, posting kMKReceiptValidatorReceiptChangedNotification if products changed.
  */
 - (void)validateReceiptWithCompletion:(ReceiptValidationCompletionBlock)completion forceRefresh:(BOOL)force;
 
+/**@name Entitlement Snapshot*/
+/**The entitlement of a product according to the snapshot written by the previous successful validation. The snapshot is memory mapped and authenticated with a random key kept in the keychain of the device, it answers without waiting for the receipt to be verified.
+ @note Use it only until validateReceiptWithCompletion:forceRefresh: completes, the receipt may have changed since the snapshot was written.
+ @param productIdentifier The identifier of the product.
+ @return The entitlement of the product.
+ */
+- (MKCachedEntitlement)cachedEntitlementOfProductIdentifier:(NSString *)productIdentifier;
+
+/**@name Metrics*/
+/**The durations of each validation stage, and the receipts, bytes and transactions validated since launch or the last reset. Only contains property list types, so it can be logged, archived or serialized to JSON.
+ @return A snapshot of the metrics, see the kMKReceiptMetrics keys.
+ */
+- (NSDictionary *)validationMetrics;
+/**Discards the recorded validation metrics.*/
+- (void)resetValidationMetrics;
+
 @end
 
 
@@ -17,6 +17,8 @@
 #import <Security/Security.h>
 #import <UIKit/UIKit.h>
 #import <StoreKit/StoreKit.h>
+#import <fcntl.h>
+#import <unistd.h>
 
 #import <OpenSSL/pkcs7.h>
 #import <OpenSSL/objects.h>
@@ -24,31 +26,27 @@
 #import <OpenSSL/x509.h>
 #import <OpenSSL/err.h>
 
+#import "MKReceiptDecoder.h"
+#import "MKReceiptIndex.h"
+#import "MKReceiptEntitlement.h"
+#import "MKReceiptVerifier.h"
+#import "MKReceiptCache.h"
+#import "MKReceiptDate.h"
+#import "MKReceiptContainer.h"
+#import "MKReceiptDelta.h"
+#import "MKReceiptMetrics.h"
+#import "MKReceiptSnapshot.h"
+#import "MKReceiptFileState.h"
+
 //Bundle information
 #define kBundleVersionConstant    @"4.0.0"
 #define kBundleIdentifierConstant @"com.BrandonMcQuilkin.WhatsMyStageOn"
 
 #define kM13MarketKitErrorDomain @"com.BrandonMcQuilkin.M13MarketKit"
 
-// ASN.1 values for the App Store receipt
-#define kBundleIdentifierField 2
-#define kVersionField 3
-#define kOpaqueValueField 4
-#define kHashField 5
-#define kInAppPurchasesField 17
-#define kOriginalVersionField 19
-#define kExpirationDateField 21
-
-// ASN.1 values for In-App Purchase values
-#define kIAPQuantityField                       1701
-#define kIAPProductIdentifierField              1702
-#define kIAPTransactionIdentifierField          1703
-#define kIAPPurchaseDateField                   1704
-#define kIAPOriginalTransactionIdentifierField	1705
-#define kIAPOriginalPurchaseDateField           1706
-#define kIAPSubscriptionExpirationDateField     1708
-#define kIAPWebOrderLineItemIdentifierField     1711
-#define kIAPCancelationDateField                1712
+//Receipt watching
+#define kMKReceiptChangeSettleInterval 0.5
+#define kMKReceiptPollInterval 30.0
 
 //Keys for the dictionaries
 NSString *kApplicationReceiptBundleIdentifier		= @"BundleIdentifier";
@@ -77,77 +75,225 @@ NSString *kIAPReceiptWebOrderLineItemID             = @"WebItemId";
 
 @implementation NSDate (RFC3339)
 
-+ (NSDateFormatter *)internetDateTimeFormatter {
-            NSLocale *en_US_POSIX = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
-            NSDateFormatter *internetDateTimeFormatter = [[NSDateFormatter alloc] init];
-            [internetDateTimeFormatter setLocale:en_US_POSIX];
-            [internetDateTimeFormatter setTimeZone:[NSTimeZone timeZoneForSecondsFromGMT:0]];
-    return internetDateTimeFormatter;
++ (NSDate *)dateFromRFC3339String:(NSString *)dateString
+{
+    if (dateString.length == 0) {
+        return nil;
+    }
+    const char *bytes = [dateString UTF8String];
+    double seconds;
+    if (!bytes || !MKReceiptDateParse((const uint8_t *)bytes, strlen(bytes), &seconds)) {
+        NSLog(@"Could not parse RFC3339 date: \"%@\" Possible invalid format.", dateString);
+        return nil;
+    }
+    return [NSDate dateWithTimeIntervalSince1970:seconds];
 }
 
-+ (NSDate *)dateFromRFC3339String:(NSString *)dateString
+@end
+
+static NSString *MKStringFromRange(NSData *data, MKReceiptRange range, NSStringEncoding encoding)
 {
-    // Keep dateString around a while (for thread-safety)
-    NSDate *date = nil;
-    if (dateString && dateString.length > 0) {
-        NSDateFormatter *dateFormatter = [NSDate internetDateTimeFormatter];
-        @synchronized(dateFormatter) {
-            
-            // Process date
-            NSString *RFC3339String = [[NSString stringWithString:dateString] uppercaseString];
-            RFC3339String = [RFC3339String stringByReplacingOccurrencesOfString:@"Z" withString:@"-0000"];
-            // Remove colon in timezone as it breaks NSDateFormatter in iOS 4+.
-            // - see https://devforums.apple.com/thread/45837
-            if (RFC3339String.length > 20) {
-                RFC3339String = [RFC3339String stringByReplacingOccurrencesOfString:@":"
-                                                                         withString:@""
-                                                                            options:0
-                                                                              range:NSMakeRange(20, RFC3339String.length-20)];
-            }
-            if (!date) { // 1996-12-19T16:39:57-0800
-                [dateFormatter setDateFormat:@"yyyy'-'MM'-'dd'T'HH':'mm':'ssZZZ"];
-                date = [dateFormatter dateFromString:RFC3339String];
-            }
-            if (!date) { // 1937-01-01T12:00:27.87+0020
-                [dateFormatter setDateFormat:@"yyyy'-'MM'-'dd'T'HH':'mm':'ss.SSSZZZ"];
-                date = [dateFormatter dateFromString:RFC3339String];
-            }
-            if (!date) { // 1937-01-01T12:00:27
-                [dateFormatter setDateFormat:@"yyyy'-'MM'-'dd'T'HH':'mm':'ss"];
-                date = [dateFormatter dateFromString:RFC3339String];
-            }
-            if (!date) { //2014-06-16T20:18:04Z
-                [dateFormatter setDateFormat:@"yyyy'-'MM'-'dd'T'HH':'mm':'ssZ"];
-            }
-            if (!date) NSLog(@"Could not parse RFC3339 date: \"%@\" Possible invalid format.", dateString);
-            
+    if (range.length == 0) {
+        return nil;
+    }
+    return [[NSString alloc] initWithBytes:MKReceiptRangeBytes(data.bytes, range) length:range.length encoding:encoding];
+}
+
+static NSDate *MKDateFromRange(NSData *data, MKReceiptRange range)
+{
+    //Parsed straight from the payload bytes, no intermediate string.
+    double seconds;
+    if (range.length == 0 || !MKReceiptDateParse(MKReceiptRangeBytes(data.bytes, range), range.length, &seconds)) {
+        return nil;
+    }
+    return [NSDate dateWithTimeIntervalSince1970:seconds];
+}
+
+static NSData *MKDataFromRange(NSData *data, MKReceiptRange range)
+{
+    if (range.length == 0) {
+        return nil;
+    }
+    return [data subdataWithRange:NSMakeRange(range.offset, range.length)];
+}
+
+/**Decodes a payload into an arena sized from it, so the transactions and the indexes built from them are released at once.*/
+static MKReceiptDecodeStatus MKDecodePayloadData(NSData *data, MKReceiptPayload *payload)
+{
+    //The transaction records and indexes take about half as many bytes as their DER encoding.
+    MKReceiptArena *arena = MKReceiptArenaCreate(data.length / 2);
+    if (!arena) {
+        return MKReceiptPayloadDecode(data.bytes, data.length, payload);
+    }
+    return MKReceiptPayloadDecodeInArena(data.bytes, data.length, arena, payload);
+}
+
+/**Creates each distinct string and date of a payload once. Product identifiers, original transaction identifiers and dates repeat across the renewals of a subscription.*/
+@interface MKReceiptValueInterner : NSObject
+- (instancetype)initWithPayloadData:(NSData *)data transactionCount:(size_t)transactionCount;
+/**The payload the values are read from.*/
+@property (nonatomic, strong, readonly) NSData *payloadData;
+- (NSString *)stringFromRange:(MKReceiptRange)range;
+- (NSDate *)dateFromRange:(MKReceiptRange)range;
+@end
+
+@implementation MKReceiptValueInterner
+{
+    /**Holds the tables, freed in one go with the interner.*/
+    MKReceiptArena *_arena;
+    MKReceiptInternTable _strings;
+    MKReceiptInternTable _dates;
+    NSMutableArray *_stringObjects;
+    NSMutableArray *_dateObjects;
+}
+
+- (instancetype)initWithPayloadData:(NSData *)data transactionCount:(size_t)transactionCount
+{
+    self = [super init];
+    if (self) {
+        _payloadData = data;
+        //Two strings and four dates per transaction at most, each slot is three words and the tables are at most half full.
+        _arena = MKReceiptArenaCreate(transactionCount * 6 * 2 * 3 * sizeof(uint32_t));
+        if (!_arena || !MKReceiptInternTableInit(&_strings, _arena, data.bytes, transactionCount * 2) || !MKReceiptInternTableInit(&_dates, _arena, data.bytes, transactionCount * 4)) {
+            //Without the tables every value gets its own object.
+            MKReceiptArenaFree(_arena);
+            _arena = NULL;
         }
+        _stringObjects = [NSMutableArray array];
+        _dateObjects = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    MKReceiptArenaFree(_arena);
+}
+
+- (NSString *)stringFromRange:(MKReceiptRange)range
+{
+    if (!_arena || range.length == 0) {
+        return MKStringFromRange(_payloadData, range, NSUTF8StringEncoding);
+    }
+    int added;
+    uint32_t value = MKReceiptInternTableIntern(&_strings, range.offset, range.length, &added);
+    if (value == MKReceiptInternNotFound) {
+        return MKStringFromRange(_payloadData, range, NSUTF8StringEncoding);
+    }
+    if (added) {
+        NSString *string = MKStringFromRange(_payloadData, range, NSUTF8StringEncoding);
+        [_stringObjects addObject:string ? string : [NSNull null]];
+    }
+    id string = _stringObjects[value];
+    return string == [NSNull null] ? nil : string;
+}
+
+- (NSDate *)dateFromRange:(MKReceiptRange)range
+{
+    if (!_arena || range.length == 0) {
+        return MKDateFromRange(_payloadData, range);
+    }
+    int added;
+    uint32_t value = MKReceiptInternTableIntern(&_dates, range.offset, range.length, &added);
+    if (value == MKReceiptInternNotFound) {
+        return MKDateFromRange(_payloadData, range);
     }
-    // Finished with date string
-    return date;
+    if (added) {
+        NSDate *date = MKDateFromRange(_payloadData, range);
+        [_dateObjects addObject:date ? date : [NSNull null]];
+    }
+    id date = _dateObjects[value];
+    return date == [NSNull null] ? nil : date;
 }
 
 @end
 
+@interface MKApplicationReceipt ()
+/** Initalizes a receipt by decoding the given receipt payload.
+ @param data The signed content of the receipt.
+ @return A new receipt object, or nil if the payload is malformed.
+ */
+- (instancetype)initWithPayloadData:(NSData *)data;
+/** Initalizes a receipt from a payload that was already decoded.
+ @param data The signed content of the receipt.
+ @param payload The payload decoded from the data. The receipt takes ownership of its memory.
+ @return A new receipt object.
+ */
+- (instancetype)initWithPayloadData:(NSData *)data decodedPayload:(MKReceiptPayload *)payload;
+/**The signed content the receipt was decoded from.*/
+@property (nonatomic, strong, readonly) NSData *payloadData;
+/**The decoded payload.*/
+@property (nonatomic, assign, readonly) const MKReceiptPayload *payload;
+/**The entitlement intervals of each product. NULL for receipts created from an information dictionary.*/
+@property (nonatomic, assign, readonly) const MKReceiptEntitlementIndex *entitlements;
+/**Compares the transactions with those of the previously validated receipt, and fills in the changed product identifiers.
+ @param receipt The previously validated receipt.
+ */
+- (void)computeChangesFromReceipt:(MKApplicationReceipt *)receipt;
+/**Creates a receipt with the same content that reports no changes, for callers whose validation was skipped because nothing changed.
+ @return The new receipt, or the receipt itself if it has no changes to report.
+ */
+- (MKApplicationReceipt *)unchangedReceipt;
+@end
 
+@interface MKInAppPurchaseReceipt ()
+/** Initalizes a receipt from a decoded transaction.
+ @param transaction The decoded transaction.
+ @param values The values of the payload the transaction was decoded from.
+ @return A new receipt object.
+ */
+- (instancetype)initWithTransaction:(const MKReceiptTransaction *)transaction values:(MKReceiptValueInterner *)values;
+@end
 
 @interface MKReceiptValidator () <SKRequestDelegate>
+/**The serial queue validation runs on. The properties below are only accessed from this queue.*/
+@property (nonatomic, strong, readonly) dispatch_queue_t validationQueue;
+/**Wether or not a validation is in flight. Callers arriving while one is attach to it.*/
+@property (nonatomic, assign, readonly) BOOL validationInProgress;
+/**Wether or not a forced validation was requested while another was in flight.*/
+@property (nonatomic, assign, readonly) BOOL needsRevalidation;
 /**The array of completion blocks to run upon validation of the receipt.*/
 @property (nonatomic, strong, readonly) NSMutableArray *completionBlocks;
 /**Wether or not the app receipt passed validation.*/
 @property (nonatomic, assign, readonly) BOOL passedValidation;
 /**The validated receipt.*/
 @property (nonatomic, strong, readonly) MKApplicationReceipt *validatedReceipt;
+/**The last validated receipt handed to callers or observers. Changes are computed against it, so a validation that runs again for late callers still reports what changed since they last heard.*/
+@property (nonatomic, strong, readonly) MKApplicationReceipt *deliveredReceipt;
 /**Wether or not we began to refresh the receipt.*/
 @property (nonatomic, assign, readonly) BOOL beganReceiptRefresh;
 /**Wether or not we refreshed the receipt.*/
 @property (nonatomic, assign, readonly) BOOL hasRefreshedReceipt;
 /**The reqest to refresh the receipts*/
 @property (nonatomic, strong, readonly) SKReceiptRefreshRequest *refreshRequest;
+/**The durations and counters of the validations.*/
+@property (nonatomic, assign, readonly) MKReceiptMetrics *metrics;
+/**Wether or not the validation in flight was started by the receipt watcher, no caller asked for it.*/
+@property (nonatomic, assign, readonly) BOOL validatingInBackground;
+/**The validated receipt without changes, handed to callers whose validation was skipped.*/
+@property (nonatomic, strong, readonly) MKApplicationReceipt *unchangedReceipt;
 
 @end
 
 @implementation MKReceiptValidator
+{
+    /**The entitlement snapshot of the previous validation, mapped on first use. Guarded by self.*/
+    MKReceiptSnapshot _snapshot;
+    /**Wether or not a snapshot was mapped.*/
+    BOOL _hasSnapshot;
+    /**Wether or not the snapshot file has to be mapped again before the next lookup.*/
+    BOOL _snapshotNeedsLoad;
+    /**The state of the receipt file that was last validated. Only accessed from the validation queue.*/
+    MKReceiptFileState _receiptState;
+    /**Watches the directory of the receipt for changes.*/
+    dispatch_source_t _receiptWatcher;
+    /**Polls the receipt when its directory can not be watched.*/
+    dispatch_source_t _receiptPollTimer;
+    /**Fires once changes to the receipt have settled.*/
+    dispatch_source_t _receiptSettleTimer;
+    /**The secrets loaded from the keychain, by name.*/
+    NSMutableDictionary *_secrets;
+}
 
 + (instancetype)sharedValidator
 {
@@ -159,75 +305,279 @@ NSString *kIAPReceiptWebOrderLineItemID             = @"WebItemId";
     return validator;
 }
 
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _validationQueue = dispatch_queue_create("com.BrandonMcQuilkin.M13MarketKit.ReceiptValidation", DISPATCH_QUEUE_SERIAL);
+        _completionBlocks = [NSMutableArray array];
+        _metrics = MKReceiptMetricsCreate();
+        _snapshotNeedsLoad = YES;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_receiptWatcher) {
+        dispatch_source_cancel(_receiptWatcher);
+    }
+    if (_receiptPollTimer) {
+        dispatch_source_cancel(_receiptPollTimer);
+    }
+    if (_receiptSettleTimer) {
+        dispatch_source_cancel(_receiptSettleTimer);
+    }
+    MKReceiptMetricsFree(_metrics);
+    MKReceiptSnapshotClose(&_snapshot);
+}
+
 - (void)validateReceiptWithCompletion:(ReceiptValidationCompletionBlock)completion forceRefresh:(BOOL)force
 {
-    if (!force && _passedValidation && _validatedReceipt) {
-        //Already validated, just send the validated receipt.
-        completion(YES, _validatedReceipt, nil);
-        return;
-    } else {
-        if (!_completionBlocks) {
-            _completionBlocks = [NSMutableArray array];
+    dispatch_async(_validationQueue, ^{
+        //A forced validation of a receipt whose bytes did not change would only repeat the last one.
+        BOOL forceRefresh = force;
+        if (force && _passedValidation && _validatedReceipt && !_validationInProgress && ![self receiptHasChanged]) {
+            forceRefresh = NO;
+        }
+        
+        if (!forceRefresh && _passedValidation && _validatedReceipt) {
+            //Already validated, just send the validated receipt. Nothing was validated for this caller, so it reports no changes.
+            if (completion != nil) {
+                if (_unchangedReceipt.payloadData != _validatedReceipt.payloadData) {
+                    _unchangedReceipt = [_validatedReceipt unchangedReceipt];
+                }
+                MKApplicationReceipt *receipt = _unchangedReceipt;
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    completion(YES, receipt, nil);
+                });
+            }
+            return;
         }
+        
         if (completion != nil) {
             [_completionBlocks addObject:completion];
         }
+        //A caller asked for this validation now, it may refresh the receipt if it has to.
+        _validatingInBackground = NO;
+        
+        if (_validationInProgress) {
+            //Attach to the validation in flight. A forced validation has to read the receipt again once it is done, the receipt may have changed since it started.
+            if (forceRefresh) {
+                _needsRevalidation = YES;
+            }
+            return;
+        }
+        
+        _validationInProgress = YES;
+        if (forceRefresh) {
+            _hasRefreshedReceipt = NO;
+        }
+        [self performValidation];
+    });
+}
+
+- (NSString *)receiptPath
+{
+    return [[[NSBundle mainBundle] appStoreReceiptURL] path];
+}
+
+- (BOOL)receiptHasChanged
+{
+    NSString *path = [self receiptPath];
+    if (!path) {
+        return YES;
+    }
+    return MKReceiptFileStateHasChanged([path fileSystemRepresentation], &_receiptState) != 0;
+}
+
+- (void)watchReceipt
+{
+    if (_receiptWatcher || _receiptPollTimer) {
+        return;
     }
     
-    if (force) {
-        _hasRefreshedReceipt = NO;
+    //StoreKit replaces the receipt instead of writing to it, so the directory holding it is watched.
+    NSString *directory = [[self receiptPath] stringByDeletingLastPathComponent];
+    int fd = directory ? open([directory fileSystemRepresentation], O_EVTONLY) : -1;
+    __weak MKReceiptValidator *weakSelf = self;
+    
+    if (fd >= 0) {
+        dispatch_source_t watcher = dispatch_source_create(DISPATCH_SOURCE_TYPE_VNODE, (uintptr_t)fd, DISPATCH_VNODE_WRITE | DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME, _validationQueue);
+        if (watcher) {
+            _receiptWatcher = watcher;
+            dispatch_source_set_event_handler(watcher, ^{
+                MKReceiptValidator *validator = weakSelf;
+                if (!validator) {
+                    return;
+                }
+                if (dispatch_source_get_data(watcher) & (DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME)) {
+                    //The directory itself went away, watch whatever is at its path now, or poll if there is nothing.
+                    dispatch_source_cancel(watcher);
+                    validator->_receiptWatcher = nil;
+                    [validator watchReceipt];
+                }
+                [validator scheduleReceiptCheck];
+            });
+            dispatch_source_set_cancel_handler(watcher, ^{
+                close(fd);
+            });
+            dispatch_resume(watcher);
+            return;
+        }
+        close(fd);
+    }
+    
+    //Nothing to watch, check the receipt periodically instead.
+    _receiptPollTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _validationQueue);
+    dispatch_source_set_timer(_receiptPollTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kMKReceiptPollInterval * NSEC_PER_SEC)), (uint64_t)(kMKReceiptPollInterval * NSEC_PER_SEC), NSEC_PER_SEC);
+    dispatch_source_set_event_handler(_receiptPollTimer, ^{
+        [weakSelf checkReceiptForChanges];
+    });
+    dispatch_resume(_receiptPollTimer);
+}
+
+- (void)scheduleReceiptCheck
+{
+    //A burst of transactions rewrites the receipt several times, only read it once the writes settle.
+    if (!_receiptSettleTimer) {
+        __weak MKReceiptValidator *weakSelf = self;
+        _receiptSettleTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _validationQueue);
+        dispatch_source_set_event_handler(_receiptSettleTimer, ^{
+            [weakSelf checkReceiptForChanges];
+        });
+        dispatch_source_set_timer(_receiptSettleTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(_receiptSettleTimer);
+    }
+    dispatch_source_set_timer(_receiptSettleTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kMKReceiptChangeSettleInterval * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 10);
+}
+
+- (void)checkReceiptForChanges
+{
+    //Only a receipt that was validated before has something to compare with.
+    if (!_passedValidation) {
+        return;
+    }
+    if (_validationInProgress) {
+        [self scheduleReceiptCheck];
+        return;
+    }
+    if (![self receiptHasChanged]) {
+        return;
     }
     
+    NSLog(@"The receipt changed, revalidating...");
+    _validationInProgress = YES;
+    _validatingInBackground = YES;
+    _hasRefreshedReceipt = NO;
+    [self performValidation];
+}
+
+- (void)performValidation
+{
     //We need to validate the receipt.
     NSLog(@"Attempting to validate the receipt...");
     
-    NSURL *receiptURL = [[NSBundle mainBundle] appStoreReceiptURL];
-    NSString *receiptPath = [receiptURL path];
+    NSString *receiptPath = [self receiptPath];
     NSError *error;
     [self validateReceiptAtPath:receiptPath error:&error];
     
     if (_passedValidation && _validatedReceipt) {
         NSLog(@"Receipt passed validation.");
         [self runCompletionBlocksWithSuccess:YES error:nil];
-    } else if (!_beganReceiptRefresh && !_hasRefreshedReceipt) {
-        //If we have not refreshed the receipt, refresh it.
+    } else if (!_beganReceiptRefresh && !_hasRefreshedReceipt && !_validatingInBackground) {
+        //If we have not refreshed the receipt, refresh it. The validation stays in flight until the request finishes.
+        //Never for a validation no caller asked for, the refresh may ask the user to sign in.
         NSLog(@"Receipt Failed validation: %@, %@", error.localizedDescription, error.localizedFailureReason);
         NSLog(@"Refreshing receipt...");
-        _refreshRequest = [[SKReceiptRefreshRequest alloc] init];
-        _refreshRequest.delegate = self;
-        [_refreshRequest start];
-    } else if (_hasRefreshedReceipt && !_passedValidation) {
+        _beganReceiptRefresh = YES;
+        [self refreshReceipt];
+    } else {
         NSLog(@"Receipt Failed validation: %@, %@", error.localizedDescription, error.localizedFailureReason);
+        //Do not let the next launch answer from the entitlements of a receipt that no longer validates.
+        [[NSFileManager defaultManager] removeItemAtPath:[self entitlementSnapshotPath] error:nil];
+        [self entitlementSnapshotChanged];
         [self runCompletionBlocksWithSuccess:NO error:error];
     }
 }
 
+- (void)refreshReceipt
+{
+    SKReceiptRefreshRequest *refreshRequest = [[SKReceiptRefreshRequest alloc] init];
+    refreshRequest.delegate = self;
+    _refreshRequest = refreshRequest;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [refreshRequest start];
+    });
+}
+
 - (void)requestDidFinish:(SKRequest *)request
 {
     NSLog(@"Receipt refresh succeded...");
-    _refreshRequest = nil;
-    _hasRefreshedReceipt = YES;
-    _beganReceiptRefresh = NO;
-    [self validateReceiptWithCompletion:nil forceRefresh:NO];
+    dispatch_async(_validationQueue, ^{
+        _refreshRequest = nil;
+        _hasRefreshedReceipt = YES;
+        _beganReceiptRefresh = NO;
+        [self performValidation];
+    });
 }
 
 - (void)request:(SKRequest *)request didFailWithError:(NSError *)error
 {
     NSLog(@"Receipt refresh failed.");
-    _refreshRequest = nil;
-    _hasRefreshedReceipt = YES;
-    _beganReceiptRefresh = NO;
-    //Failure
-    [self runCompletionBlocksWithSuccess:NO error:error];
+    dispatch_async(_validationQueue, ^{
+        _refreshRequest = nil;
+        _hasRefreshedReceipt = YES;
+        _beganReceiptRefresh = NO;
+        //Failure
+        [self runCompletionBlocksWithSuccess:NO error:error];
+    });
 }
 
 - (void)validateReceiptAtPath:(NSString *)path error:(NSError **)error;
+{
+    MKApplicationReceipt *previousReceipt = _deliveredReceipt;
+    _validatedReceipt = nil;
+    _passedValidation = NO;
+    
+    //Recorded before the receipt is read, so a change made while validating is noticed afterwards.
+    if (!path || !MKReceiptFileStateCapture([path fileSystemRepresentation], &_receiptState)) {
+        memset(&_receiptState, 0, sizeof(MKReceiptFileState));
+    }
+    
+    MKApplicationReceipt *receipt = [self verifiedApplicationReceiptAtPath:path error:error];
+    if (!receipt) {
+        return;
+    }
+    
+    if (previousReceipt) {
+        [receipt computeChangesFromReceipt:previousReceipt];
+    }
+    
+    _validatedReceipt = receipt;
+    _passedValidation = YES;
+    [self watchReceipt];
+    
+    //Record the entitlements, so the next launch can answer before the receipt is verified again.
+    NSData *snapshotKey = [self entitlementSnapshotKey];
+    if (receipt.entitlements && snapshotKey) {
+        MKReceiptSnapshotWrite([[self entitlementSnapshotPath] fileSystemRepresentation], snapshotKey.bytes, receipt.entitlements, [[NSDate date] timeIntervalSince1970]);
+        [self entitlementSnapshotChanged];
+    }
+    
+    //Callers that asked for a validation get the changes in their completion, only changes the watcher found are announced.
+    if (_validatingInBackground && receipt.updatedProductIdentifiers.count > 0) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [[NSNotificationCenter defaultCenter] postNotificationName:kMKReceiptValidatorReceiptChangedNotification object:receipt];
+        });
+    }
+}
+
+- (MKApplicationReceipt *)verifiedApplicationReceiptAtPath:(NSString *)path error:(NSError **)error
 {
     //Use defined values since the values in the info.plist can be changed.
     NSString *bundleVersion = (NSString*)kBundleVersionConstant;
     NSString *bundleIdentifier = (NSString *)kBundleIdentifierConstant;
-    _validatedReceipt = nil;
-    _passedValidation = NO;
     
     //Check that the identifier and versions match.
     NSCAssert([bundleVersion isEqualToString:[[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleShortVersionString"]],
@@ -243,21 +593,19 @@ NSString *kIAPReceiptWebOrderLineItemID             = @"WebItemId";
                                    NSLocalizedRecoverySuggestionErrorKey: NSLocalizedString(@"Refresh the application receipt.", nil)
                                    };
         *error = [NSError errorWithDomain:kM13MarketKitErrorDomain code:kMKReceiptValidationErrorCodeNoReceipt userInfo:userInfo];
-        return;
+        return nil;
     }
     
-    //Validate the receipt
-    unsigned char uuidBytes[16];
+    //Validate the receipt. Without an identifier for vendor the hash of zeros does not match.
+    unsigned char uuidBytes[16] = {0};
     NSUUID *vendorUUID = [[UIDevice currentDevice] identifierForVendor];
     [vendorUUID getUUIDBytes:uuidBytes];
     
-    NSMutableData *input = [NSMutableData data];
-    [input appendBytes:uuidBytes length:sizeof(uuidBytes)];
-    [input appendData:receipt.opaqueValue];
-    [input appendData:receipt.bundleIdentifierData];
-    
-    NSMutableData *hash = [NSMutableData dataWithLength:SHA_DIGEST_LENGTH];
-    SHA1([input bytes], [input length], [hash mutableBytes]);
+    //The three parts are hashed in turn, without joining them first.
+    NSData *opaqueValue = receipt.opaqueValue;
+    NSData *bundleIdentifierData = receipt.bundleIdentifierData;
+    NSData *sha1Hash = receipt.sha1Hash;
+    BOOL hashMatches = MKReceiptVerifierCheckDeviceHash(uuidBytes, opaqueValue.bytes, opaqueValue.length, bundleIdentifierData.bytes, bundleIdentifierData.length, sha1Hash.bytes, sha1Hash.length);
     
     if (![bundleIdentifier isEqualToString:receipt.bundleIdentifier]) {
         NSDictionary *userInfo = @{NSLocalizedDescriptionKey: NSLocalizedString(@"Application receipt failed to validate.", nil),
@@ -265,7 +613,7 @@ NSString *kIAPReceiptWebOrderLineItemID             = @"WebItemId";
                                    NSLocalizedRecoverySuggestionErrorKey: NSLocalizedString(@"The application bundle has been edited. Epic Fail", nil)
                                    };
         *error = [NSError errorWithDomain:kM13MarketKitErrorDomain code:kMKReceiptValidationErrorCodeInvalidBundleIdentifier userInfo:userInfo];
-        return;
+        return nil;
     }
     
     if (![bundleVersion isEqualToString:receipt.applicationVersion]) {
@@ -274,32 +622,46 @@ NSString *kIAPReceiptWebOrderLineItemID             = @"WebItemId";
                                    NSLocalizedRecoverySuggestionErrorKey: NSLocalizedString(@"The application bundle has been edited. Epic Fail", nil)
                                    };
         *error = [NSError errorWithDomain:kM13MarketKitErrorDomain code:kMKReceiptValidationErrorCodeInvalidVersion userInfo:userInfo];
-        return;
+        return nil;
     }
     
-    if (![hash isEqualToData:receipt.sha1Hash]) {
+    if (!hashMatches) {
         NSDictionary *userInfo = @{NSLocalizedDescriptionKey: NSLocalizedString(@"Application receipt failed to validate.", nil),
-                                   NSLocalizedFailureReasonErrorKey: NSLocalizedString(@"The receipt application version does not match the application's version", nil),
-                                   NSLocalizedRecoverySuggestionErrorKey: NSLocalizedString(@"The application bundle has been edited. Epic Fail",;nil)
+                                   NSLocalizedFailureReasonErrorKey: NSLocalizedString(@"The receipt hash does not match the device identifier", nil),
+                                   NSLocalizedRecoverySuggestionErrorKey: NSLocalizedString(@"The receipt was copied from another device, refresh it to get the receipt of this one.", nil)
                                    };
-        *error = [NSError errorWithDomain:kM13MarketKitErrorDomain code:kMKReceiptValidationErrorCodeInvalidVersion userInfo:userInfo];
-        return;
+        *error = [NSError errorWithDomain:kM13MarketKitErrorDomain code:kMKReceiptValidationErrorCodeInvalidDeviceHash userInfo:userInfo];
+        return nil;
     }
     
-    _validatedReceipt = receipt;
-    _passedValidation = YES;
+    return receipt;
 }
 
 - (void)runCompletionBlocksWithSuccess:(BOOL)success error:(NSError *)error
 {
-    //Run each completion that has been stored.
-    @synchronized(_completionBlocks) {
-        NSArray *blocks = [_completionBlocks copy];
+    if (_needsRevalidation) {
+        //A forced validation came in while this one was running, its callers get the fresh result.
+        _needsRevalidation = NO;
+        _hasRefreshedReceipt = NO;
+        [self performValidation];
+        return;
+    }
+    
+    _validationInProgress = NO;
+    _validatingInBackground = NO;
+    if (success && _validatedReceipt) {
+        _deliveredReceipt = _validatedReceipt;
+    }
+    
+    //Run each completion that has been stored on the main queue, callers update the interface. Off the validation queue, so they can start another validation.
+    NSArray *blocks = [_completionBlocks copy];
+    [_completionBlocks removeAllObjects];
+    MKApplicationReceipt *receipt = _validatedReceipt;
+    dispatch_async(dispatch_get_main_queue(), ^{
         for (ReceiptValidationCompletionBlock completion in blocks) {
-            completion(success, _validatedReceipt, error);
-            [_completionBlocks removeObject:completion];
+            completion(success, receipt, error);
         }
-    }
+    });
 }
 
 - (NSData *)appleRootCertificateData
@@ -310,210 +672,220 @@ NSString *kIAPReceiptWebOrderLineItemID             = @"WebItemId";
     return [NSData dataWithContentsOfURL:[[NSBundle mainBundle] URLForResource:@"AppleIncRootCertificate" withExtension:@"cer"]];
 }
 
-- (NSArray *)receiptsFromInAppPurchaseData:(NSData *)data
+- (MKReceiptVerifier *)receiptVerifier
 {
-    //Setup
-    int type = 0;
-    int xclass = 0;
-    long length = 0;
-    
-    NSUInteger dataLenght = [data length];
-    const uint8_t *p = [data bytes];
-    
-    const uint8_t *end = p + dataLenght;
-    
-    //The array to hold the receipts
-    NSMutableArray *resultArray = [NSMutableArray array];
+    //The root certificate and trust store are created once, and shared by every validation.
+    static MKReceiptVerifier *verifier = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        uint64_t start = MKReceiptMetricsNow();
+        NSData *rootCertificateData = [self appleRootCertificateData];
+        verifier = MKReceiptVerifierCreate(rootCertificateData.bytes, rootCertificateData.length);
+        MKReceiptMetricsRecordStage(_metrics, MKReceiptStageTrustStore, start);
+        if (!verifier) {
+            NSLog(@"Unable to load the Apple root certificate.");
+        }
+    });
+    return verifier;
+}
+
+- (NSString *)validationCachePath
+{
+    NSString *cacheDirectory = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES)[0];
+    cacheDirectory = [cacheDirectory stringByAppendingPathComponent:@"MKMarket"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:cacheDirectory withIntermediateDirectories:YES attributes:nil error:nil];
+    return [cacheDirectory stringByAppendingPathComponent:@"ReceiptValidation.cache"];
+}
+
+- (NSString *)entitlementSnapshotPath
+{
+    return [[[self validationCachePath] stringByDeletingLastPathComponent] stringByAppendingPathComponent:@"Entitlements.snapshot"];
+}
+
+- (NSData *)entitlementSnapshotKey
+{
+    //A random key kept in the keychain of this device, anyone able to write the snapshot file can not compute it.
+    return [self secretNamed:@"EntitlementSnapshot" length:MKReceiptSnapshotKeyLength];
+}
+
+- (void)entitlementSnapshotChanged
+{
+    //The next lookup maps the new file. The old mapping stays valid until then, the file is replaced by a rename.
+    @synchronized(self) {
+        _snapshotNeedsLoad = YES;
+    }
+}
+
+- (MKCachedEntitlement)cachedEntitlementOfProductIdentifier:(NSString *)productIdentifier
+{
+    const char *identifier = [productIdentifier UTF8String];
+    if (!identifier) {
+        return MKCachedEntitlementUnknown;
+    }
     
-    //While we have data to process
-    while (p < end) {
-        //Get the main object
-        ASN1_get_object(&p, &length, &type, &xclass, end - p);
+    @synchronized(self) {
+        if (_snapshotNeedsLoad) {
+            _snapshotNeedsLoad = NO;
+            MKReceiptSnapshotClose(&_snapshot);
+            NSData *key = [self entitlementSnapshotKey];
+            _hasSnapshot = key && MKReceiptSnapshotOpen(&_snapshot, [[self entitlementSnapshotPath] fileSystemRepresentation], key.bytes);
+        }
         
-        const uint8_t *set_end = p + length;
+        if (!_hasSnapshot) {
+            return MKCachedEntitlementUnknown;
+        }
         
-        //This should be as set of receipts, of not a set, we have a problem.
-        if(type != V_ASN1_SET) {
-            break;
+        switch (MKReceiptSnapshotLookup(&_snapshot, (const uint8_t *)identifier, strlen(identifier), [[NSDate date] timeIntervalSince1970])) {
+            case MKReceiptSnapshotEntitlementEntitled:
+                return MKCachedEntitlementEntitled;
+            case MKReceiptSnapshotEntitlementNotEntitled:
+                return MKCachedEntitlementNotEntitled;
+            default:
+                return MKCachedEntitlementUnknown;
+        }
+    }
+}
+
+- (NSData *)secretNamed:(NSString *)name length:(NSUInteger)length
+{
+    @synchronized(self) {
+        if (_secrets[name]) {
+            return _secrets[name];
         }
         
-        //The dictionary to set up the receipt with
-        NSMutableDictionary *item = [[NSMutableDictionary alloc] initWithCapacity:6];
+        //The secret is random and kept in the keychain, files in the sandbox can be written by anyone with access to the device backup.
+        NSDictionary *item = @{(__bridge id)kSecClass: (__bridge id)kSecClassGenericPassword,
+                               (__bridge id)kSecAttrService: @"com.BrandonMcQuilkin.M13MarketKit",
+                               (__bridge id)kSecAttrAccount: name};
+        NSMutableDictionary *query = [item mutableCopy];
+        query[(__bridge id)kSecReturnData] = @YES;
+        CFTypeRef result = NULL;
+        NSData *secret = nil;
+        OSStatus status = SecItemCopyMatching((__bridge CFDictionaryRef)query, &result);
+        if (status == errSecSuccess) {
+            secret = CFBridgingRelease(result);
+        } else if (status != errSecItemNotFound) {
+            //The keychain could not be read, for example while the device is locked. The secret may still exist, replacing it would invalidate everything it protects.
+            return nil;
+        }
         
-        //While we have data in the set to process.
-        while (p < set_end) {
-            //Get a receipt object
-            ASN1_get_object(&p, &length, &type, &xclass, set_end - p);
-            
-            //If not a sequence, we have a problem.
-            if (type != V_ASN1_SEQUENCE) {
-                break;
+        //Create the secret if there is none yet, or replace one that can not have been written by us.
+        if (secret.length != length) {
+            NSMutableData *newSecret = [NSMutableData dataWithLength:length];
+            if (SecRandomCopyBytes(kSecRandomDefault, length, newSecret.mutableBytes) != 0) {
+                return nil;
             }
-            
-            const uint8_t *seq_end = p + length;
-            
-            //Get the attribute type and version.
-            int attr_type = 0;
-            int attr_version = 0;
-            
-            // Attribute type
-            ASN1_get_object(&p, &length, &type, &xclass, seq_end - p);
-            if (type == V_ASN1_INTEGER) {
-                if(length == 1) {
-                    attr_type = p[0];
-                }
-                else if(length == 2) {
-                    attr_type = p[0] * 0x100 + p[1]
-                    ;
-                }
-            }
-            p += length;
-            
-            // Attribute version
-            ASN1_get_object(&p, &length, &type, &xclass, seq_end - p);
-            if (type == V_ASN1_INTEGER && length == 1) {
-                attr_version = p[0];
+            //Never migrated to another device, and readable by the validation in the background once the device was unlocked.
+            SecItemDelete((__bridge CFDictionaryRef)item);
+            NSMutableDictionary *attributes = [item mutableCopy];
+            attributes[(__bridge id)kSecValueData] = newSecret;
+            attributes[(__bridge id)kSecAttrAccessible] = (__bridge id)kSecAttrAccessibleAfterFirstUnlockThisDeviceOnly;
+            if (SecItemAdd((__bridge CFDictionaryRef)attributes, NULL) != errSecSuccess) {
+                return nil;
             }
-            p += length;
-            
-            //Parse the attributes (Check to see if it is a documented attribute that we want)
-            if (attr_type == kIAPCancelationDateField || attr_type == kIAPOriginalPurchaseDateField || attr_type ==kIAPOriginalTransactionIdentifierField || attr_type == kIAPProductIdentifierField || attr_type == kIAPPurchaseDateField || attr_type == kIAPQuantityField || attr_type == kIAPSubscriptionExpirationDateField || attr_type == kIAPTransactionIdentifierField || attr_type == kIAPWebOrderLineItemIdentifierField) {
-                
-                //The storage key
-                NSString *key = nil;
-                
-                ASN1_get_object(&p, &length, &type, &xclass, seq_end - p);
-                
-                if (type == V_ASN1_OCTET_STRING) {
-                    
-                    //Process integers
-                    if (attr_type == kIAPQuantityField || attr_type == kIAPWebOrderLineItemIdentifierField) {
-                        int num_type = 0;
-                        long num_length = 0;
-                        const uint8_t *num_p = p;
-                        //Get the integer
-                        ASN1_get_object(&num_p, &num_length, &num_type, &xclass, seq_end - num_p);
-                        //Check to see that is an integer, and process the data.
-                        if (num_type == V_ASN1_INTEGER) {
-                            NSUInteger quantity = 0;
-                            if (num_length) {
-                                quantity += num_p[0];
-                                if (num_length > 1) {
-                                    quantity += num_p[1] * 0x100;
-                                    if (num_length > 2) {
-                                        quantity += num_p[2] * 0x10000;
-                                        if (num_length > 3) {
-                                            quantity += num_p[3] * 0x1000000;
-                                        }
-                                    }
-                                }
-                            }
-                            
-                            //Store the values
-                            NSNumber *num = [[NSNumber alloc] initWithUnsignedInteger:quantity];
-                            if (attr_type == kIAPQuantityField) {
-                                [item setObject:num forKey:kIAPReceiptQuantity];
-                            } else if (attr_type == kIAPWebOrderLineItemIdentifierField) {
-                                [item setObject:num forKey:kIAPReceiptWebOrderLineItemID];
-                            }
-                        }
-                    }
-                    
-                    //Process strings
-                    if (attr_type == kIAPProductIdentifierField || attr_type == kIAPTransactionIdentifierField || attr_type == kIAPOriginalTransactionIdentifierField || attr_type == kIAPPurchaseDateField || attr_type == kIAPOriginalPurchaseDateField || attr_type == kIAPSubscriptionExpirationDateField || attr_type == kIAPCancelationDateField) {
-                        
-                        int str_type = 0;
-                        long str_length = 0;
-                        const uint8_t *str_p = p;
-                        //Get the string
-                        ASN1_get_object(&str_p, &str_length, &str_type, &xclass, seq_end - str_p);
-                        
-                        if (str_type == V_ASN1_UTF8STRING) {
-                            switch (attr_type) {
-                                case kIAPProductIdentifierField:
-                                    key = kIAPReceiptProductIdentifier;
-                                    break;
-                                case kIAPTransactionIdentifierField:
-                                    key = kIAPReceiptTransactionIdentifier;
-                                    break;
-                                case kIAPOriginalTransactionIdentifierField:
-                                    key = kIAPReceiptOriginalTransactionIdentifier;
-                                    break;
-                            }
-                            
-                            if (key) {
-                                NSString *string = [[NSString alloc] initWithBytes:str_p length:(NSUInteger)str_length encoding:NSUTF8StringEncoding];
-                                [item setObject:string forKey:key];
-                            }
-                        }
-                        
-                        if (str_type == V_ASN1_IA5STRING) {
-                            switch (attr_type) {
-                                case kIAPPurchaseDateField:
-                                    key = kIAPReceiptPurchaseDate;
-                                    break;
-                                case kIAPOriginalPurchaseDateField:
-                                    key = kIAPReceiptOriginalPurchaseDate;
-                                    break;
-                                case kIAPSubscriptionExpirationDateField:
-                                    key = kIAPReceiptSubscriptionExpirationDate;
-                                    break;
-                                case kIAPCancelationDateField:
-                                    key = kIAPReceiptCancellationDate;
-                                    break;
-                            }
-                            
-                            if (key) {
-                                NSString *string = [[NSString alloc] initWithBytes:str_p length:(NSUInteger)str_length encoding:NSASCIIStringEncoding];
-                                [item setObject:string forKey:key];
-                            }
-                        }
-                    }
-                }
-                
-                p += length;
-                
-            }
-            
-            // Skip any remaining fields in this SEQUENCE
-            while (p < seq_end) {
-                ASN1_get_object(&p, &length, &type, &xclass, seq_end - p);
-                p += length;
-            }
-            
+            secret = newSecret;
         }
         
-        // Skip any remaining fields in this SET
-        while (p < set_end) {
-            ASN1_get_object(&p, &length, &type, &xclass, set_end - p);
-            p += length;
+        if (!_secrets) {
+            _secrets = [NSMutableDictionary dictionary];
         }
-        
-        [resultArray addObject:[[MKInAppPurchaseReceipt alloc] initWithInformation:item]];
+        _secrets[name] = secret;
+        return secret;
+    }
+}
+
+- (BOOL)getValidationCacheKey:(uint8_t *)key forReceiptData:(NSData *)receiptData
+{
+    //The identifier is nil until the device is unlocked after a restart, a key without it would be the same on every device.
+    NSUUID *vendorUUID = [[UIDevice currentDevice] identifierForVendor];
+    if (!vendorUUID) {
+        return NO;
     }
     
-    return [resultArray copy];
+    //The device identifier is hashed so it is never stored or used as is.
+    unsigned char uuidBytes[16];
+    [vendorUUID getUUIDBytes:uuidBytes];
+    unsigned char deviceIdentifierHash[SHA256_DIGEST_LENGTH];
+    SHA256(uuidBytes, sizeof(uuidBytes), deviceIdentifierHash);
+    
+    MKReceiptCacheComputeKey(receiptData.bytes, receiptData.length, [kBundleVersionConstant UTF8String], deviceIdentifierHash, sizeof(deviceIdentifierHash), key);
+    return YES;
 }
 
 - (MKApplicationReceipt *)applicationReceiptAtPath:(NSString *)receiptPath
 {
-    //Get the root certificate
-    NSData *rootCertificateData = [self appleRootCertificateData];
+    //Without the root certificate nothing can be verified, do not record that as a result.
+    if (![self receiptVerifier]) {
+        return nil;
+    }
     
-    ERR_load_PKCS7_strings();
-    ERR_load_X509_strings();
-    OpenSSL_add_all_digests();
+    //Map the receipt read only, every later stage works on the mapped bytes.
+    uint64_t start = MKReceiptMetricsNow();
+    NSData *receiptData = [NSData dataWithContentsOfFile:receiptPath options:NSDataReadingMappedAlways error:nil];
+    if (!receiptData) {
+        return nil;
+    }
     
-    // Expected input is a PKCS7 container with signed data containing an ASN.1 SET of SEQUENCE structures. Each SEQUENCE contains two INTEGERS and an OCTET STRING.
+    //If this exact receipt was verified before, use the stored result. Only files written with our secret are trusted.
+    uint8_t key[MKReceiptCacheKeyLength];
+    const char *cachePath = [[self validationCachePath] fileSystemRepresentation];
+    NSData *secret = nil;
+    if ([self getValidationCacheKey:key forReceiptData:receiptData]) {
+        secret = [self secretNamed:@"ReceiptValidationCache" length:MKReceiptCacheSecretLength];
+    }
+    
+    MKReceiptCacheEntry entry;
+    int cached = secret && MKReceiptCacheRead(cachePath, key, secret.bytes, &entry);
+    start = MKReceiptMetricsRecordStage(_metrics, MKReceiptStageLoad, start);
+    if (cached) {
+        NSData *payloadData = [NSData dataWithBytesNoCopy:entry.content length:entry.contentLength freeWhenDone:YES];
+        MKApplicationReceipt *receipt = [[MKApplicationReceipt alloc] initWithPayloadData:payloadData decodedPayload:&entry.payload];
+        MKReceiptMetricsRecordStage(_metrics, MKReceiptStageConstruct, start);
+        if (receipt) {
+            MKReceiptMetricsRecordValidation(_metrics, receiptData.length, receipt.payload->transactionCount);
+        }
+        return receipt;
+    }
+    
+    MKApplicationReceipt *receipt = [self verifiedReceiptFromData:receiptData];
     
-    const char * path = [receiptPath fileSystemRepresentation];
-    FILE *fp = fopen(path, "rb");
-    if (fp == NULL) {
+    //Failures are not stored, the certificate validity, the clock or memory may be fine on the next attempt.
+    if (receipt) {
+        MKReceiptMetricsRecordValidation(_metrics, receiptData.length, receipt.payload->transactionCount);
+        if (secret) {
+            MKReceiptCacheWrite(cachePath, key, secret.bytes, receipt.payloadData.bytes, receipt.payloadData.length, receipt.payload);
+        }
+    }
+    
+    return receipt;
+}
+
+- (MKApplicationReceipt *)verifiedReceiptFromData:(NSData *)receiptData
+{
+    MKReceiptVerifier *verifier = [self receiptVerifier];
+    if (!verifier) {
         return nil;
     }
     
-    PKCS7 *p7 = d2i_PKCS7_fp(fp, NULL);
-    fclose(fp);
+    // Expected input is a PKCS7 container with signed data containing an ASN.1 SET of SEQUENCE structures. Each SEQUENCE contains two INTEGERS and an OCTET STRING.
+    
+    //Find the content, certificates and signer in the mapped receipt. Only the certificates are decoded to check the signature.
+    uint64_t start = MKReceiptMetricsNow();
+    MKReceiptContainer container;
+    if (MKReceiptContainerParse(receiptData.bytes, receiptData.length, &container)) {
+        MKReceiptMetricsRecordStage(_metrics, MKReceiptStageParse, start);
+        //The deallocator holds on to the mapping for as long as the content is in use.
+        NSData *payloadData = [[NSData alloc] initWithBytesNoCopy:(void *)MKReceiptRangeBytes(receiptData.bytes, container.content) length:container.content.length deallocator:^(void *bytes, NSUInteger length) {
+            (void)receiptData;
+        }];
+        return [self receiptFromPayloadData:payloadData verifiedBy:^BOOL{
+            return MKReceiptVerifierVerifyContainer(verifier, receiptData.bytes, receiptData.length, &container);
+        }];
+    }
+    
+    //Containers the parser does not handle, such as content split over several chunks, are decoded by OpenSSL.
+    const uint8_t *p = receiptData.bytes;
+    PKCS7 *p7 = d2i_PKCS7(NULL, &p, (long)receiptData.length);
     
     // Check if the receipt file was invalid (otherwise we go crashing and burning)
     if (p7 == NULL) {
@@ -530,165 +902,99 @@ NSString *kIAPReceiptWebOrderLineItemID             = @"WebItemId";
         return nil;
     }
     
-    int verifyReturnValue = 0;
-    X509_STORE *store = X509_STORE_new();
-    if (store) {
-        const uint8_t *data = (uint8_t *)(rootCertificateData.bytes);
-        X509 *appleCA = d2i_X509(NULL, &data, (long)rootCertificateData.length);
-        if (appleCA) {
-            BIO *payload = BIO_new(BIO_s_mem());
-            X509_STORE_add_cert(store, appleCA);
-            
-            if (payload) {
-                verifyReturnValue = PKCS7_verify(p7,NULL,store,NULL,payload,0);
-                BIO_free(payload);
-            }
-            
-            X509_free(appleCA);
-        }
-        
-        X509_STORE_free(store);
-    }
-    
-    EVP_cleanup();
-    
-    if (verifyReturnValue != 1) {
+    ASN1_OCTET_STRING *octets = p7->d.sign->contents->d.data;
+    if (!octets) {
         PKCS7_free(p7);
         return nil;
     }
+    MKReceiptMetricsRecordStage(_metrics, MKReceiptStageParse, start);
     
-    ASN1_OCTET_STRING *octets = p7->d.sign->contents->d.data;
-    const uint8_t *p = octets->data;
-    const uint8_t *end = p + octets->length;
-    
-    int type = 0;
-    int xclass = 0;
-    long length = 0;
-    
-    //Get the receipt object
-    ASN1_get_object(&p, &length, &type, &xclass, end - p);
-    if (type != V_ASN1_SET) {
+    //The payload references the content, the deallocator frees the container once it is no longer used.
+    NSData *payloadData = [[NSData alloc] initWithBytesNoCopy:octets->data length:(NSUInteger)octets->length deallocator:^(void *bytes, NSUInteger length) {
         PKCS7_free(p7);
+    }];
+    
+    return [self receiptFromPayloadData:payloadData verifiedBy:^BOOL{
+        return MKReceiptVerifierVerify(verifier, p7);
+    }];
+}
+
+- (NSDictionary *)validationMetrics
+{
+    if (!_metrics) {
         return nil;
     }
+    MKReceiptMetricsSnapshot snapshot;
+    MKReceiptMetricsGetSnapshot(_metrics, &snapshot);
     
-    //The information to set up the receipt with.
-    NSMutableDictionary *info = [NSMutableDictionary dictionary];
-    
-    
-    //While we have data to process
-    while (p < end) {
-        
-        //Get an object
-        ASN1_get_object(&p, &length, &type, &xclass, end - p);
-        if (type != V_ASN1_SEQUENCE) {
-            break;
-        }
-        
-        const uint8_t *seq_end = p + length;
-        
-        int attr_type = 0;
-        int attr_version = 0;
-        
-        // Attribute type
-        ASN1_get_object(&p, &length, &type, &xclass, seq_end - p);
-        if (type == V_ASN1_INTEGER && length == 1) {
-            attr_type = p[0];
-        }
-        p += length;
-        
-        // Attribute version
-        ASN1_get_object(&p, &length, &type, &xclass, seq_end - p);
-        if (type == V_ASN1_INTEGER && length == 1) {
-            attr_version = p[0];
-            attr_version = attr_version;
-        }
-        p += length;
-        
-        // Only parse attributes we're interested in
-        if (attr_type == kBundleIdentifierField || attr_type == kVersionField || attr_type == kOpaqueValueField || attr_type == kHashField ||attr_type == kInAppPurchasesField || attr_type == kOriginalVersionField || attr_type == kExpirationDateField) {
-            //The key for the data
-            NSString *key = nil;
-            
-            ASN1_get_object(&p, &length, &type, &xclass, seq_end - p);
-            if (type == V_ASN1_OCTET_STRING) {
-                NSData *data = [NSData dataWithBytes:p length:(NSUInteger)length];
-                
-                // Bytes
-                if (attr_type == kBundleIdentifierField || attr_type == kOpaqueValueField || attr_type == kHashField) {
-                    switch (attr_type) {
-                        case kBundleIdentifierField:
-                            // This is included for hash generation
-                            key = kApplicationReceiptBundleIdentifierData;
-                            break;
-                        case kOpaqueValueField:
-                            key = kApplicationReceiptOpaqueValue;
-                            break;
-                        case kHashField:
-                            key = kApplicationReceiptHash;
-                            break;
-                    }
-                    if (key) {
-                        [info setObject:data forKey:key];
-                    }
-                }
-                
-                // Strings
-                if (attr_type == kBundleIdentifierField || attr_type == kVersionField || attr_type == kOriginalVersionField) {
-                    int str_type = 0;
-                    long str_length = 0;
-                    const uint8_t *str_p = p;
-                    ASN1_get_object(&str_p, &str_length, &str_type, &xclass, seq_end - str_p);
-                    if (str_type == V_ASN1_UTF8STRING) {
-                        switch (attr_type) {
-                            case kBundleIdentifierField:
-                                key = kApplicationReceiptBundleIdentifier;
-                                break;
-                            case kVersionField:
-                                key = kApplicationReceiptVersion;
-                                break;
-                            case kOriginalVersionField:
-                                key = kApplicationReceiptOriginalVersion;
-                                break;
-                        }
-                        
-                        if (key) {
-                            NSString *string = [[NSString alloc] initWithBytes:str_p length:(NSUInteger)str_length encoding:NSUTF8StringEncoding];
-                            [info setObject:string forKey:key];
-                        }
-                    }
-                }
-                
-                // In-App purchases
-                if (attr_type == kInAppPurchasesField) {
-                    NSArray *inApp = [self receiptsFromInAppPurchaseData:data];
-                    NSArray *current = info[kApplicationReceiptInApp];
-                    if (current) {
-                        info[kApplicationReceiptInApp] = [current arrayByAddingObjectsFromArray:inApp];
-                    } else {
-                        [info setObject:inApp forKey:kApplicationReceiptInApp];
-                    }
-                }
-            }
-            p += length;
-        }
-        
-        // Skip any remaining fields in this SEQUENCE
-        while (p < seq_end) {
-            ASN1_get_object(&p, &length, &type, &xclass, seq_end - p);
-            p += length;
+    NSMutableDictionary *stages = [NSMutableDictionary dictionaryWithCapacity:MKReceiptStageCount];
+    for (int stage = 0; stage < MKReceiptStageCount; stage++) {
+        const MKReceiptStageMetrics *stageMetrics = &snapshot.stages[stage];
+        NSMutableArray *histogram = [NSMutableArray arrayWithCapacity:MKReceiptMetricsBucketCount];
+        for (int bucket = 0; bucket < MKReceiptMetricsBucketCount; bucket++) {
+            [histogram addObject:@(stageMetrics->buckets[bucket])];
         }
+        stages[@(MKReceiptStageName((MKReceiptStage)stage))] = @{kMKReceiptMetricsStageCount: @(stageMetrics->count),
+                                                                 kMKReceiptMetricsStageTotalDuration: @(stageMetrics->totalNanoseconds / 1e9),
+                                                                 kMKReceiptMetricsStageMaximumDuration: @(stageMetrics->maximumNanoseconds / 1e9),
+                                                                 kMKReceiptMetricsStageHistogram: histogram};
     }
     
-    PKCS7_free(p7);
-    
-    return [[MKApplicationReceipt alloc] initWithInformation:info];
+    return @{kMKReceiptMetricsValidations: @(snapshot.validations),
+             kMKReceiptMetricsBytesProcessed: @(snapshot.bytesProcessed),
+             kMKReceiptMetricsTransactionsDecoded: @(snapshot.transactionsDecoded),
+             kMKReceiptMetricsStages: stages};
 }
 
+- (void)resetValidationMetrics
+{
+    if (_metrics) {
+        MKReceiptMetricsReset(_metrics);
+    }
+}
+
+- (MKApplicationReceipt *)receiptFromPayloadData:(NSData *)payloadData verifiedBy:(BOOL (^)(void))verify
+{
+    //Decode on another core while the signature and chain are checked. Both only read the content.
+    __block MKApplicationReceipt *receipt = nil;
+    MKReceiptMetrics *metrics = _metrics;
+    dispatch_group_t decode = dispatch_group_create();
+    dispatch_group_async(decode, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        uint64_t start = MKReceiptMetricsNow();
+        MKReceiptPayload payload;
+        if (MKDecodePayloadData(payloadData, &payload) != MKReceiptDecodeStatusSuccess) {
+            MKReceiptPayloadFree(&payload);
+            return;
+        }
+        start = MKReceiptMetricsRecordStage(metrics, MKReceiptStageDecode, start);
+        receipt = [[MKApplicationReceipt alloc] initWithPayloadData:payloadData decodedPayload:&payload];
+        MKReceiptMetricsRecordStage(metrics, MKReceiptStageConstruct, start);
+    });
+    
+    uint64_t start = MKReceiptMetricsNow();
+    BOOL verified = verify();
+    MKReceiptMetricsRecordStage(_metrics, MKReceiptStageVerify, start);
+    dispatch_group_wait(decode, DISPATCH_TIME_FOREVER);
+    
+    //The speculatively decoded receipt is only handed out once the content is known to be genuine.
+    return verified ? receipt : nil;
+}
 
 @end
 
 @implementation MKApplicationReceipt
+{
+    /**The signed content the receipt was decoded from.*/
+    NSData *_payloadData;
+    /**The decoded payload, the in app purchase receipts are created from it on first access.*/
+    MKReceiptPayload _payload;
+    /**The index from product identifier to transactions.*/
+    MKReceiptIndex _index;
+    /**The entitlement intervals of each product.*/
+    MKReceiptEntitlementIndex _entitlements;
+    /**The in app purchase receipts.*/
+    NSArray *_inAppPurchaseReceipts;
+}
 
 - (instancetype)initWithInformation:(NSDictionary *)information
 {
@@ -706,6 +1012,317 @@ NSString *kIAPReceiptWebOrderLineItemID             = @"WebItemId";
     return self;
 }
 
+- (instancetype)initWithPayloadData:(NSData *)data
+{
+    MKReceiptPayload payload;
+    if (MKDecodePayloadData(data, &payload) != MKReceiptDecodeStatusSuccess) {
+        MKReceiptPayloadFree(&payload);
+        return nil;
+    }
+    return [self initWithPayloadData:data decodedPayload:&payload];
+}
+
+- (instancetype)initWithPayloadData:(NSData *)data decodedPayload:(MKReceiptPayload *)payload
+{
+    self = [super init];
+    if (self) {
+        _payload = *payload;
+        memset(payload, 0, sizeof(MKReceiptPayload));
+        if (!MKReceiptIndexBuild(&_index, data.bytes, &_payload) || !MKReceiptEntitlementIndexBuild(&_entitlements, &_index)) {
+            return nil;
+        }
+        _payloadData = data;
+        _bundleIdentifier = MKStringFromRange(data, _payload.bundleIdentifier, NSUTF8StringEncoding);
+        _bundleIdentifierData = MKDataFromRange(data, _payload.bundleIdentifierData);
+        _sha1Hash = MKDataFromRange(data, _payload.sha1Hash);
+        _opaqueValue = MKDataFromRange(data, _payload.opaqueValue);
+        _originalApplicationVersion = MKStringFromRange(data, _payload.originalApplicationVersion, NSUTF8StringEncoding);
+        _applicationVersion = MKStringFromRange(data, _payload.applicationVersion, NSUTF8StringEncoding);
+        _receiptExpirationDate = MKDateFromRange(data, _payload.receiptExpirationDate);
+    } else {
+        MKReceiptPayloadFree(payload);
+    }
+    return self;
+}
+
+- (NSData *)payloadData
+{
+    return _payloadData;
+}
+
+- (const MKReceiptPayload *)payload
+{
+    return &_payload;
+}
+
+- (const MKReceiptEntitlementIndex *)entitlements
+{
+    return _payloadData ? &_entitlements : NULL;
+}
+
+- (void)dealloc
+{
+    MKReceiptEntitlementIndexFree(&_entitlements);
+    MKReceiptIndexFree(&_index);
+    MKReceiptPayloadFree(&_payload);
+}
+
+- (NSArray *)inAppPurchaseReceipts
+{
+    @synchronized(self) {
+        //Create the receipt objects the first time they are asked for.
+        if (!_inAppPurchaseReceipts && _payloadData) {
+            NSMutableArray *receipts = [[NSMutableArray alloc] initWithCapacity:_payload.transactionCount];
+            MKReceiptValueInterner *values = [[MKReceiptValueInterner alloc] initWithPayloadData:_payloadData transactionCount:_payload.transactionCount];
+            for (size_t i = 0; i < _payload.transactionCount; i++) {
+                [receipts addObject:[[MKInAppPurchaseReceipt alloc] initWithTransaction:&_payload.transactions[i] values:values]];
+            }
+            _inAppPurchaseReceipts = [receipts copy];
+        }
+        return _inAppPurchaseReceipts;
+    }
+}
+
+- (NSArray *)inAppPurchaseReceiptsForProductIdentifier:(NSString *)productIdentifier
+{
+    NSArray *receipts = self.inAppPurchaseReceipts;
+    
+    //Receipts created from an information dictionary have no index.
+    if (!_payloadData) {
+        NSMutableArray *matches = [NSMutableArray array];
+        for (MKInAppPurchaseReceipt *receipt in receipts) {
+            if ([receipt.productIdentifier isEqualToString:productIdentifier]) {
+                [matches addObject:receipt];
+            }
+        }
+        return [matches copy];
+    }
+    
+    const char *identifier = [productIdentifier UTF8String];
+    if (!identifier) {
+        return @[];
+    }
+    
+    NSMutableArray *matches = [NSMutableArray array];
+    uint32_t transaction = MKReceiptIndexFirstTransaction(&_index, (const uint8_t *)identifier, strlen(identifier));
+    while (transaction != MKReceiptIndexNotFound) {
+        [matches addObject:receipts[transaction]];
+        transaction = MKReceiptIndexNextTransaction(&_index, transaction);
+    }
+    return [matches copy];
+}
+
+- (NSIndexSet *)indexesOfEntitledProductIdentifiers:(NSArray *)productIdentifiers
+{
+    NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+    NSUInteger count = productIdentifiers.count;
+    double now = [[NSDate date] timeIntervalSince1970];
+    
+    //Receipts created from an information dictionary have no index. A receipt entitles over the same interval the index would give it.
+    if (!_payloadData) {
+        NSMutableSet *entitled = [NSMutableSet set];
+        for (MKInAppPurchaseReceipt *receipt in self.inAppPurchaseReceipts) {
+            if (!receipt.productIdentifier || !receipt.purchaseDate || receipt.purchaseDate.timeIntervalSince1970 > now) {
+                continue;
+            }
+            double end = receipt.subscriptionExpirationDate ? receipt.subscriptionExpirationDate.timeIntervalSince1970 : INFINITY;
+            if (receipt.cancelationDate && receipt.cancelationDate.timeIntervalSince1970 < end) {
+                end = receipt.cancelationDate.timeIntervalSince1970;
+            }
+            if (now < end) {
+                [entitled addObject:receipt.productIdentifier];
+            }
+        }
+        [productIdentifiers enumerateObjectsUsingBlock:^(NSString *identifier, NSUInteger idx, BOOL *stop) {
+            if ([entitled containsObject:identifier]) {
+                [indexes addIndex:idx];
+            }
+        }];
+        return [indexes copy];
+    }
+    
+    if (count == 0) {
+        return [indexes copy];
+    }
+    
+    const uint8_t **identifiers = malloc(count * sizeof(uint8_t *));
+    size_t *lengths = malloc(count * sizeof(size_t));
+    uint64_t *bitset = malloc(((count + 63) / 64) * sizeof(uint64_t));
+    if (!identifiers || !lengths || !bitset) {
+        free(identifiers);
+        free(lengths);
+        free(bitset);
+        return nil;
+    }
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        const char *identifier = [productIdentifiers[i] UTF8String];
+        identifiers[i] = (const uint8_t *)identifier;
+        lengths[i] = identifier ? strlen(identifier) : 0;
+    }
+    
+    MKReceiptEntitlementIndexEntitledSetAt(&_entitlements, identifiers, lengths, count, now, bitset);
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        if (bitset[i / 64] & ((uint64_t)1 << (i % 64))) {
+            [indexes addIndex:i];
+        }
+    }
+    
+    free(identifiers);
+    free(lengths);
+    free(bitset);
+    return [indexes copy];
+}
+
+/**Builds the merged entitlement intervals of a product from in app purchase receipts, for receipts created from an information dictionary.
+ @return The intervals, must be freed with free. NULL if there are none.
+ */
+static MKReceiptEntitlementInterval *MKEntitlementIntervalsFromReceipts(NSArray *receipts, NSString *productIdentifier, size_t *count)
+{
+    *count = 0;
+    MKReceiptEntitlementInterval *intervals = malloc((receipts.count ? receipts.count : 1) * sizeof(MKReceiptEntitlementInterval));
+    if (!intervals) {
+        return NULL;
+    }
+    
+    size_t used = 0;
+    for (MKInAppPurchaseReceipt *receipt in receipts) {
+        if (![receipt.productIdentifier isEqualToString:productIdentifier] || !receipt.purchaseDate) {
+            continue;
+        }
+        double start = receipt.purchaseDate.timeIntervalSince1970;
+        double end = receipt.subscriptionExpirationDate ? receipt.subscriptionExpirationDate.timeIntervalSince1970 : INFINITY;
+        if (receipt.cancelationDate && receipt.cancelationDate.timeIntervalSince1970 < end) {
+            end = receipt.cancelationDate.timeIntervalSince1970;
+        }
+        if (end > start) {
+            intervals[used++] = (MKReceiptEntitlementInterval){start, end, 0};
+        }
+    }
+    
+    *count = MKReceiptEntitlementIntervalsMerge(intervals, used);
+    return intervals;
+}
+
+- (BOOL)isProductIdentifier:(NSString *)productIdentifier entitledAtDate:(NSDate *)date
+{
+    double time = date.timeIntervalSince1970;
+    
+    //Receipts created from an information dictionary have no index.
+    if (!_payloadData) {
+        size_t count;
+        MKReceiptEntitlementInterval *intervals = MKEntitlementIntervalsFromReceipts(self.inAppPurchaseReceipts, productIdentifier, &count);
+        BOOL entitled = intervals && MKReceiptEntitlementIntervalsEntitledAt(intervals, count, time, NULL);
+        free(intervals);
+        return entitled;
+    }
+    
+    const char *identifier = [productIdentifier UTF8String];
+    if (!identifier) {
+        return NO;
+    }
+    return MKReceiptEntitlementIndexEntitledAt(&_entitlements, (const uint8_t *)identifier, strlen(identifier), time, NULL) != 0;
+}
+
+- (NSTimeInterval)entitledDurationOfProductIdentifier:(NSString *)productIdentifier fromDate:(NSDate *)startDate toDate:(NSDate *)endDate
+{
+    double start = startDate.timeIntervalSince1970;
+    double end = endDate.timeIntervalSince1970;
+    
+    //Receipts created from an information dictionary have no index.
+    if (!_payloadData) {
+        size_t count;
+        MKReceiptEntitlementInterval *intervals = MKEntitlementIntervalsFromReceipts(self.inAppPurchaseReceipts, productIdentifier, &count);
+        NSTimeInterval duration = intervals ? MKReceiptEntitlementIntervalsEntitledDuration(intervals, count, start, end) : 0;
+        free(intervals);
+        return duration;
+    }
+    
+    const char *identifier = [productIdentifier UTF8String];
+    if (!identifier) {
+        return 0;
+    }
+    return MKReceiptEntitlementIndexEntitledDuration(&_entitlements, (const uint8_t *)identifier, strlen(identifier), start, end);
+}
+
+- (void)computeChangesFromReceipt:(MKApplicationReceipt *)receipt
+{
+    //Receipts created from an information dictionary have no transaction table to compare.
+    if (!_payloadData || !receipt.payloadData) {
+        return;
+    }
+    
+    const MKReceiptPayload *previous = receipt.payload;
+    uint8_t *changes = malloc(_payload.transactionCount ? _payload.transactionCount : 1);
+    uint8_t *removed = malloc(previous->transactionCount ? previous->transactionCount : 1);
+    if (!changes || !removed || !MKReceiptDeltaCompute(receipt.payloadData.bytes, previous, _payloadData.bytes, &_payload, changes, removed)) {
+        free(changes);
+        free(removed);
+        return;
+    }
+    
+    NSMutableSet *added = [NSMutableSet set];
+    NSMutableSet *changed = [NSMutableSet set];
+    NSMutableSet *cancelled = [NSMutableSet set];
+    for (size_t i = 0; i < _payload.transactionCount; i++) {
+        NSMutableSet *set = nil;
+        switch (changes[i]) {
+            case MKReceiptChangeAdded:
+                set = added;
+                break;
+            case MKReceiptChangeModified:
+                set = changed;
+                break;
+            case MKReceiptChangeCancelled:
+                set = cancelled;
+                break;
+            default:
+                continue;
+        }
+        NSString *identifier = MKStringFromRange(_payloadData, _payload.transactions[i].productIdentifier, NSUTF8StringEncoding);
+        if (identifier) {
+            [set addObject:identifier];
+        }
+    }
+    for (size_t i = 0; i < previous->transactionCount; i++) {
+        NSString *identifier = removed[i] ? MKStringFromRange(receipt.payloadData, previous->transactions[i].productIdentifier, NSUTF8StringEncoding) : nil;
+        if (identifier) {
+            [changed addObject:identifier];
+        }
+    }
+    free(changes);
+    free(removed);
+    
+    _addedProductIdentifiers = [added copy];
+    _changedProductIdentifiers = [changed copy];
+    _cancelledProductIdentifiers = [cancelled copy];
+}
+
+- (MKApplicationReceipt *)unchangedReceipt
+{
+    //Receipts created from an information dictionary never report changes.
+    MKApplicationReceipt *receipt = _payloadData ? [[MKApplicationReceipt alloc] initWithPayloadData:_payloadData] : nil;
+    if (!receipt) {
+        return self;
+    }
+    receipt->_addedProductIdentifiers = [NSSet set];
+    receipt->_changedProductIdentifiers = [NSSet set];
+    receipt->_cancelledProductIdentifiers = [NSSet set];
+    return receipt;
+}
+
+- (NSSet *)updatedProductIdentifiers
+{
+    if (!_addedProductIdentifiers) {
+        return nil;
+    }
+    NSMutableSet *identifiers = [_addedProductIdentifiers mutableCopy];
+    [identifiers unionSet:_changedProductIdentifiers];
+    [identifiers unionSet:_cancelledProductIdentifiers];
+    return [identifiers copy];
+}
+
 @end
 
 @implementation MKInAppPurchaseReceipt
@@ -727,4 +1344,22 @@ NSString *kIAPReceiptWebOrderLineItemID             = @"WebItemId";
     return self;
 }
 
+- (instancetype)initWithTransaction:(const MKReceiptTransaction *)transaction values:(MKReceiptValueInterner *)values
+{
+    self = [super init];
+    if (self) {
+        _quantity = (NSUInteger)transaction->quantity;
+        _productIdentifier = [values stringFromRange:transaction->productIdentifier];
+        //Transaction identifiers are unique, looking them up would only cost.
+        _transactionIdentifier = MKStringFromRange(values.payloadData, transaction->transactionIdentifier, NSUTF8StringEncoding);
+        _originalTransactionIdentifier = [values stringFromRange:transaction->originalTransactionIdentifier];
+        _purchaseDate = [values dateFromRange:transaction->purchaseDate];
+        _originalPurchaseDate = [values dateFromRange:transaction->originalPurchaseDate];
+        _subscriptionExpirationDate = [values dateFromRange:transaction->subscriptionExpirationDate];
+        _cancelationDate = [values dateFromRange:transaction->cancellationDate];
+        _webOrderLineItemIdentifier = (NSUInteger)transaction->webOrderLineItemIdentifier;
+    }
+    return self;
+}
+
 @end
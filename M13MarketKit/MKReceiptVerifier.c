@@ -0,0 +1,447 @@
+//
+//  MKReceiptVerifier.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKReceiptVerifier.h"
+#include "MKReceiptDate.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <openssl/x509.h>
+#include <openssl/x509_vfy.h>
+
+/**The most embedded certificates a verifier keeps parsed. Receipts are signed by a handful of Apple certificates.*/
+#define MKReceiptVerifierCachedCertificates 16
+
+/**An embedded certificate kept parsed between verifications, with its public key and the key's Montgomery context.*/
+typedef struct {
+    /**The SHA-256 of the DER encoded certificate.*/
+    uint8_t fingerprint[SHA256_DIGEST_LENGTH];
+    /**The parsed certificate, or NULL if the slot is empty.*/
+    X509 *certificate;
+} MKReceiptCachedCertificate;
+
+/**The most verified chains a verifier remembers.*/
+#define MKReceiptVerifierVerifiedChains 16
+
+/**A certificate chain that verified up to the root certificate.*/
+typedef struct {
+    /**The SHA-256 over the fingerprints of the embedded certificates, in order, and the signer's position among them.*/
+    uint8_t key[SHA256_DIGEST_LENGTH];
+    /**The latest notBefore in the chain, in seconds since the epoch.*/
+    double validFrom;
+    /**The earliest notAfter in the chain, in seconds since the epoch.*/
+    double validUntil;
+    /**The chain X509_verify_cert built, from the signer to the root, or NULL if the slot is empty.*/
+    STACK_OF(X509) *chain;
+} MKReceiptVerifiedChain;
+
+struct MKReceiptVerifier {
+    /**The parsed Apple Inc. root certificate.*/
+    X509 *rootCertificate;
+    /**The trust store containing the root certificate.*/
+    X509_STORE *store;
+    /**Guards the certificate cache and the verified chains, the rest of the verifier never changes.*/
+    pthread_mutex_t cacheLock;
+    /**The embedded certificates seen so far.*/
+    MKReceiptCachedCertificate cachedCertificates[MKReceiptVerifierCachedCertificates];
+    /**The slot the next new certificate replaces once the cache is full.*/
+    size_t nextCachedCertificate;
+    /**The chains verified so far.*/
+    MKReceiptVerifiedChain verifiedChains[MKReceiptVerifierVerifiedChains];
+    /**The slot the next verified chain replaces once all are in use.*/
+    size_t nextVerifiedChain;
+};
+
+/**Takes a reference to a certificate (X509_up_ref is 1.1.0 and later).*/
+static X509 *MKCertificateRetain(X509 *certificate)
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    CRYPTO_add(&certificate->references, 1, CRYPTO_LOCK_X509);
+#else
+    X509_up_ref(certificate);
+#endif
+    return certificate;
+}
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+/**The locks OpenSSL needs to be used from more than one thread (1.0.x only, later versions lock internally).*/
+static pthread_mutex_t *MKOpenSSLLocks = NULL;
+
+static void MKOpenSSLLockingCallback(int mode, int type, const char *file, int line)
+{
+    if (mode & CRYPTO_LOCK) {
+        pthread_mutex_lock(&MKOpenSSLLocks[type]);
+    } else {
+        pthread_mutex_unlock(&MKOpenSSLLocks[type]);
+    }
+}
+#endif
+
+static pthread_once_t MKOpenSSLOnce = PTHREAD_ONCE_INIT;
+
+/**Loads the error strings and digests once per process. They are never cleaned up, as other validations may be running.*/
+static void MKOpenSSLInitialize(void)
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    ERR_load_PKCS7_strings();
+    ERR_load_X509_strings();
+    OpenSSL_add_all_digests();
+
+    //Only install locking if the host application has not already done so.
+    if (CRYPTO_get_locking_callback() == NULL) {
+        int count = CRYPTO_num_locks();
+        MKOpenSSLLocks = malloc((size_t)count * sizeof(pthread_mutex_t));
+        if (MKOpenSSLLocks) {
+            for (int i = 0; i < count; i++) {
+                pthread_mutex_init(&MKOpenSSLLocks[i], NULL);
+            }
+            CRYPTO_set_locking_callback(MKOpenSSLLockingCallback);
+        }
+    }
+#else
+    OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CRYPTO_STRINGS | OPENSSL_INIT_ADD_ALL_DIGESTS, NULL);
+#endif
+}
+
+MKReceiptVerifier *MKReceiptVerifierCreate(const uint8_t *rootCertificate, size_t length)
+{
+    pthread_once(&MKOpenSSLOnce, MKOpenSSLInitialize);
+
+    if (!rootCertificate || length == 0) {
+        return NULL;
+    }
+
+    MKReceiptVerifier *verifier = calloc(1, sizeof(MKReceiptVerifier));
+    if (!verifier) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&verifier->cacheLock, NULL) != 0) {
+        free(verifier);
+        return NULL;
+    }
+
+    const uint8_t *p = rootCertificate;
+    verifier->rootCertificate = d2i_X509(NULL, &p, (long)length);
+    verifier->store = X509_STORE_new();
+    if (!verifier->rootCertificate || !verifier->store || !X509_STORE_add_cert(verifier->store, verifier->rootCertificate)) {
+        MKReceiptVerifierFree(verifier);
+        return NULL;
+    }
+
+    return verifier;
+}
+
+void MKReceiptVerifierFree(MKReceiptVerifier *verifier)
+{
+    if (!verifier) {
+        return;
+    }
+    for (size_t i = 0; i < MKReceiptVerifierCachedCertificates; i++) {
+        X509_free(verifier->cachedCertificates[i].certificate);
+    }
+    for (size_t i = 0; i < MKReceiptVerifierVerifiedChains; i++) {
+        sk_X509_pop_free(verifier->verifiedChains[i].chain, X509_free);
+    }
+    pthread_mutex_destroy(&verifier->cacheLock);
+    X509_STORE_free(verifier->store);
+    X509_free(verifier->rootCertificate);
+    free(verifier);
+}
+
+int MKReceiptVerifierVerify(const MKReceiptVerifier *verifier, PKCS7 *p7)
+{
+    if (!verifier || !p7 || !PKCS7_type_is_signed(p7)) {
+        return 0;
+    }
+
+    //No output BIO: the content is digested as it is read from the octet string, and never written out again.
+    int result = PKCS7_verify(p7, NULL, verifier->store, NULL, NULL, 0);
+
+    //Leave nothing behind on this thread's error queue.
+    ERR_clear_error();
+    return result == 1;
+}
+
+/**The digests a receipt may be signed with, by the contents of their object identifier.*/
+typedef struct {
+    uint8_t identifier[9];
+    size_t length;
+    const EVP_MD *(*digest)(void);
+} MKReceiptDigestAlgorithm;
+
+static const MKReceiptDigestAlgorithm MKReceiptDigestAlgorithms[] = {
+    {{0x2B, 0x0E, 0x03, 0x02, 0x1A}, 5, EVP_sha1},
+    {{0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01}, 9, EVP_sha256},
+    {{0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x02}, 9, EVP_sha384},
+    {{0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x03}, 9, EVP_sha512},
+    {{0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x04}, 9, EVP_sha224},
+};
+
+static const EVP_MD *MKReceiptDigestForAlgorithm(const uint8_t *identifier, size_t length)
+{
+    for (size_t i = 0; i < sizeof(MKReceiptDigestAlgorithms) / sizeof(MKReceiptDigestAlgorithms[0]); i++) {
+        if (MKReceiptDigestAlgorithms[i].length == length && memcmp(MKReceiptDigestAlgorithms[i].identifier, identifier, length) == 0) {
+            return MKReceiptDigestAlgorithms[i].digest();
+        }
+    }
+    return NULL;
+}
+
+/**Returns a reference to the parsed certificate, decoding and caching it the first time it is seen. The caller frees the reference.
+ @note The cache is the only part of a verifier that changes after creation, hence the cast.
+ */
+static X509 *MKReceiptVerifierCertificate(const MKReceiptVerifier *sharedVerifier, const uint8_t *bytes, size_t length, uint8_t *fingerprint)
+{
+    MKReceiptVerifier *verifier = (MKReceiptVerifier *)sharedVerifier;
+    SHA256(bytes, length, fingerprint);
+
+    X509 *certificate = NULL;
+    pthread_mutex_lock(&verifier->cacheLock);
+    for (size_t i = 0; i < MKReceiptVerifierCachedCertificates && !certificate; i++) {
+        if (verifier->cachedCertificates[i].certificate && memcmp(verifier->cachedCertificates[i].fingerprint, fingerprint, SHA256_DIGEST_LENGTH) == 0) {
+            certificate = MKCertificateRetain(verifier->cachedCertificates[i].certificate);
+        }
+    }
+    pthread_mutex_unlock(&verifier->cacheLock);
+    if (certificate) {
+        return certificate;
+    }
+
+    const uint8_t *p = bytes;
+    certificate = d2i_X509(NULL, &p, (long)length);
+    if (!certificate) {
+        return NULL;
+    }
+    //Decode the public key now, it and the Montgomery context RSA builds on first use stay with the cached certificate.
+    EVP_PKEY_free(X509_get_pubkey(certificate));
+
+    pthread_mutex_lock(&verifier->cacheLock);
+    //Another thread may have added it in the meantime.
+    int cached = 0;
+    for (size_t i = 0; i < MKReceiptVerifierCachedCertificates && !cached; i++) {
+        cached = verifier->cachedCertificates[i].certificate && memcmp(verifier->cachedCertificates[i].fingerprint, fingerprint, SHA256_DIGEST_LENGTH) == 0;
+    }
+    if (!cached) {
+        MKReceiptCachedCertificate *slot = &verifier->cachedCertificates[verifier->nextCachedCertificate];
+        verifier->nextCachedCertificate = (verifier->nextCachedCertificate + 1) % MKReceiptVerifierCachedCertificates;
+        X509_free(slot->certificate);
+        memcpy(slot->fingerprint, fingerprint, SHA256_DIGEST_LENGTH);
+        slot->certificate = MKCertificateRetain(certificate);
+    }
+    pthread_mutex_unlock(&verifier->cacheLock);
+    return certificate;
+}
+
+/**Converts a certificate UTCTime ("YYMMDDHHMMSSZ") or GeneralizedTime ("YYYYMMDDHHMMSSZ"), the only forms RFC 5280 allows, to seconds since the epoch.*/
+static int MKCertificateTimeParse(const ASN1_TIME *time, double *seconds)
+{
+    const uint8_t *digits = time->data;
+    char century[2];
+    if (time->type == V_ASN1_UTCTIME && time->length == 13) {
+        //Two digit years from 50 on are in the 20th century.
+        century[0] = digits[0] >= '5' ? '1' : '2';
+        century[1] = digits[0] >= '5' ? '9' : '0';
+    } else if (time->type == V_ASN1_GENERALIZEDTIME && time->length == 15) {
+        century[0] = (char)digits[0];
+        century[1] = (char)digits[1];
+        digits += 2;
+    } else {
+        return 0;
+    }
+    if (digits[12] != 'Z') {
+        return 0;
+    }
+    const char date[20] = {century[0], century[1], digits[0], digits[1], '-', digits[2], digits[3], '-', digits[4], digits[5], 'T', digits[6], digits[7], ':', digits[8], digits[9], ':', digits[10], digits[11], 'Z'};
+    return MKReceiptDateParse((const uint8_t *)date, sizeof(date), seconds);
+}
+
+/**Returns 1 if a chain with the given key verified before and all of its certificates are still within their validity period.*/
+static int MKReceiptVerifierChainWasVerified(const MKReceiptVerifier *sharedVerifier, const uint8_t *key)
+{
+    MKReceiptVerifier *verifier = (MKReceiptVerifier *)sharedVerifier;
+    double now = (double)time(NULL);
+    int verified = 0;
+    pthread_mutex_lock(&verifier->cacheLock);
+    for (size_t i = 0; i < MKReceiptVerifierVerifiedChains; i++) {
+        MKReceiptVerifiedChain *entry = &verifier->verifiedChains[i];
+        if (entry->chain && memcmp(entry->key, key, SHA256_DIGEST_LENGTH) == 0) {
+            verified = now >= entry->validFrom && now < entry->validUntil;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&verifier->cacheLock);
+    return verified;
+}
+
+/**Remembers a chain X509_verify_cert accepted, for as long as all of its certificates are valid. Takes ownership of the chain.*/
+static void MKReceiptVerifierAddVerifiedChain(const MKReceiptVerifier *sharedVerifier, const uint8_t *key, STACK_OF(X509) *chain)
+{
+    MKReceiptVerifier *verifier = (MKReceiptVerifier *)sharedVerifier;
+    double validFrom = 0.0;
+    double validUntil = 0.0;
+    for (int i = 0; i < sk_X509_num(chain); i++) {
+        X509 *certificate = sk_X509_value(chain, i);
+        double notBefore, notAfter;
+        if (!MKCertificateTimeParse(X509_get_notBefore(certificate), &notBefore) || !MKCertificateTimeParse(X509_get_notAfter(certificate), &notAfter)) {
+            //A validity period that cannot be read is left to X509_verify_cert every time.
+            sk_X509_pop_free(chain, X509_free);
+            return;
+        }
+        if (i == 0 || notBefore > validFrom) {
+            validFrom = notBefore;
+        }
+        if (i == 0 || notAfter < validUntil) {
+            validUntil = notAfter;
+        }
+    }
+
+    pthread_mutex_lock(&verifier->cacheLock);
+    //Replace an expired entry for the same key, otherwise the oldest one.
+    MKReceiptVerifiedChain *slot = NULL;
+    for (size_t i = 0; i < MKReceiptVerifierVerifiedChains && !slot; i++) {
+        if (verifier->verifiedChains[i].chain && memcmp(verifier->verifiedChains[i].key, key, SHA256_DIGEST_LENGTH) == 0) {
+            slot = &verifier->verifiedChains[i];
+        }
+    }
+    if (!slot) {
+        slot = &verifier->verifiedChains[verifier->nextVerifiedChain];
+        verifier->nextVerifiedChain = (verifier->nextVerifiedChain + 1) % MKReceiptVerifierVerifiedChains;
+    }
+    sk_X509_pop_free(slot->chain, X509_free);
+    memcpy(slot->key, key, SHA256_DIGEST_LENGTH);
+    slot->validFrom = validFrom;
+    slot->validUntil = validUntil;
+    slot->chain = chain;
+    pthread_mutex_unlock(&verifier->cacheLock);
+}
+
+/**Verifies with the full PKCS7 structure, then checks OpenSSL verified the content the container points at.*/
+static int MKReceiptVerifierVerifyDecoded(const MKReceiptVerifier *verifier, const uint8_t *bytes, size_t length, const MKReceiptContainer *container)
+{
+    const uint8_t *p = bytes;
+    PKCS7 *p7 = d2i_PKCS7(NULL, &p, (long)length);
+    int result = p7 && PKCS7_type_is_signed(p7) && PKCS7_type_is_data(p7->d.sign->contents) && p7->d.sign->contents->d.data && MKReceiptVerifierVerify(verifier, p7);
+    if (result) {
+        ASN1_OCTET_STRING *octets = p7->d.sign->contents->d.data;
+        result = container->content.length == (uint32_t)octets->length && memcmp(MKReceiptRangeBytes(bytes, container->content), octets->data, container->content.length) == 0;
+    }
+    PKCS7_free(p7);
+    ERR_clear_error();
+    return result;
+}
+
+/**Runs the smime_sign chain check PKCS7_verify runs, and remembers the chain under the given key if it passes.*/
+static int MKReceiptVerifierVerifyChain(const MKReceiptVerifier *verifier, const uint8_t *key, X509 *signer, STACK_OF(X509) *certificates)
+{
+    X509_STORE_CTX *storeContext = X509_STORE_CTX_new();
+    if (!storeContext || !X509_STORE_CTX_init(storeContext, verifier->store, signer, certificates)) {
+        X509_STORE_CTX_free(storeContext);
+        return 0;
+    }
+    X509_STORE_CTX_set_default(storeContext, "smime_sign");
+    int chained = X509_verify_cert(storeContext) == 1;
+    STACK_OF(X509) *chain = chained ? X509_STORE_CTX_get1_chain(storeContext) : NULL;
+    X509_STORE_CTX_cleanup(storeContext);
+    X509_STORE_CTX_free(storeContext);
+    if (chain) {
+        MKReceiptVerifierAddVerifiedChain(verifier, key, chain);
+    }
+    return chained;
+}
+
+/**Makes the checks PKCS7_verify makes for a signer without authenticated attributes: the chain, unless it verified before and is still valid, then the signature over the content digest.*/
+static int MKReceiptVerifierVerifySigner(const MKReceiptVerifier *verifier, const uint8_t *bytes, const MKReceiptContainer *container, const EVP_MD *digest, const uint8_t *chainKey, X509 *signer, STACK_OF(X509) *certificates)
+{
+    if (!MKReceiptVerifierChainWasVerified(verifier, chainKey) && !MKReceiptVerifierVerifyChain(verifier, chainKey, signer, certificates)) {
+        return 0;
+    }
+
+    EVP_PKEY *key = X509_get_pubkey(signer);
+    EVP_MD_CTX *digestContext = EVP_MD_CTX_create();
+    int result = 0;
+    if (key && digestContext && EVP_VerifyInit_ex(digestContext, digest, NULL) && EVP_VerifyUpdate(digestContext, MKReceiptRangeBytes(bytes, container->content), container->content.length)) {
+        result = EVP_VerifyFinal(digestContext, MKReceiptRangeBytes(bytes, container->encryptedDigest), container->encryptedDigest.length, key) == 1;
+    }
+    EVP_MD_CTX_destroy(digestContext);
+    EVP_PKEY_free(key);
+    return result;
+}
+
+int MKReceiptVerifierVerifyContainer(const MKReceiptVerifier *verifier, const uint8_t *bytes, size_t length, const MKReceiptContainer *container)
+{
+    if (!verifier || !bytes || !container) {
+        return 0;
+    }
+
+    const EVP_MD *digest = MKReceiptDigestForAlgorithm(MKReceiptRangeBytes(bytes, container->digestAlgorithm), container->digestAlgorithm.length);
+    if (container->signedAttributes.length || !digest || !container->signerCertificate.length) {
+        return MKReceiptVerifierVerifyDecoded(verifier, bytes, length, container);
+    }
+
+    //Only the embedded certificates are decoded, once per verifier, and the chain is built from them.
+    //The chain is identified by the certificate fingerprints in order and by which of them signed.
+    int result = 0;
+    X509 *signer = NULL;
+    uint8_t fingerprints[MKReceiptContainerMaximumCertificates][SHA256_DIGEST_LENGTH + 1];
+    uint8_t chainKey[SHA256_DIGEST_LENGTH];
+    STACK_OF(X509) *certificates = sk_X509_new_null();
+    if (certificates) {
+        result = 1;
+        for (size_t i = 0; i < container->certificateCount && result; i++) {
+            X509 *certificate = MKReceiptVerifierCertificate(verifier, MKReceiptRangeBytes(bytes, container->certificates[i]), container->certificates[i].length, fingerprints[i]);
+            if (!certificate || !sk_X509_push(certificates, certificate)) {
+                X509_free(certificate);
+                result = 0;
+                continue;
+            }
+            fingerprints[i][SHA256_DIGEST_LENGTH] = container->certificates[i].offset == container->signerCertificate.offset;
+            if (fingerprints[i][SHA256_DIGEST_LENGTH]) {
+                signer = certificate;
+            }
+        }
+        result = result && signer && SHA256(fingerprints[0], container->certificateCount * sizeof(fingerprints[0]), chainKey) && MKReceiptVerifierVerifySigner(verifier, bytes, container, digest, chainKey, signer, certificates);
+        sk_X509_pop_free(certificates, X509_free);
+    }
+
+    ERR_clear_error();
+    return result;
+}
+
+int MKReceiptVerifierCheckDeviceHash(const uint8_t *deviceIdentifier, const uint8_t *opaqueValue, size_t opaqueValueLength, const uint8_t *bundleIdentifierData, size_t bundleIdentifierDataLength, const uint8_t *hash, size_t hashLength)
+{
+    if (!deviceIdentifier || !hash || hashLength != SHA_DIGEST_LENGTH) {
+        return 0;
+    }
+
+    uint8_t digest[SHA_DIGEST_LENGTH];
+    unsigned int digestLength = 0;
+    EVP_MD_CTX *digestContext = EVP_MD_CTX_create();
+    int result = digestContext && EVP_DigestInit_ex(digestContext, EVP_sha1(), NULL)
+        && EVP_DigestUpdate(digestContext, deviceIdentifier, MKReceiptDeviceIdentifierLength)
+        && EVP_DigestUpdate(digestContext, opaqueValue, opaqueValueLength)
+        && EVP_DigestUpdate(digestContext, bundleIdentifierData, bundleIdentifierDataLength)
+        && EVP_DigestFinal_ex(digestContext, digest, &digestLength)
+        && digestLength == SHA_DIGEST_LENGTH
+        && CRYPTO_memcmp(digest, hash, SHA_DIGEST_LENGTH) == 0;
+    EVP_MD_CTX_destroy(digestContext);
+    return result;
+}
@@ -0,0 +1,81 @@
+//
+//  MKReceiptVerifier.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKReceiptVerifier_h
+#define M13MarketKit_MKReceiptVerifier_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <openssl/pkcs7.h>
+
+#include "MKReceiptContainer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**A long lived receipt verification context. Holds the parsed Apple root certificate, the trust store built from it, and the embedded certificates seen so far with their public keys.
+ @note A verifier can be shared by any number of threads. Only its certificate cache changes after creation, under a lock.
+ */
+typedef struct MKReceiptVerifier MKReceiptVerifier;
+
+/**Creates a verifier that trusts the given root certificate.
+ @param rootCertificate The DER encoded Apple Inc. root certificate.
+ @param length The length of the certificate.
+ @return A new verifier, or NULL if the certificate could not be parsed.
+ */
+MKReceiptVerifier *MKReceiptVerifierCreate(const uint8_t *rootCertificate, size_t length);
+
+/**Frees the verifier. No verification may be in progress.*/
+void MKReceiptVerifierFree(MKReceiptVerifier *verifier);
+
+/**Verifies the signature and certificate chain of a receipt container. The signed content is hashed where it is, no copy of it is made.
+ @param verifier The verifier.
+ @param p7 The receipt container. Must be signed data.
+ @return 1 if the receipt is signed by a certificate that chains to the root certificate, 0 otherwise.
+ */
+int MKReceiptVerifierVerify(const MKReceiptVerifier *verifier, PKCS7 *p7);
+
+/**Verifies the signature and certificate chain of a parsed receipt container. Only the embedded certificates are decoded, the first time the verifier sees them, and the signed content is hashed in place.
+ @note Containers the in place check does not cover, such as ones with authenticated attributes, are verified with MKReceiptVerifierVerify. The content OpenSSL verified must then match container->content.
+ @param verifier The verifier.
+ @param bytes The receipt container.
+ @param length The length of the container.
+ @param container The container, parsed with MKReceiptContainerParse.
+ @return 1 if the content is signed by a certificate that chains to the root certificate, 0 otherwise.
+ */
+int MKReceiptVerifierVerifyContainer(const MKReceiptVerifier *verifier, const uint8_t *bytes, size_t length, const MKReceiptContainer *container);
+
+/**The length of the device identifier a receipt's hash is computed with, the bytes of identifierForVendor.*/
+#define MKReceiptDeviceIdentifierLength 16
+
+/**Checks a receipt's SHA-1 hash against the device it is used on. The hash covers the device identifier, the opaque value and the bundle identifier data, which are hashed in turn without being joined.
+ @param deviceIdentifier The MKReceiptDeviceIdentifierLength bytes of the device identifier.
+ @param opaqueValue The receipt's opaque value.
+ @param opaqueValueLength The length of the opaque value.
+ @param bundleIdentifierData The receipt's bundle identifier data.
+ @param bundleIdentifierDataLength The length of the bundle identifier data.
+ @param hash The receipt's SHA-1 hash.
+ @param hashLength The length of the hash.
+ @return 1 if the hash matches, 0 otherwise.
+ */
+int MKReceiptVerifierCheckDeviceHash(const uint8_t *deviceIdentifier, const uint8_t *opaqueValue, size_t opaqueValueLength, const uint8_t *bundleIdentifierData, size_t bundleIdentifierDataLength, const uint8_t *hash, size_t hashLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
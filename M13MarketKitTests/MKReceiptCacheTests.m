@@ -0,0 +1,122 @@
+//
+//  MKReceiptCacheTests.m
+//  M13MarketKitTests
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <XCTest/XCTest.h>
+#import "MKReceiptCache.h"
+#import "MKReceiptTestData.h"
+
+@interface MKReceiptCacheTests : XCTestCase
+
+@end
+
+@implementation MKReceiptCacheTests
+{
+    NSURL *_directory;
+    NSData *_content;
+    MKReceiptPayload _payload;
+    uint8_t _key[MKReceiptCacheKeyLength];
+    uint8_t _secret[MKReceiptCacheSecretLength];
+}
+
+- (void)setUp {
+    [super setUp];
+    _directory = MKTestTemporaryDirectory();
+    _content = MKTestReceiptPayload(@"com.example.app", @[@"com.example.pro", @"com.example.coins"]);
+    XCTAssertEqual(MKReceiptPayloadDecode(_content.bytes, _content.length, &_payload), MKReceiptDecodeStatusSuccess);
+
+    uint8_t deviceIdentifierHash[20] = {0};
+    MKReceiptCacheComputeKey(_content.bytes, _content.length, "1.0", deviceIdentifierHash, sizeof(deviceIdentifierHash), _key);
+    memset(_secret, 0x5A, sizeof(_secret));
+}
+
+- (void)tearDown {
+    MKReceiptPayloadFree(&_payload);
+    [[NSFileManager defaultManager] removeItemAtURL:_directory error:nil];
+    [super tearDown];
+}
+
+- (NSString *)cacheFile {
+    return [_directory URLByAppendingPathComponent:@"Receipt.cache"].path;
+}
+
+- (const char *)cachePath {
+    return [[self cacheFile] fileSystemRepresentation];
+}
+
+- (void)testCacheHit {
+    XCTAssertTrue(MKReceiptCacheWrite([self cachePath], _key, _secret, _content.bytes, _content.length, &_payload));
+
+    MKReceiptCacheEntry entry;
+    XCTAssertTrue(MKReceiptCacheRead([self cachePath], _key, _secret, &entry));
+    XCTAssertEqual(entry.contentLength, _content.length);
+    XCTAssertEqual(memcmp(entry.content, _content.bytes, _content.length), 0);
+    XCTAssertEqual(entry.payload.transactionCount, (size_t)2);
+    XCTAssertEqual(memcmp(MKReceiptRangeBytes(entry.content, entry.payload.transactions[1].productIdentifier), "com.example.coins", 17), 0);
+    MKReceiptCacheEntryFree(&entry);
+}
+
+- (void)testCacheMissForOtherKey {
+    XCTAssertTrue(MKReceiptCacheWrite([self cachePath], _key, _secret, _content.bytes, _content.length, &_payload));
+
+    //A different application version is a different receipt.
+    uint8_t otherKey[MKReceiptCacheKeyLength];
+    uint8_t deviceIdentifierHash[20] = {0};
+    MKReceiptCacheComputeKey(_content.bytes, _content.length, "1.1", deviceIdentifierHash, sizeof(deviceIdentifierHash), otherKey);
+    XCTAssertNotEqual(memcmp(otherKey, _key, sizeof(otherKey)), 0);
+
+    MKReceiptCacheEntry entry;
+    XCTAssertFalse(MKReceiptCacheRead([self cachePath], otherKey, _secret, &entry));
+}
+
+- (void)testRejectsForgedCacheFile {
+    //A well formed cache file, written for the right key by someone who does not have the secret.
+    NSData *forgedContent = MKTestReceiptPayload(@"com.example.app", @[@"com.example.pro", @"com.example.coins", @"com.example.unpaid"]);
+    MKReceiptPayload forgedPayload;
+    XCTAssertEqual(MKReceiptPayloadDecode(forgedContent.bytes, forgedContent.length, &forgedPayload), MKReceiptDecodeStatusSuccess);
+    uint8_t forgedSecret[MKReceiptCacheSecretLength];
+    memset(forgedSecret, 0xA5, sizeof(forgedSecret));
+    XCTAssertTrue(MKReceiptCacheWrite([self cachePath], _key, forgedSecret, forgedContent.bytes, forgedContent.length, &forgedPayload));
+    MKReceiptPayloadFree(&forgedPayload);
+
+    MKReceiptCacheEntry entry;
+    XCTAssertFalse(MKReceiptCacheRead([self cachePath], _key, _secret, &entry));
+}
+
+- (void)testRejectsTamperedCacheFile {
+    XCTAssertTrue(MKReceiptCacheWrite([self cachePath], _key, _secret, _content.bytes, _content.length, &_payload));
+    NSString *path = [self cacheFile];
+    NSData *file = [NSData dataWithContentsOfFile:path];
+
+    //Flip one bit anywhere in the file, or cut it short.
+    for (NSUInteger offset = 0; offset < file.length; offset++) {
+        NSMutableData *tampered = [file mutableCopy];
+        ((uint8_t *)tampered.mutableBytes)[offset] ^= 0x01;
+        XCTAssertTrue([tampered writeToFile:path atomically:YES]);
+
+        MKReceiptCacheEntry entry;
+        XCTAssertFalse(MKReceiptCacheRead([self cachePath], _key, _secret, &entry), @"Accepted a change at offset %lu", (unsigned long)offset);
+    }
+
+    XCTAssertTrue([[file subdataWithRange:NSMakeRange(0, file.length - 1)] writeToFile:path atomically:YES]);
+    MKReceiptCacheEntry entry;
+    XCTAssertFalse(MKReceiptCacheRead([self cachePath], _key, _secret, &entry));
+}
+
+- (void)testMissingCacheFile {
+    MKReceiptCacheEntry entry;
+    XCTAssertFalse(MKReceiptCacheRead([self cachePath], _key, _secret, &entry));
+}
+
+@end
@@ -0,0 +1,130 @@
+//
+//  MKReceiptDecoderTests.m
+//  M13MarketKitTests
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <XCTest/XCTest.h>
+#import "MKReceiptDecoder.h"
+#import "MKReceiptTestData.h"
+
+@interface MKReceiptDecoderTests : XCTestCase
+
+@end
+
+@implementation MKReceiptDecoderTests
+
+- (void)testDecodesReceipt {
+    NSData *data = MKTestReceiptPayload(@"com.example.app", @[@"com.example.pro", @"com.example.coins"]);
+    MKReceiptPayload payload;
+    XCTAssertEqual(MKReceiptPayloadDecode(data.bytes, data.length, &payload), MKReceiptDecodeStatusSuccess);
+
+    XCTAssertEqual(payload.bundleIdentifier.length, (uint32_t)15);
+    XCTAssertEqual(memcmp(MKReceiptRangeBytes(data.bytes, payload.bundleIdentifier), "com.example.app", 15), 0);
+    //The raw value wraps the string in its DER header.
+    XCTAssertEqual(payload.bundleIdentifierData.length, (uint32_t)17);
+    XCTAssertEqual(payload.transactionCount, (size_t)2);
+    XCTAssertEqual(payload.transactions[1].productIdentifier.length, (uint32_t)17);
+    XCTAssertEqual(memcmp(MKReceiptRangeBytes(data.bytes, payload.transactions[1].productIdentifier), "com.example.coins", 17), 0);
+    XCTAssertEqual(payload.transactions[0].quantity, (uint64_t)1);
+
+    MKReceiptPayloadFree(&payload);
+}
+
+- (void)testAbsentFieldsHaveEmptyRanges {
+    //Only the bundle identifier, and one purchase with only a product identifier.
+    NSData *purchase = MKTestReceiptSet(@[MKTestReceiptAttribute(1702, MKTestDERString(MKTestDERTagUTF8String, @"com.example.pro"))]);
+    NSData *data = MKTestReceiptSet(@[MKTestReceiptAttribute(2, MKTestDERString(MKTestDERTagUTF8String, @"com.example.app")),
+                                      MKTestReceiptAttribute(17, purchase)]);
+    MKReceiptPayload payload;
+    XCTAssertEqual(MKReceiptPayloadDecode(data.bytes, data.length, &payload), MKReceiptDecodeStatusSuccess);
+
+    XCTAssertEqual(payload.applicationVersion.length, (uint32_t)0);
+    XCTAssertEqual(payload.opaqueValue.length, (uint32_t)0);
+    XCTAssertEqual(payload.sha1Hash.length, (uint32_t)0);
+    XCTAssertEqual(payload.originalApplicationVersion.length, (uint32_t)0);
+    XCTAssertEqual(payload.receiptExpirationDate.length, (uint32_t)0);
+
+    XCTAssertEqual(payload.transactionCount, (size_t)1);
+    MKReceiptTransaction *transaction = &payload.transactions[0];
+    XCTAssertEqual(transaction->productIdentifier.length, (uint32_t)15);
+    XCTAssertEqual(transaction->transactionIdentifier.length, (uint32_t)0);
+    XCTAssertEqual(transaction->purchaseDate.length, (uint32_t)0);
+    XCTAssertEqual(transaction->subscriptionExpirationDate.length, (uint32_t)0);
+    XCTAssertEqual(transaction->cancellationDate.length, (uint32_t)0);
+    XCTAssertEqual(transaction->quantity, (uint64_t)0);
+    XCTAssertEqual(transaction->webOrderLineItemIdentifier, (uint64_t)0);
+
+    MKReceiptPayloadFree(&payload);
+}
+
+- (void)testZeroLengthValues {
+    //An empty string, an empty opaque value and an empty purchase all decode to zero-length ranges.
+    NSData *data = MKTestReceiptSet(@[MKTestReceiptAttribute(2, MKTestDERString(MKTestDERTagUTF8String, @"")),
+                                      MKTestReceiptAttribute(4, [NSData data]),
+                                      MKTestReceiptAttribute(17, MKTestReceiptSet(@[]))]);
+    MKReceiptPayload payload;
+    XCTAssertEqual(MKReceiptPayloadDecode(data.bytes, data.length, &payload), MKReceiptDecodeStatusSuccess);
+
+    XCTAssertEqual(payload.bundleIdentifier.length, (uint32_t)0);
+    XCTAssertEqual(payload.bundleIdentifierData.length, (uint32_t)2);
+    XCTAssertEqual(payload.opaqueValue.length, (uint32_t)0);
+    XCTAssertEqual(payload.transactionCount, (size_t)1);
+    XCTAssertEqual(payload.transactions[0].productIdentifier.length, (uint32_t)0);
+
+    MKReceiptPayloadFree(&payload);
+}
+
+- (void)testEmptyReceipt {
+    NSData *data = MKTestReceiptSet(@[]);
+    MKReceiptPayload payload;
+    XCTAssertEqual(MKReceiptPayloadDecode(data.bytes, data.length, &payload), MKReceiptDecodeStatusSuccess);
+    XCTAssertEqual(payload.bundleIdentifier.length, (uint32_t)0);
+    XCTAssertEqual(payload.transactionCount, (size_t)0);
+    MKReceiptPayloadFree(&payload);
+
+    XCTAssertEqual(MKReceiptPayloadDecode(data.bytes, 0, &payload), MKReceiptDecodeStatusMalformed);
+    MKReceiptPayloadFree(&payload);
+}
+
+- (void)testIgnoresUnknownAndMistypedFields {
+    //Unknown types are skipped, and a value of the wrong string type is left out.
+    NSData *data = MKTestReceiptSet(@[MKTestReceiptAttribute(99, MKTestDERString(MKTestDERTagUTF8String, @"unknown")),
+                                      MKTestReceiptAttribute(100000, [NSData data]),
+                                      MKTestReceiptAttribute(2, MKTestDERString(MKTestDERTagIA5String, @"com.example.app")),
+                                      MKTestReceiptAttribute(3, MKTestDERString(MKTestDERTagUTF8String, @"1.0"))]);
+    MKReceiptPayload payload;
+    XCTAssertEqual(MKReceiptPayloadDecode(data.bytes, data.length, &payload), MKReceiptDecodeStatusSuccess);
+    XCTAssertEqual(payload.bundleIdentifier.length, (uint32_t)0);
+    XCTAssertEqual(payload.applicationVersion.length, (uint32_t)3);
+    MKReceiptPayloadFree(&payload);
+}
+
+- (void)testRejectsTruncatedReceipt {
+    NSData *data = MKTestReceiptPayload(@"com.example.app", @[@"com.example.pro"]);
+    MKReceiptPayload payload;
+    for (NSUInteger length = 0; length < data.length; length++) {
+        MKReceiptDecodeStatus status = MKReceiptPayloadDecode(data.bytes, length, &payload);
+        XCTAssertEqual(status, MKReceiptDecodeStatusMalformed, @"Decoded %lu of %lu bytes", (unsigned long)length, (unsigned long)data.length);
+        MKReceiptPayloadFree(&payload);
+    }
+}
+
+- (void)testRejectsMalformedPurchase {
+    //The purchases must be sets of attributes.
+    NSData *data = MKTestReceiptSet(@[MKTestReceiptAttribute(17, MKTestDERString(MKTestDERTagUTF8String, @"com.example.pro"))]);
+    MKReceiptPayload payload;
+    XCTAssertEqual(MKReceiptPayloadDecode(data.bytes, data.length, &payload), MKReceiptDecodeStatusMalformed);
+    MKReceiptPayloadFree(&payload);
+}
+
+@end
@@ -0,0 +1,121 @@
+//
+//  MKReceiptSnapshotTests.m
+//  M13MarketKitTests
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <XCTest/XCTest.h>
+#import "MKReceiptSnapshot.h"
+#import "MKReceiptTestData.h"
+
+//2015-01-01T00:00:00Z, after the purchases of the test receipt.
+static const double MKTestSnapshotTime = 1420070400.0;
+
+@interface MKReceiptSnapshotTests : XCTestCase
+
+@end
+
+@implementation MKReceiptSnapshotTests
+{
+    NSURL *_directory;
+    NSData *_content;
+    MKReceiptPayload _payload;
+    MKReceiptIndex _index;
+    MKReceiptEntitlementIndex _entitlements;
+    uint8_t _key[MKReceiptSnapshotKeyLength];
+}
+
+- (void)setUp {
+    [super setUp];
+    _directory = MKTestTemporaryDirectory();
+    _content = MKTestReceiptPayload(@"com.example.app", @[@"com.example.pro", @"com.example.coins"]);
+    XCTAssertEqual(MKReceiptPayloadDecode(_content.bytes, _content.length, &_payload), MKReceiptDecodeStatusSuccess);
+    XCTAssertTrue(MKReceiptIndexBuild(&_index, _content.bytes, &_payload));
+    XCTAssertTrue(MKReceiptEntitlementIndexBuild(&_entitlements, &_index));
+    memset(_key, 0x5A, sizeof(_key));
+}
+
+- (void)tearDown {
+    MKReceiptEntitlementIndexFree(&_entitlements);
+    MKReceiptIndexFree(&_index);
+    MKReceiptPayloadFree(&_payload);
+    [[NSFileManager defaultManager] removeItemAtURL:_directory error:nil];
+    [super tearDown];
+}
+
+- (NSString *)snapshotFile {
+    return [_directory URLByAppendingPathComponent:@"Entitlements.snapshot"].path;
+}
+
+- (MKReceiptSnapshotEntitlement)lookup:(NSString *)productIdentifier inSnapshot:(MKReceiptSnapshot *)snapshot {
+    NSData *identifier = [productIdentifier dataUsingEncoding:NSUTF8StringEncoding];
+    return MKReceiptSnapshotLookup(snapshot, identifier.bytes, identifier.length, MKTestSnapshotTime);
+}
+
+- (void)testLookup {
+    XCTAssertTrue(MKReceiptSnapshotWrite([self snapshotFile].fileSystemRepresentation, _key, &_entitlements, MKTestSnapshotTime));
+
+    MKReceiptSnapshot snapshot;
+    XCTAssertTrue(MKReceiptSnapshotOpen(&snapshot, [self snapshotFile].fileSystemRepresentation, _key));
+    XCTAssertEqual(snapshot.count, (size_t)2);
+    XCTAssertEqual(snapshot.writtenAt, MKTestSnapshotTime);
+    XCTAssertEqual([self lookup:@"com.example.pro" inSnapshot:&snapshot], MKReceiptSnapshotEntitlementEntitled);
+    XCTAssertEqual([self lookup:@"com.example.coins" inSnapshot:&snapshot], MKReceiptSnapshotEntitlementEntitled);
+    XCTAssertEqual([self lookup:@"com.example.unpaid" inSnapshot:&snapshot], MKReceiptSnapshotEntitlementUnknown);
+    MKReceiptSnapshotClose(&snapshot);
+}
+
+- (void)testNotEntitledBeforePurchase {
+    //Taken in 2011, before the purchases.
+    XCTAssertTrue(MKReceiptSnapshotWrite([self snapshotFile].fileSystemRepresentation, _key, &_entitlements, 1300000000.0));
+
+    MKReceiptSnapshot snapshot;
+    XCTAssertTrue(MKReceiptSnapshotOpen(&snapshot, [self snapshotFile].fileSystemRepresentation, _key));
+    XCTAssertEqual([self lookup:@"com.example.pro" inSnapshot:&snapshot], MKReceiptSnapshotEntitlementNotEntitled);
+    MKReceiptSnapshotClose(&snapshot);
+}
+
+- (void)testRejectsOtherKey {
+    uint8_t otherKey[MKReceiptSnapshotKeyLength];
+    memset(otherKey, 0xA5, sizeof(otherKey));
+    XCTAssertTrue(MKReceiptSnapshotWrite([self snapshotFile].fileSystemRepresentation, otherKey, &_entitlements, MKTestSnapshotTime));
+
+    MKReceiptSnapshot snapshot;
+    XCTAssertFalse(MKReceiptSnapshotOpen(&snapshot, [self snapshotFile].fileSystemRepresentation, _key));
+    XCTAssertTrue(snapshot.mapping == NULL);
+}
+
+- (void)testRejectsTamperedSnapshot {
+    XCTAssertTrue(MKReceiptSnapshotWrite([self snapshotFile].fileSystemRepresentation, _key, &_entitlements, MKTestSnapshotTime));
+    NSData *file = [NSData dataWithContentsOfFile:[self snapshotFile]];
+
+    //Flip one bit anywhere in the file, or cut it short.
+    for (NSUInteger offset = 0; offset < file.length; offset++) {
+        NSMutableData *tampered = [file mutableCopy];
+        ((uint8_t *)tampered.mutableBytes)[offset] ^= 0x01;
+        XCTAssertTrue([tampered writeToFile:[self snapshotFile] atomically:YES]);
+
+        MKReceiptSnapshot snapshot;
+        XCTAssertFalse(MKReceiptSnapshotOpen(&snapshot, [self snapshotFile].fileSystemRepresentation, _key), @"Accepted a change at offset %lu", (unsigned long)offset);
+    }
+
+    XCTAssertTrue([[file subdataWithRange:NSMakeRange(0, file.length - 1)] writeToFile:[self snapshotFile] atomically:YES]);
+    MKReceiptSnapshot snapshot;
+    XCTAssertFalse(MKReceiptSnapshotOpen(&snapshot, [self snapshotFile].fileSystemRepresentation, _key));
+}
+
+- (void)testMissingSnapshot {
+    MKReceiptSnapshot snapshot;
+    XCTAssertFalse(MKReceiptSnapshotOpen(&snapshot, [self snapshotFile].fileSystemRepresentation, _key));
+}
+
+@end
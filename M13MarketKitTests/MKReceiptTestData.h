@@ -0,0 +1,46 @@
+//
+//  MKReceiptTestData.h
+//  M13MarketKitTests
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <Foundation/Foundation.h>
+
+//DER tags used by the receipt payload
+#define MKTestDERTagInteger 0x02
+#define MKTestDERTagOctetString 0x04
+#define MKTestDERTagUTF8String 0x0C
+#define MKTestDERTagIA5String 0x16
+#define MKTestDERTagSequence 0x30
+#define MKTestDERTagSet 0x31
+
+/**Encodes a DER element with the given tag and contents.*/
+NSData *MKTestDERElement(uint8_t tag, NSData *contents);
+
+/**Encodes a DER string element.*/
+NSData *MKTestDERString(uint8_t tag, NSString *string);
+
+/**Encodes a receipt attribute: SEQUENCE { type INTEGER, version INTEGER, value OCTET STRING }.*/
+NSData *MKTestReceiptAttribute(NSUInteger type, NSData *value);
+
+/**Encodes a SET of the given attributes.*/
+NSData *MKTestReceiptSet(NSArray *attributes);
+
+/**Builds a receipt payload with one purchase of each product, purchased on 2014-06-08 and never expiring.
+ @param bundleIdentifier The bundle identifier of the receipt.
+ @param productIdentifiers The identifiers of the purchased products.
+ @return The encoded payload.
+ */
+NSData *MKTestReceiptPayload(NSString *bundleIdentifier, NSArray *productIdentifiers);
+
+/**Creates an empty directory for a test to write into.*/
+NSURL *MKTestTemporaryDirectory(void);
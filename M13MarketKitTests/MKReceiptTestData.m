@@ -0,0 +1,103 @@
+//
+//  MKReceiptTestData.m
+//  M13MarketKitTests
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import "MKReceiptTestData.h"
+
+NSData *MKTestDERElement(uint8_t tag, NSData *contents)
+{
+    NSMutableData *element = [NSMutableData dataWithBytes:&tag length:1];
+    NSUInteger length = contents.length;
+    if (length < 0x80) {
+        uint8_t shortLength = (uint8_t)length;
+        [element appendBytes:&shortLength length:1];
+    } else {
+        //Long form: the number of length bytes, then the length big endian.
+        uint8_t lengthBytes[5];
+        uint8_t count = 0;
+        for (NSUInteger remaining = length; remaining > 0; remaining >>= 8) {
+            count++;
+        }
+        lengthBytes[0] = 0x80 | count;
+        for (uint8_t i = 0; i < count; i++) {
+            lengthBytes[count - i] = (uint8_t)(length >> (8 * i));
+        }
+        [element appendBytes:lengthBytes length:count + 1];
+    }
+    [element appendData:contents];
+    return element;
+}
+
+NSData *MKTestDERString(uint8_t tag, NSString *string)
+{
+    return MKTestDERElement(tag, [string dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+static NSData *MKTestDERInteger(NSUInteger value)
+{
+    //Big endian, with a leading zero if the top bit is set so the value stays positive.
+    uint8_t bytes[sizeof(NSUInteger) + 1];
+    NSUInteger count = 0;
+    do {
+        bytes[sizeof(bytes) - 1 - count++] = (uint8_t)value;
+        value >>= 8;
+    } while (value > 0);
+    if (bytes[sizeof(bytes) - count] & 0x80) {
+        bytes[sizeof(bytes) - 1 - count++] = 0;
+    }
+    return MKTestDERElement(MKTestDERTagInteger, [NSData dataWithBytes:bytes + sizeof(bytes) - count length:count]);
+}
+
+NSData *MKTestReceiptAttribute(NSUInteger type, NSData *value)
+{
+    NSMutableData *contents = [NSMutableData data];
+    [contents appendData:MKTestDERInteger(type)];
+    [contents appendData:MKTestDERInteger(1)];
+    [contents appendData:MKTestDERElement(MKTestDERTagOctetString, value)];
+    return MKTestDERElement(MKTestDERTagSequence, contents);
+}
+
+NSData *MKTestReceiptSet(NSArray *attributes)
+{
+    NSMutableData *contents = [NSMutableData data];
+    for (NSData *attribute in attributes) {
+        [contents appendData:attribute];
+    }
+    return MKTestDERElement(MKTestDERTagSet, contents);
+}
+
+NSData *MKTestReceiptPayload(NSString *bundleIdentifier, NSArray *productIdentifiers)
+{
+    NSMutableArray *attributes = [NSMutableArray array];
+    [attributes addObject:MKTestReceiptAttribute(2, MKTestDERString(MKTestDERTagUTF8String, bundleIdentifier))];
+    [attributes addObject:MKTestReceiptAttribute(3, MKTestDERString(MKTestDERTagUTF8String, @"1.0"))];
+
+    NSUInteger transaction = 1000;
+    for (NSString *productIdentifier in productIdentifiers) {
+        NSData *purchase = MKTestReceiptSet(@[MKTestReceiptAttribute(1701, MKTestDERInteger(1)),
+                                              MKTestReceiptAttribute(1702, MKTestDERString(MKTestDERTagUTF8String, productIdentifier)),
+                                              MKTestReceiptAttribute(1703, MKTestDERString(MKTestDERTagUTF8String, [NSString stringWithFormat:@"%lu", (unsigned long)transaction++])),
+                                              MKTestReceiptAttribute(1704, MKTestDERString(MKTestDERTagIA5String, @"2014-06-08T12:00:00Z"))]);
+        [attributes addObject:MKTestReceiptAttribute(17, purchase)];
+    }
+
+    return MKTestReceiptSet(attributes);
+}
+
+NSURL *MKTestTemporaryDirectory(void)
+{
+    NSURL *directory = [[NSURL fileURLWithPath:NSTemporaryDirectory() isDirectory:YES] URLByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString] isDirectory:YES];
+    [[NSFileManager defaultManager] createDirectoryAtURL:directory withIntermediateDirectories:YES attributes:nil error:nil];
+    return directory;
+}
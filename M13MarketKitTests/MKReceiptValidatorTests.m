@@ -0,0 +1,160 @@
+//
+//  MKReceiptValidatorTests.m
+//  M13MarketKitTests
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <XCTest/XCTest.h>
+#import <StoreKit/StoreKit.h>
+#import "MKReceiptValidator.h"
+#import "MKReceiptTestData.h"
+
+@interface MKApplicationReceipt (Testing)
+- (instancetype)initWithPayloadData:(NSData *)data;
+@end
+
+@interface MKReceiptValidator (Testing) <SKRequestDelegate>
+- (BOOL)receiptHasChanged;
+- (void)watchReceipt;
+- (void)refreshReceipt;
+- (NSString *)entitlementSnapshotPath;
+- (NSData *)entitlementSnapshotKey;
+- (MKApplicationReceipt *)verifiedApplicationReceiptAtPath:(NSString *)path error:(NSError **)error;
+@end
+
+/**A validator that verifies queued payloads instead of the receipt of the application, and never talks to the store.*/
+@interface MKTestReceiptValidator : MKReceiptValidator
+/**The payloads the next validations verify, in order. NSNull fails the validation. Once empty, the last payload keeps being verified.*/
+@property (nonatomic, strong) NSMutableArray *payloads;
+@property (nonatomic, strong) NSData *lastPayload;
+@property (nonatomic, strong) NSURL *directory;
+/**Fulfilled when the validator asks the store for a new receipt.*/
+@property (nonatomic, strong) XCTestExpectation *refreshExpectation;
+@end
+
+@implementation MKTestReceiptValidator
+
+- (BOOL)receiptHasChanged {
+    return YES;
+}
+
+- (void)watchReceipt {
+}
+
+- (void)refreshReceipt {
+    [self.refreshExpectation fulfill];
+}
+
+- (NSString *)entitlementSnapshotPath {
+    return [self.directory URLByAppendingPathComponent:@"Entitlements.snapshot"].path;
+}
+
+- (NSData *)entitlementSnapshotKey {
+    return nil;
+}
+
+- (MKApplicationReceipt *)verifiedApplicationReceiptAtPath:(NSString *)path error:(NSError **)error {
+    id payload;
+    @synchronized(self) {
+        payload = self.payloads.count > 0 ? self.payloads[0] : self.lastPayload;
+        if (self.payloads.count > 0) {
+            [self.payloads removeObjectAtIndex:0];
+        }
+    }
+    if (payload == [NSNull null]) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"MKReceiptValidatorTests" code:1 userInfo:nil];
+        }
+        return nil;
+    }
+    self.lastPayload = payload;
+    return [[MKApplicationReceipt alloc] initWithPayloadData:payload];
+}
+
+@end
+
+@interface MKReceiptValidatorTests : XCTestCase
+
+@end
+
+@implementation MKReceiptValidatorTests
+{
+    MKTestReceiptValidator *_validator;
+    NSData *_original;
+    NSData *_updated;
+}
+
+- (void)setUp {
+    [super setUp];
+    _validator = [[MKTestReceiptValidator alloc] init];
+    _validator.directory = MKTestTemporaryDirectory();
+    _original = MKTestReceiptPayload(@"com.example.app", @[@"com.example.pro"]);
+    _updated = MKTestReceiptPayload(@"com.example.app", @[@"com.example.pro", @"com.example.coins"]);
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtURL:_validator.directory error:nil];
+    _validator = nil;
+    [super tearDown];
+}
+
+- (void)validateOriginalReceipt {
+    _validator.payloads = [NSMutableArray arrayWithObject:_original];
+    XCTestExpectation *validated = [self expectationWithDescription:@"validated"];
+    [_validator validateReceiptWithCompletion:^(BOOL validAppReceipt, MKApplicationReceipt *receipt, NSError *error) {
+        XCTAssertTrue(validAppReceipt);
+        XCTAssertEqual(receipt.updatedProductIdentifiers.count, (NSUInteger)0);
+        [validated fulfill];
+    } forceRefresh:NO];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testForcedValidationReportsChanges {
+    [self validateOriginalReceipt];
+    
+    _validator.payloads = [NSMutableArray arrayWithObject:_updated];
+    XCTestExpectation *validated = [self expectationWithDescription:@"validated"];
+    [_validator validateReceiptWithCompletion:^(BOOL validAppReceipt, MKApplicationReceipt *receipt, NSError *error) {
+        XCTAssertTrue(validAppReceipt);
+        XCTAssertEqualObjects(receipt.addedProductIdentifiers, [NSSet setWithObject:@"com.example.coins"]);
+        XCTAssertEqualObjects(receipt.updatedProductIdentifiers, [NSSet setWithObject:@"com.example.coins"]);
+        [validated fulfill];
+    } forceRefresh:YES];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testRevalidationDuringValidationReportsChanges {
+    [self validateOriginalReceipt];
+    
+    //The first attempt fails, so the validation stays in flight while the receipt is refreshed.
+    _validator.payloads = [NSMutableArray arrayWithObjects:[NSNull null], _updated, nil];
+    _validator.refreshExpectation = [self expectationWithDescription:@"refreshing"];
+    XCTestExpectation *firstCaller = [self expectationWithDescription:@"first caller"];
+    [_validator validateReceiptWithCompletion:^(BOOL validAppReceipt, MKApplicationReceipt *receipt, NSError *error) {
+        XCTAssertTrue(validAppReceipt);
+        XCTAssertEqualObjects(receipt.updatedProductIdentifiers, [NSSet setWithObject:@"com.example.coins"]);
+        [firstCaller fulfill];
+    } forceRefresh:YES];
+    
+    //Validations run in order on one queue, so this caller attaches while the receipt is refreshed, and the validation runs again once the refreshed receipt is verified.
+    XCTestExpectation *secondCaller = [self expectationWithDescription:@"second caller"];
+    [_validator validateReceiptWithCompletion:^(BOOL validAppReceipt, MKApplicationReceipt *receipt, NSError *error) {
+        XCTAssertTrue(validAppReceipt);
+        XCTAssertEqualObjects(receipt.addedProductIdentifiers, [NSSet setWithObject:@"com.example.coins"]);
+        XCTAssertEqualObjects(receipt.updatedProductIdentifiers, [NSSet setWithObject:@"com.example.coins"]);
+        [secondCaller fulfill];
+    } forceRefresh:YES];
+    [_validator requestDidFinish:nil];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+@end
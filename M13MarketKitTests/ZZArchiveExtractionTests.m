@@ -0,0 +1,226 @@
+//
+//  ZZArchiveExtractionTests.m
+//  M13MarketKitTests
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#import <XCTest/XCTest.h>
+#import "ZZArchive.h"
+#import "ZZArchiveEntry.h"
+#import "ZZError.h"
+#import "MKReceiptTestData.h"
+
+static const uint16_t ZZTestStored = 0;
+static const uint16_t ZZTestDeflated = 8;
+
+static void ZZTestAppend16(NSMutableData *data, uint16_t value)
+{
+    uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+    [data appendBytes:bytes length:sizeof(bytes)];
+}
+
+static void ZZTestAppend32(NSMutableData *data, uint32_t value)
+{
+    uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    [data appendBytes:bytes length:sizeof(bytes)];
+}
+
+/**The CRC-32 zip records for an entry file.*/
+static uint32_t ZZTestCRC32(NSData *data)
+{
+    const uint8_t *bytes = data.bytes;
+    uint32_t crc = 0xFFFFFFFF;
+    for (NSUInteger i = 0; i < data.length; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+/**Wraps data in deflate stored blocks, so a deflated entry can be built without a compressor.*/
+static NSData *ZZTestDeflate(NSData *data)
+{
+    NSMutableData *deflated = [NSMutableData data];
+    NSUInteger offset = 0;
+    do {
+        uint16_t length = (uint16_t)MIN(data.length - offset, (NSUInteger)0xFFFF);
+        uint8_t final = offset + length == data.length ? 1 : 0;
+        [deflated appendBytes:&final length:1];
+        ZZTestAppend16(deflated, length);
+        ZZTestAppend16(deflated, (uint16_t)~length);
+        [deflated appendBytes:(const uint8_t *)data.bytes + offset length:length];
+        offset += length;
+    } while (offset < data.length);
+    return deflated;
+}
+
+/**Builds a zip file with one entry, recording the given checksum and uncompressed size in both of its headers.*/
+static NSData *ZZTestArchive(NSString *fileName, uint16_t compressionMethod, NSData *fileData, uint32_t crc32, uint32_t uncompressedSize)
+{
+    NSData *name = [fileName dataUsingEncoding:NSUTF8StringEncoding];
+    NSMutableData *archive = [NSMutableData data];
+
+    //Local file header
+    ZZTestAppend32(archive, 0x04034b50);
+    ZZTestAppend16(archive, 20);
+    ZZTestAppend16(archive, 0);
+    ZZTestAppend16(archive, compressionMethod);
+    ZZTestAppend16(archive, 0);
+    ZZTestAppend16(archive, 0x4521);
+    ZZTestAppend32(archive, crc32);
+    ZZTestAppend32(archive, (uint32_t)fileData.length);
+    ZZTestAppend32(archive, uncompressedSize);
+    ZZTestAppend16(archive, (uint16_t)name.length);
+    ZZTestAppend16(archive, 0);
+    [archive appendData:name];
+    [archive appendData:fileData];
+
+    //Central file header
+    uint32_t centralDirectoryOffset = (uint32_t)archive.length;
+    ZZTestAppend32(archive, 0x02014b50);
+    ZZTestAppend16(archive, 20);
+    ZZTestAppend16(archive, 20);
+    ZZTestAppend16(archive, 0);
+    ZZTestAppend16(archive, compressionMethod);
+    ZZTestAppend16(archive, 0);
+    ZZTestAppend16(archive, 0x4521);
+    ZZTestAppend32(archive, crc32);
+    ZZTestAppend32(archive, (uint32_t)fileData.length);
+    ZZTestAppend32(archive, uncompressedSize);
+    ZZTestAppend16(archive, (uint16_t)name.length);
+    ZZTestAppend16(archive, 0);
+    ZZTestAppend16(archive, 0);
+    ZZTestAppend16(archive, 0);
+    ZZTestAppend16(archive, 0);
+    ZZTestAppend32(archive, 0);
+    ZZTestAppend32(archive, 0);
+    [archive appendData:name];
+
+    //End of central directory
+    uint32_t centralDirectoryLength = (uint32_t)archive.length - centralDirectoryOffset;
+    ZZTestAppend32(archive, 0x06054b50);
+    ZZTestAppend16(archive, 0);
+    ZZTestAppend16(archive, 0);
+    ZZTestAppend16(archive, 1);
+    ZZTestAppend16(archive, 1);
+    ZZTestAppend32(archive, centralDirectoryLength);
+    ZZTestAppend32(archive, centralDirectoryOffset);
+    ZZTestAppend16(archive, 0);
+
+    return archive;
+}
+
+@interface ZZArchiveExtractionTests : XCTestCase
+
+@end
+
+@implementation ZZArchiveExtractionTests
+{
+    NSURL *_directory;
+    NSData *_contents;
+}
+
+- (void)setUp {
+    [super setUp];
+    _directory = MKTestTemporaryDirectory();
+
+    //Larger than the extraction buffer, so the entry is written in several pieces.
+    NSMutableData *contents = [NSMutableData dataWithLength:200000];
+    uint8_t *bytes = contents.mutableBytes;
+    for (NSUInteger i = 0; i < contents.length; i++) {
+        bytes[i] = (uint8_t)(i * 31 + (i >> 8));
+    }
+    _contents = contents;
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtURL:_directory error:nil];
+    [super tearDown];
+}
+
+- (NSError *)extract:(NSData *)archiveData {
+    ZZArchive *archive = [ZZArchive archiveWithData:archiveData];
+    NSError *error = nil;
+    BOOL extracted = [archive extractToURL:_directory maxConcurrentEntries:1 progressBlock:nil error:&error];
+    XCTAssertEqual(extracted, error == nil);
+    return error;
+}
+
+- (BOOL)entryFileExists {
+    return [[NSFileManager defaultManager] fileExistsAtPath:[_directory URLByAppendingPathComponent:@"Entry.bin"].path];
+}
+
+- (void)testExtractsStoredEntry {
+    NSError *error = [self extract:ZZTestArchive(@"Entry.bin", ZZTestStored, _contents, ZZTestCRC32(_contents), (uint32_t)_contents.length)];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([NSData dataWithContentsOfURL:[_directory URLByAppendingPathComponent:@"Entry.bin"]], _contents);
+}
+
+- (void)testExtractsDeflatedEntry {
+    NSError *error = [self extract:ZZTestArchive(@"Entry.bin", ZZTestDeflated, ZZTestDeflate(_contents), ZZTestCRC32(_contents), (uint32_t)_contents.length)];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([NSData dataWithContentsOfURL:[_directory URLByAppendingPathComponent:@"Entry.bin"]], _contents);
+}
+
+- (void)testRejectsDeflatedEntryLargerThanRecorded {
+    //The entry inflates to far more than its headers claim.
+    NSError *error = [self extract:ZZTestArchive(@"Entry.bin", ZZTestDeflated, ZZTestDeflate(_contents), ZZTestCRC32(_contents), 1000)];
+    XCTAssertEqualObjects(error.domain, ZZErrorDomain);
+    XCTAssertEqual(error.code, ZZLocalFileReadErrorCode);
+    XCTAssertFalse([self entryFileExists]);
+}
+
+- (void)testRejectsDeflatedEntrySmallerThanRecorded {
+    NSError *error = [self extract:ZZTestArchive(@"Entry.bin", ZZTestDeflated, ZZTestDeflate(_contents), ZZTestCRC32(_contents), (uint32_t)_contents.length + 1)];
+    XCTAssertEqualObjects(error.domain, ZZErrorDomain);
+    XCTAssertEqual(error.code, ZZLocalFileReadErrorCode);
+    XCTAssertFalse([self entryFileExists]);
+}
+
+- (void)testRejectsStoredEntryOfWrongSize {
+    NSError *error = [self extract:ZZTestArchive(@"Entry.bin", ZZTestStored, _contents, ZZTestCRC32(_contents), (uint32_t)_contents.length - 1)];
+    XCTAssertEqualObjects(error.domain, ZZErrorDomain);
+    XCTAssertEqual(error.code, ZZLocalFileReadErrorCode);
+    XCTAssertFalse([self entryFileExists]);
+}
+
+- (void)testRejectsStoredEntryWithWrongChecksum {
+    NSError *error = [self extract:ZZTestArchive(@"Entry.bin", ZZTestStored, _contents, ZZTestCRC32(_contents) ^ 1, (uint32_t)_contents.length)];
+    XCTAssertEqualObjects(error.domain, ZZErrorDomain);
+    XCTAssertEqual(error.code, ZZInvalidCRChecksum);
+    XCTAssertFalse([self entryFileExists]);
+}
+
+- (void)testRejectsDeflatedEntryWithWrongChecksum {
+    NSError *error = [self extract:ZZTestArchive(@"Entry.bin", ZZTestDeflated, ZZTestDeflate(_contents), ZZTestCRC32(_contents) ^ 1, (uint32_t)_contents.length)];
+    XCTAssertEqualObjects(error.domain, ZZErrorDomain);
+    XCTAssertEqual(error.code, ZZInvalidCRChecksum);
+    XCTAssertFalse([self entryFileExists]);
+}
+
+- (void)testRejectsUnsupportedCompressionMethod {
+    NSError *error = [self extract:ZZTestArchive(@"Entry.bin", 12, _contents, ZZTestCRC32(_contents), (uint32_t)_contents.length)];
+    XCTAssertEqualObjects(error.domain, ZZErrorDomain);
+    XCTAssertEqual(error.code, ZZUnsupportedCompressionMethod);
+    XCTAssertFalse([self entryFileExists]);
+}
+
+- (void)testRejectsEntryOutsideDirectory {
+    NSError *error = [self extract:ZZTestArchive(@"../Entry.bin", ZZTestStored, _contents, ZZTestCRC32(_contents), (uint32_t)_contents.length)];
+    XCTAssertEqualObjects(error.domain, ZZErrorDomain);
+    XCTAssertEqual(error.code, ZZUnsafeFileNameErrorCode);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[[_directory URLByDeletingLastPathComponent] URLByAppendingPathComponent:@"Entry.bin"].path]);
+}
+
+@end
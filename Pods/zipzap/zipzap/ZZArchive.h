@@ -35,6 +35,8 @@
 
 /**
  * The ZZArchive class represents a zip file for reading only.
+ *
+ * An archive and its entries may be read from several threads at once.
  */
 @interface ZZArchive : NSObject
 
@@ -104,6 +106,31 @@
  */
 - (BOOL)load:(out NSError**)error;
 
+/**
+ * Extracts the entries into the directory at the given file URL, several entries at a time.
+ *
+ * Directories, including those only implied by entry file names, are created first. The file entries are then
+ * handed out in order to at most maxConcurrentEntries workers, each of which streams one entry at a time to its file
+ * through a fixed-size buffer, so memory use depends on the number of workers and not on the size of the entries.
+ *
+ * When entries fail, the error reported is the one for the lowest-indexed failing entry, the same one a serial
+ * extraction would report. Entries after it are not extracted, although some of them may already have been written.
+ *
+ * An entry whose file name is absolute or leads outside of the directory through ".." fails with ZZUnsafeFileNameErrorCode,
+ * and nothing is written for it.
+ *
+ * @param URL The file URL of the directory to extract into.
+ * @param maxConcurrentEntries The most entries to extract at the same time, or 0 for one per active processor.
+ * @param progressBlock The callback to report the uncompressed bytes extracted so far out of the total, after each entry file.
+ * It may be called on any thread, but never concurrently. Pass in nil if you do not want progress information.
+ * @param error The error information when an error occurs. Pass in nil if you do not want error information.
+ * @return Whether all entries were extracted or not.
+ */
+- (BOOL)extractToURL:(NSURL*)URL
+maxConcurrentEntries:(NSUInteger)maxConcurrentEntries
+	   progressBlock:(void(^)(unsigned long long completedBytes, unsigned long long totalBytes))progressBlock
+			   error:(out NSError**)error;
+
 @end
 
 /**
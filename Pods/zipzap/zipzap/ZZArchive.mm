@@ -7,7 +7,10 @@
 //
 
 #include <algorithm>
+#include <atomic>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <vector>
 
 #import "ZZChannelOutput.h"
 #import "ZZDataChannel.h"
@@ -73,23 +76,38 @@
 
 - (NSData*)contents
 {
-	// lazily load in contents + refresh entries
-	if (!_contents)
-		[self load:nil];
-	
-	return _contents;
+	@synchronized(self)
+	{
+		// lazily load in contents + refresh entries
+		if (!_contents)
+			[self load:nil];
+		
+		return _contents;
+	}
 }
 
 - (NSArray*)entries
 {
-	// lazily load in contents + refresh entries	
-	if (!_contents)
-		[self load:nil];
-	
-	return _entries;
+	@synchronized(self)
+	{
+		// lazily load in contents + refresh entries
+		if (!_contents)
+			[self load:nil];
+		
+		return _entries;
+	}
 }
 
 - (BOOL)load:(NSError**)error
+{
+	// serialize with lazy loading on other threads
+	@synchronized(self)
+	{
+		return [self loadContents:error];
+	}
+}
+
+- (BOOL)loadContents:(NSError**)error
 {
 	// memory-map the contents from the zip file
 	NSError* __autoreleasing readError;
@@ -161,6 +179,152 @@
 	return YES;
 }
 
+- (BOOL)extractToURL:(NSURL*)URL
+maxConcurrentEntries:(NSUInteger)maxConcurrentEntries
+	   progressBlock:(void(^)(unsigned long long completedBytes, unsigned long long totalBytes))progressBlock
+			   error:(NSError**)error
+{
+	// take the contents along with the entries: the entries point into them, so they must outlive a reload on another thread
+	NSData* contents __attribute__((objc_precise_lifetime));
+	NSArray* entries;
+	@synchronized(self)
+	{
+		if (!_contents && ![self loadContents:error])
+			return NO;
+		contents = _contents;
+		entries = _entries;
+	}
+	
+	NSFileManager* fileManager = [[NSFileManager alloc] init];
+	
+	// the lowest-indexed failure so far, and its error: blocks cannot copy atomics, so they share them through pointers
+	std::atomic<NSUInteger> failedIndexStorage(NSNotFound);
+	std::atomic<NSUInteger>* failedIndex = &failedIndexStorage;
+	NSError* __block failedError = nil;
+	NSObject* failureLock = [[NSObject alloc] init];
+	void (^fail)(NSUInteger, NSError*) = ^(NSUInteger index, NSError* indexError)
+	{
+		@synchronized(failureLock)
+		{
+			if (index < *failedIndex)
+			{
+				*failedIndex = index;
+				failedError = indexError;
+			}
+		}
+	};
+	
+	// create the directories serially, so that workers never race to create the same one
+	NSMutableArray* targetURLs = [NSMutableArray arrayWithCapacity:entries.count];
+	std::vector<NSUInteger> fileIndexes;
+	unsigned long long totalBytes = 0;
+	NSMutableSet* directoryURLs = [NSMutableSet set];
+	NSString* rootPath = [URL URLByStandardizingPath].path;
+	NSString* rootPrefix = [rootPath hasSuffix:@"/"] ? rootPath : [rootPath stringByAppendingString:@"/"];
+	for (NSUInteger index = 0; index < entries.count; ++index)
+	{
+		ZZArchiveEntry* entry = entries[index];
+		NSString* fileName = entry.fileName;
+		if (!fileName)
+		{
+			fail(index, [NSError errorWithDomain:ZZErrorDomain code:ZZLocalFileReadErrorCode userInfo:@{ZZEntryIndexKey : @(index)}]);
+			break;
+		}
+		
+		// resolve any ".." and refuse names that lead outside of the directory
+		NSURL* targetURL = [[URL URLByAppendingPathComponent:fileName] URLByStandardizingPath];
+		NSString* targetPath = targetURL.path;
+		if (!targetPath || fileName.isAbsolutePath || !([targetPath isEqualToString:rootPath] || [targetPath hasPrefix:rootPrefix]))
+		{
+			fail(index, [NSError errorWithDomain:ZZErrorDomain code:ZZUnsafeFileNameErrorCode userInfo:@{ZZEntryIndexKey : @(index)}]);
+			break;
+		}
+		[targetURLs addObject:targetURL];
+		
+		BOOL isDirectory = S_ISDIR(entry.fileMode) || [fileName hasSuffix:@"/"];
+		
+		// some archives don't have a separate entry for each directory and just include the directory's name in the file name
+		NSURL* directoryURL = isDirectory ? targetURL : [targetURL URLByDeletingLastPathComponent];
+		if (![directoryURLs containsObject:directoryURL])
+		{
+			NSError* __autoreleasing directoryError;
+			if (![fileManager createDirectoryAtURL:directoryURL
+					   withIntermediateDirectories:YES
+										attributes:nil
+											 error:&directoryError])
+			{
+				fail(index, [NSError errorWithDomain:ZZErrorDomain code:ZZExtractWriteErrorCode userInfo:@{NSUnderlyingErrorKey : directoryError, ZZEntryIndexKey : @(index)}]);
+				break;
+			}
+			[directoryURLs addObject:directoryURL];
+		}
+		
+		if (!isDirectory)
+		{
+			fileIndexes.push_back(index);
+			totalBytes += entry.uncompressedSize;
+		}
+	}
+	
+	// share the file entries out among the workers in index order, skipping any after a failure
+	std::atomic<NSUInteger> nextFileStorage(0);
+	std::atomic<NSUInteger>* nextFile = &nextFileStorage;
+	NSUInteger fileCount = fileIndexes.size();
+	const NSUInteger* files = fileIndexes.data();
+	unsigned long long __block completedBytes = 0;
+	NSObject* progressLock = [[NSObject alloc] init];
+	
+	if (maxConcurrentEntries == 0)
+		maxConcurrentEntries = [NSProcessInfo processInfo].activeProcessorCount;
+	NSUInteger workerCount = std::min(maxConcurrentEntries, fileCount);
+	
+	dispatch_group_t workers = dispatch_group_create();
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	for (NSUInteger worker = 0; worker < workerCount; ++worker)
+		dispatch_group_async(workers, queue, ^
+							 {
+								 for (NSUInteger file = (*nextFile)++; file < fileCount; file = (*nextFile)++)
+								 {
+									 // files are handed out in index order, so every later file is also past the failure
+									 NSUInteger index = files[file];
+									 if (index > *failedIndex)
+										 break;
+									 
+									 @autoreleasepool
+									 {
+										 // stream each entry through a fixed-size buffer, so memory use does not grow with entry size
+										 ZZArchiveEntry* entry = entries[index];
+										 NSError* __autoreleasing entryError = nil;
+										 if (![entry extractToURL:targetURLs[index] error:&entryError])
+										 {
+											 NSMutableDictionary* userInfo = [NSMutableDictionary dictionaryWithDictionary:entryError.userInfo];
+											 userInfo[ZZEntryIndexKey] = @(index);
+											 fail(index, [NSError errorWithDomain:entryError ? entryError.domain : ZZErrorDomain
+																			 code:entryError ? entryError.code : ZZLocalFileReadErrorCode
+																		 userInfo:userInfo]);
+											 break;
+										 }
+										 
+										 if (progressBlock)
+											 @synchronized(progressLock)
+											 {
+												 completedBytes += entry.uncompressedSize;
+												 progressBlock(completedBytes, totalBytes);
+											 }
+									 }
+								 }
+							 });
+	dispatch_group_wait(workers, DISPATCH_TIME_FOREVER);
+	
+	if (*failedIndex != NSNotFound)
+	{
+		if (error)
+			*error = failedError;
+		return NO;
+	}
+	return YES;
+}
+
 @end
 
 @implementation ZZMutableArchive
@@ -196,6 +196,33 @@
  */
 - (NSData*)newDataWithPassword:(NSString*)password error:(NSError**)error;
 
+/**
+ * Extracts the entry file to the file at the given file URL, replacing any file already there.
+ *
+ * The entry file is inflated through a fixed-size buffer and written out as it goes,
+ * so memory use does not grow with the size of the entry. The extraction fails as soon as the entry grows past its
+ * recorded uncompressed size, and when its checksum does not match. If the extraction fails, the partly written file is removed.
+ *
+ * @param URL The file URL to extract to.
+ * @param error A pointer to a variable that will contain the error if any.
+ * @return Whether the extraction was successful or not: NO for new entries.
+ */
+- (BOOL)extractToURL:(NSURL*)URL error:(NSError**)error;
+
+/**
+ * Extracts the entry file to the file at the given file URL, replacing any file already there.
+ *
+ * The entry file is decrypted and inflated through a fixed-size buffer and written out as it goes,
+ * so memory use does not grow with the size of the entry. The extraction fails as soon as the entry grows past its
+ * recorded uncompressed size, and when its checksum does not match. If the extraction fails, the partly written file is removed.
+ *
+ * @param URL The file URL to extract to.
+ * @param password The password to be used for decryption.
+ * @param error A pointer to a variable that will contain the error if any.
+ * @return Whether the extraction was successful or not: NO for new entries.
+ */
+- (BOOL)extractToURL:(NSURL*)URL password:(NSString*)password error:(NSError**)error;
+
 /**
  * Creates a data provider to represent the entry file.
  *
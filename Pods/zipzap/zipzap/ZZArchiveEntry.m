@@ -145,6 +145,16 @@
 	return nil;
 }
 
+- (BOOL)extractToURL:(NSURL*)URL error:(NSError**)error
+{
+	return [self extractToURL:URL password:nil error:error];
+}
+
+- (BOOL)extractToURL:(NSURL*)URL password:(NSString*)password error:(NSError**)error
+{
+	return NO;
+}
+
 - (CGDataProviderRef)newDataProviderWithError:(NSError**)error
 {
 	return [self newDataProviderWithPassword:nil error:error];
@@ -104,7 +104,17 @@ typedef NS_ENUM(NSInteger, ZZErrorCode)
 	/**
 	 * The wrong key was passed in (don't count on this; we cannot always detect that the problem is indeed a wrong password. in most "wrong password" cases we will raise a CRC error.)
 	 */
-	ZZWrongPassword
+	ZZWrongPassword,
+	
+	/**
+	 * Cannot write an entry file or directory while extracting.
+	 */
+	ZZExtractWriteErrorCode,
+	
+	/**
+	 * An entry file name leads outside of the directory being extracted into.
+	 */
+	ZZUnsafeFileNameErrorCode
 };
 
 static inline BOOL ZZRaiseError(NSError** error, ZZErrorCode errorCode, NSDictionary* userInfo)
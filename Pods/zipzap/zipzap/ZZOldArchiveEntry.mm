@@ -7,6 +7,9 @@
 //
 //
 
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
 #include <zlib.h>
 
 #import "ZZDataProvider.h"
@@ -21,6 +24,30 @@
 #import "ZZAESDecryptInputStream.h"
 #import "ZZConstants.h"
 
+static const NSUInteger _extractBufferLength = 65536; // 64K buffer
+
+static BOOL writeFully(int fileDescriptor, const uint8_t* bytes, NSUInteger length)
+{
+	while (length > 0)
+	{
+		ssize_t bytesWritten = write(fileDescriptor, bytes, std::min(length, _extractBufferLength));
+		if (bytesWritten > 0)
+		{
+			bytes += bytesWritten;
+			length -= bytesWritten;
+		}
+		else if (bytesWritten == 0)
+		{
+			// no progress: give up rather than spin
+			errno = EIO;
+			return NO;
+		}
+		else if (errno != EINTR)
+			return NO;
+	}
+	return YES;
+}
+
 @interface ZZOldArchiveEntry ()
 
 - (NSData*)fileData;
@@ -384,6 +411,132 @@
 	}
 }
 
+- (BOOL)extractToURL:(NSURL*)URL password:(NSString*)password error:(out NSError**)error
+{
+	if (![self checkEncryptionAndCompression:error])
+		return NO;
+	
+	NSData* fileData = [self fileData];
+	
+	// encrypted files go through the decrypting stream, the others are inflated straight from the mapped file data
+	NSInputStream* stream = nil;
+	if (_encryptionMode != ZZEncryptionModeNone)
+	{
+		stream = [self streamForData:fileData withPassword:password];
+		if (!stream)
+			return ZZRaiseError(error, ZZLocalFileReadErrorCode, nil);
+	}
+	
+	const char* path = URL.path.fileSystemRepresentation;
+	int fileDescriptor = open(path,
+							  O_WRONLY | O_CREAT | O_TRUNC,
+							  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fileDescriptor == -1)
+		return ZZRaiseError(error, ZZExtractWriteErrorCode, @{NSUnderlyingErrorKey : [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]});
+	
+	BOOL __block extracted = NO;
+	ZZScopeGuard fileCloser(^
+							{
+								close(fileDescriptor);
+								if (!extracted)
+									unlink(path);
+							});
+	
+	// the one buffer all output passes through, whatever the size of the entry
+	NSMutableData* buffer = [NSMutableData dataWithLength:_extractBufferLength];
+	uint8_t* bufferBytes = (uint8_t*)buffer.mutableBytes;
+	NSUInteger totalBytesWritten = 0;
+	uLong crc = crc32(0L, Z_NULL, 0);
+	
+	if (stream)
+	{
+		[stream open];
+		ZZScopeGuard streamCloser(^{[stream close];});
+		
+		// read until all decompressed or EOF or error
+		while (totalBytesWritten < _centralFileHeader->uncompressedSize)
+		{
+			NSInteger bytesRead = [stream read:bufferBytes
+									 maxLength:std::min(_extractBufferLength, _centralFileHeader->uncompressedSize - totalBytesWritten)];
+			if (bytesRead <= 0)
+				break;
+			if (!writeFully(fileDescriptor, bufferBytes, bytesRead))
+				return ZZRaiseError(error, ZZExtractWriteErrorCode, @{NSUnderlyingErrorKey : [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]});
+			crc = crc32(crc, bufferBytes, (uInt)bytesRead);
+			totalBytesWritten += bytesRead;
+		}
+		if (stream.streamError)
+		{
+			if (error)
+				*error = stream.streamError;
+			return NO;
+		}
+	}
+	else
+		switch (self.compressionMethod)
+		{
+			case ZZCompressionMethod::stored:
+				// unencrypted, stored: write the mapped file data as-is, once its size is known to match
+				if (fileData.length != _centralFileHeader->uncompressedSize)
+					return ZZRaiseError(error, ZZLocalFileReadErrorCode, nil);
+				if (!writeFully(fileDescriptor, (const uint8_t*)fileData.bytes, fileData.length))
+					return ZZRaiseError(error, ZZExtractWriteErrorCode, @{NSUnderlyingErrorKey : [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]});
+				for (NSUInteger offset = 0; offset < fileData.length; offset += _extractBufferLength)
+					crc = crc32(crc, (const Bytef*)fileData.bytes + offset, (uInt)std::min(_extractBufferLength, fileData.length - offset));
+				totalBytesWritten = fileData.length;
+				break;
+			case ZZCompressionMethod::deflated:
+			{
+				// unencrypted, deflated: inflate a buffer at a time, writing out each one before reusing it
+				z_stream inflateStream;
+				inflateStream.zalloc = Z_NULL;
+				inflateStream.zfree = Z_NULL;
+				inflateStream.opaque = Z_NULL;
+				inflateStream.next_in = (Bytef*)fileData.bytes;
+				inflateStream.avail_in = (uInt)fileData.length;
+				if (inflateInit2(&inflateStream, -15) != Z_OK)
+					return ZZRaiseError(error, ZZLocalFileReadErrorCode, nil);
+				z_stream* inflateStreamPointer = &inflateStream; // blocks capture structs by copy
+				ZZScopeGuard inflateEnder(^{inflateEnd(inflateStreamPointer);});
+				
+				int result;
+				do
+				{
+					inflateStream.next_out = bufferBytes;
+					inflateStream.avail_out = (uInt)_extractBufferLength;
+					result = inflate(&inflateStream, Z_NO_FLUSH);
+					if (result != Z_OK && result != Z_STREAM_END)
+						return ZZRaiseError(error, ZZLocalFileReadErrorCode, nil);
+					
+					// stop as soon as the entry inflates past its recorded size, before it can fill the disk
+					NSUInteger bytesInflated = _extractBufferLength - inflateStream.avail_out;
+					if (totalBytesWritten + bytesInflated > _centralFileHeader->uncompressedSize)
+						return ZZRaiseError(error, ZZLocalFileReadErrorCode, nil);
+					if (!writeFully(fileDescriptor, bufferBytes, bytesInflated))
+						return ZZRaiseError(error, ZZExtractWriteErrorCode, @{NSUnderlyingErrorKey : [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]});
+					crc = crc32(crc, bufferBytes, (uInt)bytesInflated);
+					totalBytesWritten += bytesInflated;
+				}
+				while (result != Z_STREAM_END);
+				break;
+			}
+			default:
+				return ZZRaiseError(error, ZZUnsupportedCompressionMethod, @{});
+		}
+	
+	// a short entry file is truncated or corrupt
+	if (totalBytesWritten != _centralFileHeader->uncompressedSize)
+		return ZZRaiseError(error, ZZLocalFileReadErrorCode, nil);
+	
+	// WinZip AES-2 entries record no checksum, their authentication code covers the data instead
+	BOOL hasChecksum = !(_encryptionMode == ZZEncryptionModeWinZipAES && _centralFileHeader->crc32 == 0);
+	if (hasChecksum && crc != _centralFileHeader->crc32)
+		return ZZRaiseError(error, ZZInvalidCRChecksum, @{});
+	
+	extracted = YES;
+	return YES;
+}
+
 - (CGDataProviderRef)newDataProviderWithPassword:(NSString*)password error:(out NSError**)error
 {
 	if (![self checkEncryptionAndCompression:error])
@@ -0,0 +1,215 @@
+//
+//  MKBase64.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKBase64.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MK_BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+/**Maps each character to its 6 bit value, or 0xFF if it is not in the alphabet.*/
+static const uint8_t MKBase64DecodeTable[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 62,   0xFF, 0xFF, 0xFF, 63,
+    52,   53,   54,   55,   56,   57,   58,   59,   60,   61,   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0,    1,    2,    3,    4,    5,    6,    7,    8,    9,    10,   11,   12,   13,   14,
+    15,   16,   17,   18,   19,   20,   21,   22,   23,   24,   25,   0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 26,   27,   28,   29,   30,   31,   32,   33,   34,   35,   36,   37,   38,   39,   40,
+    41,   42,   43,   44,   45,   46,   47,   48,   49,   50,   51,   0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/**Strips up to two padding characters. Returns 0 if no whole number of bytes is left.*/
+static int MKBase64StripPadding(const char *input, size_t *length)
+{
+    if (*length % 4 == 0 && *length >= 4) {
+        if (input[*length - 1] == '=') {
+            (*length)--;
+        }
+        if (input[*length - 1] == '=') {
+            (*length)--;
+        }
+    }
+    return *length % 4 != 1;
+}
+
+/**Decodes unpadded input one group of four characters at a time.*/
+static int MKBase64DecodeGroups(const uint8_t *in, size_t length, uint8_t *out, size_t *outputLength)
+{
+    uint8_t *start = out;
+    size_t i = 0;
+
+    //Whole groups of four characters.
+    for (; i + 4 <= length; i += 4) {
+        uint8_t a = MKBase64DecodeTable[in[i]];
+        uint8_t b = MKBase64DecodeTable[in[i + 1]];
+        uint8_t c = MKBase64DecodeTable[in[i + 2]];
+        uint8_t d = MKBase64DecodeTable[in[i + 3]];
+        //Valid values are below 64, so one test catches an invalid character anywhere in the group.
+        if ((a | b | c | d) & 0xC0) {
+            return 0;
+        }
+        uint32_t group = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | d;
+        *out++ = (uint8_t)(group >> 16);
+        *out++ = (uint8_t)(group >> 8);
+        *out++ = (uint8_t)group;
+    }
+
+    //The final two or three characters.
+    size_t remaining = length - i;
+    if (remaining >= 2) {
+        uint8_t a = MKBase64DecodeTable[in[i]];
+        uint8_t b = MKBase64DecodeTable[in[i + 1]];
+        uint8_t c = remaining == 3 ? MKBase64DecodeTable[in[i + 2]] : 0;
+        if ((a | b | c) & 0xC0) {
+            return 0;
+        }
+        uint32_t group = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6);
+        *out++ = (uint8_t)(group >> 16);
+        if (remaining == 3) {
+            *out++ = (uint8_t)(group >> 8);
+        }
+    }
+
+    *outputLength = (size_t)(out - start);
+    return 1;
+}
+
+int MKBase64DecodeScalar(const char *input, size_t length, uint8_t *output, size_t *outputLength)
+{
+    if (!MKBase64StripPadding(input, &length)) {
+        return 0;
+    }
+    return MKBase64DecodeGroups((const uint8_t *)input, length, output, outputLength);
+}
+
+#ifdef MK_BASE64_X86
+
+//The vector decoders translate 16 characters per lane with two nibble lookups (Wojciech Muła's method):
+//the low nibble selects which high nibbles are valid for it, the high nibble selects the offset to add.
+//Each block stores a whole vector, more than the 3/4 of its input it decodes, so the loops stop while the
+//output for the remaining characters could not take the store, and the scalar loop finishes the input.
+
+/**Decodes 16 characters per step with SSSE3. Returns the number of characters consumed, or SIZE_MAX on an invalid character.*/
+__attribute__((target("ssse3")))
+static size_t MKBase64DecodeSSSE3(const uint8_t *in, size_t length, uint8_t *out)
+{
+    const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+    //For each low nibble, a bit per high nibble that makes a character in the alphabet.
+    const __m128i validHighNibbles = _mm_setr_epi8((char)0xA8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m128i highNibbleBits = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+    //The offset from the character to its value, by high nibble. "/" shares a high nibble with "+" and is fixed up below.
+    const __m128i offsets = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i slashCorrection = _mm_set1_epi8(3);
+    const __m128i mergePairs = _mm_set1_epi32(0x01400140);
+    const __m128i mergeQuads = _mm_set1_epi32(0x00011000);
+    const __m128i packBytes = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t i = 0;
+    for (; i + 24 <= length; i += 16) {
+        __m128i characters = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i high = _mm_and_si128(_mm_srli_epi32(characters, 4), nibbleMask);
+        __m128i low = _mm_and_si128(characters, nibbleMask);
+        __m128i valid = _mm_and_si128(_mm_shuffle_epi8(validHighNibbles, low), _mm_shuffle_epi8(highNibbleBits, high));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(valid, _mm_setzero_si128()))) {
+            return SIZE_MAX;
+        }
+        __m128i offset = _mm_sub_epi8(_mm_shuffle_epi8(offsets, high), _mm_and_si128(_mm_cmpeq_epi8(characters, slash), slashCorrection));
+        __m128i values = _mm_add_epi8(characters, offset);
+        //Four 6 bit values to one 24 bit group per 32 bit lane, then the three bytes of each group in order.
+        __m128i groups = _mm_madd_epi16(_mm_maddubs_epi16(values, mergePairs), mergeQuads);
+        _mm_storeu_si128((__m128i *)(out + i / 4 * 3), _mm_shuffle_epi8(groups, packBytes));
+    }
+    return i;
+}
+
+/**Decodes 32 characters per step with AVX2. Returns the number of characters consumed, or SIZE_MAX on an invalid character.*/
+__attribute__((target("avx2")))
+static size_t MKBase64DecodeAVX2(const uint8_t *in, size_t length, uint8_t *out)
+{
+    //The same tables as MKBase64DecodeSSSE3, once per 128 bit lane.
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+    const __m256i validHighNibbles = _mm256_setr_epi8((char)0xA8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF0, 0x54, 0x50, 0x50, 0x50, 0x54,
+                                                      (char)0xA8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m256i highNibbleBits = _mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i offsets = _mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i slash = _mm256_set1_epi8('/');
+    const __m256i slashCorrection = _mm256_set1_epi8(3);
+    const __m256i mergePairs = _mm256_set1_epi32(0x01400140);
+    const __m256i mergeQuads = _mm256_set1_epi32(0x00011000);
+    const __m256i packBytes = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                               2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    //Moves the 12 bytes of the upper lane down next to those of the lower lane.
+    const __m256i packLanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+    size_t i = 0;
+    for (; i + 44 <= length; i += 32) {
+        __m256i characters = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i high = _mm256_and_si256(_mm256_srli_epi32(characters, 4), nibbleMask);
+        __m256i low = _mm256_and_si256(characters, nibbleMask);
+        __m256i valid = _mm256_and_si256(_mm256_shuffle_epi8(validHighNibbles, low), _mm256_shuffle_epi8(highNibbleBits, high));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(valid, _mm256_setzero_si256()))) {
+            return SIZE_MAX;
+        }
+        __m256i offset = _mm256_sub_epi8(_mm256_shuffle_epi8(offsets, high), _mm256_and_si256(_mm256_cmpeq_epi8(characters, slash), slashCorrection));
+        __m256i values = _mm256_add_epi8(characters, offset);
+        __m256i groups = _mm256_madd_epi16(_mm256_maddubs_epi16(values, mergePairs), mergeQuads);
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(groups, packBytes), packLanes);
+        _mm256_storeu_si256((__m256i *)(out + i / 4 * 3), packed);
+    }
+    return i;
+}
+
+#endif
+
+int MKBase64Decode(const char *input, size_t length, uint8_t *output, size_t *outputLength)
+{
+    if (!MKBase64StripPadding(input, &length)) {
+        return 0;
+    }
+
+    const uint8_t *in = (const uint8_t *)input;
+    size_t consumed = 0;
+#ifdef MK_BASE64_X86
+    if (__builtin_cpu_supports("avx2")) {
+        consumed = MKBase64DecodeAVX2(in, length, output);
+    } else if (__builtin_cpu_supports("ssse3")) {
+        consumed = MKBase64DecodeSSSE3(in, length, output);
+    }
+    if (consumed == SIZE_MAX) {
+        return 0;
+    }
+#endif
+
+    //Whatever the vector loop left, or everything without one.
+    size_t tailLength;
+    if (!MKBase64DecodeGroups(in + consumed, length - consumed, output + consumed / 4 * 3, &tailLength)) {
+        return 0;
+    }
+    *outputLength = consumed / 4 * 3 + tailLength;
+    return 1;
+}
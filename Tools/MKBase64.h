@@ -0,0 +1,46 @@
+//
+//  MKBase64.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKBase64_h
+#define M13MarketKit_MKBase64_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**The largest number of bytes the given number of base64 characters can decode to.*/
+#define MKBase64DecodedLength(length) ((((length) + 3) / 4) * 3)
+
+/**Decodes standard (RFC 4648) base64, as used for the "receipt-data" of a verifyReceipt request.
+ @note Padding is optional. Any character outside the alphabet, including whitespace, is an error. On x86 the bulk of the input is decoded with AVX2 or SSSE3 when the processor has them.
+ @param input The base64 characters.
+ @param length The number of characters.
+ @param output Receives the decoded bytes, must hold at least MKBase64DecodedLength(length) bytes.
+ @param outputLength Receives the number of decoded bytes.
+ @return 1 on success, 0 if the input is not valid base64.
+ */
+int MKBase64Decode(const char *input, size_t length, uint8_t *output, size_t *outputLength);
+
+/**Decodes base64 exactly as MKBase64Decode does, one group of four characters at a time. Kept as the reference the vector decoders are checked and measured against.*/
+int MKBase64DecodeScalar(const char *input, size_t length, uint8_t *output, size_t *outputLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,169 @@
+//
+//  MKBase64Benchmark.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//Benchmarks MKBase64Decode against MKBase64DecodeScalar on receipt sized inputs, after checking the two agree:
+//every length up to 200 characters, and every byte value at every position of a 96 character input, must give
+//the same result and the same bytes.
+//
+//Build and run on Linux from the repository root:
+//  cc -std=c99 -O2 -ITools Tools/MKBase64Benchmark.c Tools/MKBase64.c -o MKBase64Benchmark
+//  ./MKBase64Benchmark [encoded length ...]
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "MKBase64.h"
+
+#define kMKBenchmarkMinimumSeconds 0.3
+
+static const char MKBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static double MKBenchmarkNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**Encodes with padding. The output must hold ((length + 2) / 3) * 4 characters.*/
+static size_t MKBase64Encode(const uint8_t *bytes, size_t length, char *output)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t group = (uint32_t)bytes[i] << 16;
+        if (i + 1 < length) {
+            group |= (uint32_t)bytes[i + 1] << 8;
+        }
+        if (i + 2 < length) {
+            group |= bytes[i + 2];
+        }
+        output[count++] = MKBase64Alphabet[(group >> 18) & 0x3F];
+        output[count++] = MKBase64Alphabet[(group >> 12) & 0x3F];
+        output[count++] = i + 1 < length ? MKBase64Alphabet[(group >> 6) & 0x3F] : '=';
+        output[count++] = i + 2 < length ? MKBase64Alphabet[group & 0x3F] : '=';
+    }
+    return count;
+}
+
+/**Decodes with both decoders and reports whether they agree on the result and the bytes.*/
+static int MKDecodersAgree(const char *input, size_t length, uint8_t *scalarOutput, uint8_t *output)
+{
+    size_t scalarLength = 0;
+    size_t vectorLength = 0;
+    int scalarResult = MKBase64DecodeScalar(input, length, scalarOutput, &scalarLength);
+    int vectorResult = MKBase64Decode(input, length, output, &vectorLength);
+    if (scalarResult != vectorResult) {
+        return 0;
+    }
+    return !scalarResult || (scalarLength == vectorLength && memcmp(scalarOutput, output, scalarLength) == 0);
+}
+
+static int MKCheckDecoders(void)
+{
+    uint8_t bytes[150];
+    char encoded[200];
+    uint8_t scalarOutput[MKBase64DecodedLength(200)];
+    uint8_t output[MKBase64DecodedLength(200)];
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (uint8_t)(i * 151 + 7);
+    }
+
+    //Every length, padded and unpadded, so every split between the vector and scalar loops is covered.
+    MKBase64Encode(bytes, sizeof(bytes), encoded);
+    for (size_t length = 0; length <= sizeof(encoded); length++) {
+        if (!MKDecodersAgree(encoded, length, scalarOutput, output)) {
+            fprintf(stderr, "Decoders disagree at length %zu\n", length);
+            return 0;
+        }
+    }
+
+    //Every byte value at every position of an input long enough for the widest vector loop.
+    size_t length = MKBase64Encode(bytes, 72, encoded);
+    for (size_t position = 0; position < length; position++) {
+        char original = encoded[position];
+        for (int value = 0; value < 256; value++) {
+            encoded[position] = (char)value;
+            if (!MKDecodersAgree(encoded, length, scalarOutput, output)) {
+                fprintf(stderr, "Decoders disagree for byte 0x%02X at position %zu\n", value, position);
+                return 0;
+            }
+        }
+        encoded[position] = original;
+    }
+    return 1;
+}
+
+typedef int (*MKBase64Decoder)(const char *input, size_t length, uint8_t *output, size_t *outputLength);
+
+/**Returns the decoded megabytes per second.*/
+static double MKMeasure(MKBase64Decoder decoder, const char *input, size_t length, uint8_t *output)
+{
+    size_t iterations = 0;
+    size_t decodedLength = 0;
+    double start = MKBenchmarkNow();
+    double elapsed = 0.0;
+    do {
+        decoder(input, length, output, &decodedLength);
+        iterations++;
+        elapsed = MKBenchmarkNow() - start;
+    } while (elapsed < kMKBenchmarkMinimumSeconds);
+    return (double)(decodedLength * iterations) / elapsed / (1024.0 * 1024.0);
+}
+
+int main(int argc, char **argv)
+{
+    if (!MKCheckDecoders()) {
+        return 1;
+    }
+    printf("decoders agree on every length up to 200 and every byte at every position\n");
+
+    //A one purchase receipt, a typical one, and one with a long purchase history.
+    size_t defaultLengths[] = {5000, 20000, 400000, 4000000};
+    size_t lengthCount = argc > 1 ? (size_t)(argc - 1) : sizeof(defaultLengths) / sizeof(defaultLengths[0]);
+
+    printf("%-12s %14s %14s %8s\n", "characters", "scalar MB/s", "decode MB/s", "speedup");
+    for (size_t n = 0; n < lengthCount; n++) {
+        size_t length = argc > 1 ? strtoul(argv[n + 1], NULL, 10) : defaultLengths[n];
+        size_t byteCount = length / 4 * 3;
+        uint8_t *bytes = malloc(byteCount + 1);
+        char *encoded = malloc(length + 4);
+        uint8_t *output = malloc(MKBase64DecodedLength(length) + 1);
+        if (!bytes || !encoded || !output) {
+            free(bytes);
+            free(encoded);
+            free(output);
+            return 1;
+        }
+        srand(1);
+        for (size_t i = 0; i < byteCount; i++) {
+            bytes[i] = (uint8_t)rand();
+        }
+        size_t encodedLength = MKBase64Encode(bytes, byteCount, encoded);
+
+        double scalar = MKMeasure(MKBase64DecodeScalar, encoded, encodedLength, output);
+        double vector = MKMeasure(MKBase64Decode, encoded, encodedLength, output);
+        printf("%-12zu %14.1f %14.1f %7.2fx\n", encodedLength, scalar, vector, vector / scalar);
+
+        free(bytes);
+        free(encoded);
+        free(output);
+    }
+    return 0;
+}
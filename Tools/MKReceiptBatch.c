@@ -0,0 +1,904 @@
+//
+//  MKReceiptBatch.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//Validates receipts in bulk on Linux, with the same verifier and decoder the framework uses.
+//
+//Input is either a directory of receipt files (the DER encoded PKCS #7 container, as found at
+//appStoreReceiptURL, which are mapped read only), or NDJSON where each line holds a "receipt-data"
+//member with the base64 encoded receipt, as sent to verifyReceipt. Use "-" to read NDJSON from
+//standard input. A line may also hold a "device-identifier" member with the identifierForVendor
+//UUID string of the device the receipt came from, the receipt's hash is then checked against it.
+//
+//Build and run on Linux from the repository root:
+//  cc -std=c99 -O2 -pthread -IM13MarketKit -ITools Tools/MKReceiptBatch.c Tools/MKBase64.c Tools/MKSHA1.c M13MarketKit/MKReceiptVerifier.c M13MarketKit/MKReceiptDecoder.c M13MarketKit/MKReceiptArena.c M13MarketKit/MKReceiptContainer.c M13MarketKit/MKReceiptDate.c -lcrypto -o MKReceiptBatch
+//  ./MKReceiptBatch -r AppleIncRootCertificate.cer [-j threads] [-b bundle identifier] [-o] <directory | file.ndjson | ->
+//
+//With -o, one NDJSON result per receipt is written to standard output. The summary (receipts per
+//second and per stage latency percentiles) is always written to standard error.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/crypto.h>
+#include <openssl/pkcs7.h>
+#include <openssl/x509.h>
+
+#include "MKBase64.h"
+#include "MKReceiptContainer.h"
+#include "MKReceiptDecoder.h"
+#include "MKReceiptVerifier.h"
+#include "MKSHA1.h"
+
+//-------------------------------------------
+//Jobs
+//-------------------------------------------
+
+/**The stages a receipt goes through, each one is timed.*/
+typedef enum {
+    /**Reading the file, or decoding the base64 of an NDJSON line.*/
+    MKBatchStageLoad,
+    /**Parsing the PKCS #7 container.*/
+    MKBatchStageParse,
+    /**Verifying the signature and certificate chain.*/
+    MKBatchStageVerify,
+    /**Decoding the receipt payload.*/
+    MKBatchStageDecode,
+    MKBatchStageCount
+} MKBatchStage;
+
+static const char *MKBatchStageNames[MKBatchStageCount] = {"load", "parse", "verify", "decode"};
+
+typedef enum {
+    /**Not processed, the input stopped before the receipt was handed to a worker.*/
+    MKBatchResultPending,
+    MKBatchResultValid,
+    MKBatchResultUnreadable,
+    MKBatchResultMalformed,
+    MKBatchResultUnverified,
+    MKBatchResultWrongBundle,
+    MKBatchResultWrongDevice
+} MKBatchResult;
+
+static const char *MKBatchResultNames[] = {"pending", "valid", "unreadable", "malformed", "unverified", "wrong-bundle", "wrong-device"};
+
+typedef struct {
+    /**The file path, or NULL for an NDJSON line.*/
+    char *path;
+    /**The base64 receipt of an NDJSON line, freed once decoded.*/
+    char *encoded;
+    size_t encodedLength;
+    /**The device the receipt came from, if the NDJSON line named one.*/
+    uint8_t deviceIdentifier[MKReceiptDeviceIdentifierLength];
+    int hasDeviceIdentifier;
+    /**The line number or directory position, used to report the result.*/
+    size_t number;
+    MKBatchResult result;
+    size_t transactionCount;
+    /**The time spent in each stage, in nanoseconds. Stages that were not reached are 0.*/
+    uint64_t stageTimes[MKBatchStageCount];
+    /**Whether or not the stage was reached.*/
+    uint8_t stageReached[MKBatchStageCount];
+} MKBatchJob;
+
+/**The validation settings shared (read only) by every worker.*/
+typedef struct {
+    const MKReceiptVerifier *verifier;
+    const char *bundleIdentifier;
+    size_t bundleIdentifierLength;
+} MKBatchSettings;
+
+static uint64_t MKBatchNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint8_t *MKBatchReadFile(const char *path, size_t *length)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    uint8_t *bytes = NULL;
+    struct stat info;
+    if (fstat(fileno(fp), &info) == 0 && info.st_size > 0) {
+        bytes = malloc((size_t)info.st_size);
+        if (bytes && fread(bytes, 1, (size_t)info.st_size, fp) != (size_t)info.st_size) {
+            free(bytes);
+            bytes = NULL;
+        }
+        if (bytes) {
+            *length = (size_t)info.st_size;
+        }
+    }
+    fclose(fp);
+    return bytes;
+}
+
+/**The bytes of a receipt, either mapped read only from its file or decoded from base64 into the worker's scratch buffer.*/
+typedef struct {
+    uint8_t *bytes;
+    size_t length;
+    int mapped;
+} MKBatchBuffer;
+
+/**A worker's decode buffer, reused for every NDJSON receipt it handles and only grown for a larger one.*/
+typedef struct {
+    uint8_t *bytes;
+    size_t capacity;
+} MKBatchScratch;
+
+/**The device hash checks a worker collected, run together once there is one for each SHA-1 lane.*/
+typedef struct {
+    size_t count;
+    size_t lanes;
+    MKBatchJob *jobs[MKSHA1MaxLanes];
+    /**The opaque value followed by the bundle identifier data of each receipt, copied out as the receipt is released before the check runs. Reused, and only grown for a larger one.*/
+    uint8_t *bytes[MKSHA1MaxLanes];
+    size_t capacities[MKSHA1MaxLanes];
+    size_t opaqueValueLengths[MKSHA1MaxLanes];
+    size_t bundleIdentifierDataLengths[MKSHA1MaxLanes];
+    uint8_t hashes[MKSHA1MaxLanes][MKSHA1DigestLength];
+} MKBatchDeviceChecks;
+
+static int MKBatchMapFile(const char *path, MKBatchBuffer *buffer)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat info;
+    void *bytes = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        bytes = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (bytes == MAP_FAILED) {
+        return 0;
+    }
+    buffer->bytes = bytes;
+    buffer->length = (size_t)info.st_size;
+    buffer->mapped = 1;
+    return 1;
+}
+
+static int MKBatchDecodeBase64(const char *encoded, size_t length, MKBatchScratch *scratch, MKBatchBuffer *buffer)
+{
+    size_t capacity = MKBase64DecodedLength(length) + 1;
+    if (capacity > scratch->capacity) {
+        uint8_t *bytes = realloc(scratch->bytes, capacity);
+        if (!bytes) {
+            return 0;
+        }
+        scratch->bytes = bytes;
+        scratch->capacity = capacity;
+    }
+    buffer->bytes = scratch->bytes;
+    buffer->mapped = 0;
+    return MKBase64Decode(encoded, length, buffer->bytes, &buffer->length);
+}
+
+static void MKBatchBufferRelease(MKBatchBuffer *buffer)
+{
+    //Decoded receipts stay in the scratch buffer for the next one.
+    if (buffer->mapped) {
+        munmap(buffer->bytes, buffer->length);
+    }
+    buffer->bytes = NULL;
+}
+
+/**Queues the device hash check of a decoded receipt.
+ @return 0 if the receipt can not be from the device, 1 if it was queued or checked right away and matches.
+ */
+static int MKBatchQueueDeviceCheck(MKBatchDeviceChecks *checks, MKBatchJob *job, const uint8_t *content, const MKReceiptPayload *payload)
+{
+    if (payload->sha1Hash.length != MKSHA1DigestLength) {
+        return 0;
+    }
+    const uint8_t *opaqueValue = MKReceiptRangeBytes(content, payload->opaqueValue);
+    const uint8_t *bundleIdentifierData = MKReceiptRangeBytes(content, payload->bundleIdentifierData);
+    size_t i = checks->count;
+    size_t length = payload->opaqueValue.length + payload->bundleIdentifierData.length;
+    if (length > checks->capacities[i]) {
+        uint8_t *bytes = realloc(checks->bytes[i], length);
+        if (!bytes) {
+            //No room to keep it for later, check it on its own.
+            return MKReceiptVerifierCheckDeviceHash(job->deviceIdentifier, opaqueValue, payload->opaqueValue.length, bundleIdentifierData, payload->bundleIdentifierData.length, MKReceiptRangeBytes(content, payload->sha1Hash), payload->sha1Hash.length);
+        }
+        checks->bytes[i] = bytes;
+        checks->capacities[i] = length;
+    }
+    if (payload->opaqueValue.length) {
+        memcpy(checks->bytes[i], opaqueValue, payload->opaqueValue.length);
+    }
+    if (payload->bundleIdentifierData.length) {
+        memcpy(checks->bytes[i] + payload->opaqueValue.length, bundleIdentifierData, payload->bundleIdentifierData.length);
+    }
+    checks->opaqueValueLengths[i] = payload->opaqueValue.length;
+    checks->bundleIdentifierDataLengths[i] = payload->bundleIdentifierData.length;
+    memcpy(checks->hashes[i], MKReceiptRangeBytes(content, payload->sha1Hash), MKSHA1DigestLength);
+    checks->jobs[i] = job;
+    checks->count++;
+    return 1;
+}
+
+/**Hashes the queued receipts side by side, one per SHA-1 lane, and marks those whose hash does not match their device.*/
+static void MKBatchRunDeviceChecks(MKBatchDeviceChecks *checks)
+{
+    MKSHA1Message messages[MKSHA1MaxLanes];
+    uint8_t digests[MKSHA1MaxLanes][MKSHA1DigestLength];
+    for (size_t i = 0; i < checks->count; i++) {
+        MKSHA1Message message = {{checks->jobs[i]->deviceIdentifier, checks->bytes[i], checks->bytes[i] + checks->opaqueValueLengths[i]}, {MKReceiptDeviceIdentifierLength, checks->opaqueValueLengths[i], checks->bundleIdentifierDataLengths[i]}};
+        messages[i] = message;
+    }
+    MKSHA1HashMessages(messages, checks->count, digests);
+    for (size_t i = 0; i < checks->count; i++) {
+        if (CRYPTO_memcmp(digests[i], checks->hashes[i], MKSHA1DigestLength) != 0) {
+            checks->jobs[i]->result = MKBatchResultWrongDevice;
+        }
+    }
+    checks->count = 0;
+}
+
+/**Runs one receipt through every stage, the same checks applicationReceiptAtPath: makes. The device hash check is queued, and runs with those of other receipts.*/
+static void MKBatchProcessJob(MKBatchJob *job, const MKBatchSettings *settings, MKBatchScratch *scratch, MKBatchDeviceChecks *checks)
+{
+    uint64_t start = MKBatchNow();
+    MKBatchBuffer buffer;
+    int loaded;
+    job->stageReached[MKBatchStageLoad] = 1;
+    if (job->path) {
+        loaded = MKBatchMapFile(job->path, &buffer);
+    } else {
+        loaded = MKBatchDecodeBase64(job->encoded, job->encodedLength, scratch, &buffer);
+        free(job->encoded);
+        job->encoded = NULL;
+    }
+    uint64_t end = MKBatchNow();
+    job->stageTimes[MKBatchStageLoad] = end - start;
+    if (!loaded) {
+        job->result = MKBatchResultUnreadable;
+        return;
+    }
+
+    start = end;
+    job->stageReached[MKBatchStageParse] = 1;
+    //Locate the pieces in place, only containers the parser does not handle are decoded by OpenSSL.
+    MKReceiptContainer container;
+    PKCS7 *p7 = NULL;
+    int parsed = MKReceiptContainerParse(buffer.bytes, buffer.length, &container);
+    int isSignedData = parsed;
+    if (!parsed) {
+        const uint8_t *p = buffer.bytes;
+        p7 = d2i_PKCS7(NULL, &p, (long)buffer.length);
+        isSignedData = p7 && PKCS7_type_is_signed(p7) && PKCS7_type_is_data(p7->d.sign->contents) && p7->d.sign->contents->d.data;
+    }
+    end = MKBatchNow();
+    job->stageTimes[MKBatchStageParse] = end - start;
+    if (!isSignedData) {
+        job->result = MKBatchResultMalformed;
+        PKCS7_free(p7);
+        MKBatchBufferRelease(&buffer);
+        return;
+    }
+
+    start = end;
+    job->stageReached[MKBatchStageVerify] = 1;
+    int verified = parsed ? MKReceiptVerifierVerifyContainer(settings->verifier, buffer.bytes, buffer.length, &container) : MKReceiptVerifierVerify(settings->verifier, p7);
+    end = MKBatchNow();
+    job->stageTimes[MKBatchStageVerify] = end - start;
+    if (!verified) {
+        job->result = MKBatchResultUnverified;
+        PKCS7_free(p7);
+        MKBatchBufferRelease(&buffer);
+        return;
+    }
+
+    start = end;
+    job->stageReached[MKBatchStageDecode] = 1;
+
+    const uint8_t *content;
+    size_t contentLength;
+    if (parsed) {
+        content = MKReceiptRangeBytes(buffer.bytes, container.content);
+        contentLength = container.content.length;
+    } else {
+        content = p7->d.sign->contents->d.data->data;
+        contentLength = (size_t)p7->d.sign->contents->d.data->length;
+    }
+
+    MKReceiptPayload payload;
+    MKReceiptDecodeStatus status = MKReceiptPayloadDecode(content, contentLength, &payload);
+    if (status != MKReceiptDecodeStatusSuccess) {
+        job->result = MKBatchResultMalformed;
+    } else if (settings->bundleIdentifier && (payload.bundleIdentifier.length != settings->bundleIdentifierLength || memcmp(MKReceiptRangeBytes(content, payload.bundleIdentifier), settings->bundleIdentifier, settings->bundleIdentifierLength) != 0)) {
+        job->result = MKBatchResultWrongBundle;
+    } else if (job->hasDeviceIdentifier && !MKBatchQueueDeviceCheck(checks, job, content, &payload)) {
+        job->result = MKBatchResultWrongDevice;
+    } else {
+        //Until the queued device check, if any, says otherwise.
+        job->result = MKBatchResultValid;
+    }
+    job->transactionCount = payload.transactionCount;
+    MKReceiptPayloadFree(&payload);
+    job->stageTimes[MKBatchStageDecode] = MKBatchNow() - start;
+
+    PKCS7_free(p7);
+    MKBatchBufferRelease(&buffer);
+}
+
+//-------------------------------------------
+//Work stealing pool
+//-------------------------------------------
+
+/**A worker's deque. The owner takes from the tail, idle workers steal from the head.*/
+typedef struct {
+    pthread_mutex_t lock;
+    MKBatchJob **jobs;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} MKBatchDeque;
+
+typedef struct MKBatchPool MKBatchPool;
+
+typedef struct {
+    MKBatchPool *pool;
+    size_t index;
+    pthread_t thread;
+    MKBatchDeque deque;
+    MKBatchScratch scratch;
+    MKBatchDeviceChecks checks;
+    size_t processed;
+    size_t stolen;
+} MKBatchWorker;
+
+struct MKBatchPool {
+    MKBatchWorker *workers;
+    size_t workerCount;
+    const MKBatchSettings *settings;
+    /**Guards the counters below, and lets idle workers sleep until there is work.*/
+    pthread_mutex_t lock;
+    pthread_cond_t condition;
+    size_t queued;
+    int inputFinished;
+    /**The next deque the producer pushes to.*/
+    size_t nextWorker;
+};
+
+static int MKBatchDequePush(MKBatchDeque *deque, MKBatchJob *job)
+{
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail == deque->capacity) {
+        //Slide the live jobs down before growing.
+        size_t count = deque->tail - deque->head;
+        if (deque->head > 0 && count < deque->capacity / 2) {
+            memmove(deque->jobs, deque->jobs + deque->head, count * sizeof(MKBatchJob *));
+        } else {
+            size_t capacity = deque->capacity ? deque->capacity * 2 : 64;
+            MKBatchJob **jobs = malloc(capacity * sizeof(MKBatchJob *));
+            if (!jobs) {
+                pthread_mutex_unlock(&deque->lock);
+                return 0;
+            }
+            if (count) {
+                memcpy(jobs, deque->jobs + deque->head, count * sizeof(MKBatchJob *));
+            }
+            free(deque->jobs);
+            deque->jobs = jobs;
+            deque->capacity = capacity;
+        }
+        deque->head = 0;
+        deque->tail = count;
+    }
+    deque->jobs[deque->tail++] = job;
+    pthread_mutex_unlock(&deque->lock);
+    return 1;
+}
+
+static MKBatchJob *MKBatchDequePop(MKBatchDeque *deque, int steal)
+{
+    MKBatchJob *job = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        job = steal ? deque->jobs[deque->head++] : deque->jobs[--deque->tail];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return job;
+}
+
+static MKBatchJob *MKBatchWorkerTake(MKBatchWorker *worker)
+{
+    MKBatchPool *pool = worker->pool;
+    MKBatchJob *job = MKBatchDequePop(&worker->deque, 0);
+
+    //Out of local work, steal from the others starting with the next worker over.
+    for (size_t i = 1; !job && i < pool->workerCount; i++) {
+        job = MKBatchDequePop(&pool->workers[(worker->index + i) % pool->workerCount].deque, 1);
+        if (job) {
+            worker->stolen++;
+        }
+    }
+    if (job) {
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return job;
+}
+
+static void *MKBatchWorkerRun(void *context)
+{
+    MKBatchWorker *worker = context;
+    MKBatchPool *pool = worker->pool;
+
+    for (;;) {
+        MKBatchJob *job = MKBatchWorkerTake(worker);
+        if (job) {
+            MKBatchProcessJob(job, pool->settings, &worker->scratch, &worker->checks);
+            worker->processed++;
+            if (worker->checks.count == worker->checks.lanes) {
+                MKBatchRunDeviceChecks(&worker->checks);
+            }
+            continue;
+        }
+
+        //Run the checks of a partial batch rather than keep them while waiting.
+        if (worker->checks.count > 0) {
+            MKBatchRunDeviceChecks(&worker->checks);
+        }
+
+        //Nothing anywhere, sleep until the producer adds more or finishes.
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queued == 0 && !pool->inputFinished) {
+            pthread_cond_wait(&pool->condition, &pool->lock);
+        }
+        int finished = pool->queued == 0 && pool->inputFinished;
+        pthread_mutex_unlock(&pool->lock);
+        if (finished) {
+            free(worker->scratch.bytes);
+            for (size_t i = 0; i < MKSHA1MaxLanes; i++) {
+                free(worker->checks.bytes[i]);
+            }
+            return NULL;
+        }
+    }
+}
+
+static int MKBatchPoolSubmit(MKBatchPool *pool, MKBatchJob *job)
+{
+    MKBatchWorker *worker = &pool->workers[pool->nextWorker];
+    pool->nextWorker = (pool->nextWorker + 1) % pool->workerCount;
+
+    //Count the job under the same lock it is published under. A thief takes the pool lock to uncount it, so it can not get there first and wrap the counter.
+    pthread_mutex_lock(&pool->lock);
+    if (!MKBatchDequePush(&worker->deque, job)) {
+        pthread_mutex_unlock(&pool->lock);
+        return 0;
+    }
+    pool->queued++;
+    pthread_cond_signal(&pool->condition);
+    pthread_mutex_unlock(&pool->lock);
+    return 1;
+}
+
+static void MKBatchPoolFinishInput(MKBatchPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->inputFinished = 1;
+    pthread_cond_broadcast(&pool->condition);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+//-------------------------------------------
+//Input
+//-------------------------------------------
+
+/**Keeps every job so the results can be reported in input order.*/
+typedef struct {
+    MKBatchJob **jobs;
+    size_t count;
+    size_t capacity;
+} MKBatchJobList;
+
+static MKBatchJob *MKBatchJobListAdd(MKBatchJobList *list)
+{
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        MKBatchJob **jobs = realloc(list->jobs, capacity * sizeof(MKBatchJob *));
+        if (!jobs) {
+            return NULL;
+        }
+        list->jobs = jobs;
+        list->capacity = capacity;
+    }
+    MKBatchJob *job = calloc(1, sizeof(MKBatchJob));
+    if (job) {
+        list->jobs[list->count++] = job;
+    }
+    return job;
+}
+
+static int MKBatchSubmitDirectory(MKBatchPool *pool, MKBatchJobList *list, const char *directoryPath)
+{
+    DIR *directory = opendir(directoryPath);
+    if (!directory) {
+        fprintf(stderr, "Could not open %s\n", directoryPath);
+        return 0;
+    }
+
+    int submitted = 1;
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        size_t length = strlen(directoryPath) + strlen(entry->d_name) + 2;
+        char *path = malloc(length);
+        if (!path) {
+            submitted = 0;
+            break;
+        }
+        snprintf(path, length, "%s/%s", directoryPath, entry->d_name);
+
+        struct stat info;
+        if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+            free(path);
+            continue;
+        }
+
+        MKBatchJob *job = MKBatchJobListAdd(list);
+        if (!job) {
+            free(path);
+            submitted = 0;
+            break;
+        }
+        job->path = path;
+        job->number = list->count;
+        if (!MKBatchPoolSubmit(pool, job)) {
+            submitted = 0;
+            break;
+        }
+    }
+    closedir(directory);
+    if (!submitted) {
+        fprintf(stderr, "Out of memory, stopped reading %s\n", directoryPath);
+    }
+    return submitted;
+}
+
+/**Finds the string member with the given quoted name in a line and copies it out, dropping JSON escapes (base64 only ever escapes "/").*/
+static char *MKBatchStringFromLine(const char *line, const char *name, size_t *length)
+{
+    const char *key = strstr(line, name);
+    if (!key) {
+        return NULL;
+    }
+    const char *p = key + strlen(name);
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (*p++ != ':') {
+        return NULL;
+    }
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (*p++ != '"') {
+        return NULL;
+    }
+
+    const char *end = p;
+    while (*end && *end != '"') {
+        end += (*end == '\\' && end[1]) ? 2 : 1;
+    }
+    if (*end != '"') {
+        return NULL;
+    }
+
+    char *value = malloc((size_t)(end - p) + 1);
+    if (!value) {
+        return NULL;
+    }
+    size_t count = 0;
+    for (; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        }
+        value[count++] = *p;
+    }
+    value[count] = '\0';
+    *length = count;
+    return value;
+}
+
+/**Reads a UUID string, "E621E1F8-C36C-495A-93FC-0C247A3E6E5F", into its bytes.*/
+static int MKBatchParseDeviceIdentifier(const char *string, size_t length, uint8_t *bytes)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (string[i] == '-' && (i == 8 || i == 13 || i == 18 || i == 23)) {
+            continue;
+        }
+        char c = string[i];
+        int value = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (value < 0 || count == 2 * MKReceiptDeviceIdentifierLength) {
+            return 0;
+        }
+        bytes[count / 2] = (uint8_t)(count % 2 ? (bytes[count / 2] | value) : value << 4);
+        count++;
+    }
+    return count == 2 * MKReceiptDeviceIdentifierLength;
+}
+
+static int MKBatchSubmitStream(MKBatchPool *pool, MKBatchJobList *list, FILE *stream)
+{
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    size_t lineNumber = 0;
+    int submitted = 1;
+    while (getline(&line, &lineCapacity, stream) != -1) {
+        lineNumber++;
+        size_t length = 0;
+        char *encoded = MKBatchStringFromLine(line, "\"receipt-data\"", &length);
+        if (!encoded && strspn(line, " \t\r\n") == strlen(line)) {
+            //Blank line.
+            continue;
+        }
+
+        MKBatchJob *job = MKBatchJobListAdd(list);
+        if (!job) {
+            free(encoded);
+            submitted = 0;
+            break;
+        }
+        job->number = lineNumber;
+        if (!encoded) {
+            job->result = MKBatchResultUnreadable;
+            continue;
+        }
+        size_t deviceLength = 0;
+        char *device = MKBatchStringFromLine(line, "\"device-identifier\"", &deviceLength);
+        if (device) {
+            job->hasDeviceIdentifier = 1;
+            int readable = MKBatchParseDeviceIdentifier(device, deviceLength, job->deviceIdentifier);
+            free(device);
+            if (!readable) {
+                job->result = MKBatchResultUnreadable;
+                free(encoded);
+                continue;
+            }
+        }
+        job->encoded = encoded;
+        job->encodedLength = length;
+        if (!MKBatchPoolSubmit(pool, job)) {
+            submitted = 0;
+            break;
+        }
+    }
+    free(line);
+    if (!submitted) {
+        fprintf(stderr, "Out of memory, stopped reading the input at line %zu\n", lineNumber);
+    }
+    return submitted;
+}
+
+//-------------------------------------------
+//Report
+//-------------------------------------------
+
+static int MKBatchCompareTimes(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double MKBatchPercentile(const uint64_t *sorted, size_t count, double percentile)
+{
+    size_t index = (size_t)(percentile / 100.0 * (double)(count - 1) + 0.5);
+    return (double)sorted[index] / 1000.0;
+}
+
+static void MKBatchReportStages(const MKBatchJobList *list)
+{
+    uint64_t *times = malloc((list->count ? list->count : 1) * sizeof(uint64_t));
+    if (!times) {
+        return;
+    }
+
+    fprintf(stderr, "%-8s %10s %10s %10s %10s %10s  (microseconds)\n", "stage", "count", "p50", "p90", "p99", "max");
+    for (int stage = 0; stage < MKBatchStageCount; stage++) {
+        size_t count = 0;
+        for (size_t i = 0; i < list->count; i++) {
+            if (list->jobs[i]->stageReached[stage]) {
+                times[count++] = list->jobs[i]->stageTimes[stage];
+            }
+        }
+        if (count == 0) {
+            fprintf(stderr, "%-8s %10zu\n", MKBatchStageNames[stage], count);
+            continue;
+        }
+        qsort(times, count, sizeof(uint64_t), MKBatchCompareTimes);
+        fprintf(stderr, "%-8s %10zu %10.1f %10.1f %10.1f %10.1f\n", MKBatchStageNames[stage], count, MKBatchPercentile(times, count, 50), MKBatchPercentile(times, count, 90), MKBatchPercentile(times, count, 99), (double)times[count - 1] / 1000.0);
+    }
+    free(times);
+}
+
+/**Writes a string as a JSON string literal.*/
+static void MKBatchPrintJSONString(const char *string)
+{
+    putchar('"');
+    for (const unsigned char *c = (const unsigned char *)string; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            printf("\\%c", *c);
+        } else if (*c < 0x20) {
+            printf("\\u%04x", *c);
+        } else {
+            putchar(*c);
+        }
+    }
+    putchar('"');
+}
+
+static void MKBatchUsage(const char *name)
+{
+    fprintf(stderr, "usage: %s -r root-certificate.cer [-j threads] [-b bundle-identifier] [-o] <directory | file.ndjson | ->\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *rootPath = NULL;
+    const char *bundleIdentifier = NULL;
+    long threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    int printResults = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "r:j:b:o")) != -1) {
+        switch (option) {
+            case 'r':
+                rootPath = optarg;
+                break;
+            case 'j':
+                threadCount = strtol(optarg, NULL, 10);
+                break;
+            case 'b':
+                bundleIdentifier = optarg;
+                break;
+            case 'o':
+                printResults = 1;
+                break;
+            default:
+                MKBatchUsage(argv[0]);
+                return 2;
+        }
+    }
+    if (!rootPath || optind != argc - 1) {
+        MKBatchUsage(argv[0]);
+        return 2;
+    }
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    const char *input = argv[optind];
+
+    size_t rootLength = 0;
+    uint8_t *rootCertificate = MKBatchReadFile(rootPath, &rootLength);
+    MKReceiptVerifier *verifier = rootCertificate ? MKReceiptVerifierCreate(rootCertificate, rootLength) : NULL;
+    free(rootCertificate);
+    if (!verifier) {
+        fprintf(stderr, "Could not load the root certificate %s\n", rootPath);
+        return 2;
+    }
+
+    MKBatchSettings settings = {verifier, bundleIdentifier, bundleIdentifier ? strlen(bundleIdentifier) : 0};
+    MKBatchPool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.settings = &settings;
+    pool.workerCount = (size_t)threadCount;
+    pool.workers = calloc(pool.workerCount, sizeof(MKBatchWorker));
+    if (!pool.workers) {
+        MKReceiptVerifierFree(verifier);
+        return 2;
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.condition, NULL);
+
+    uint64_t start = MKBatchNow();
+    for (size_t i = 0; i < pool.workerCount; i++) {
+        pool.workers[i].pool = &pool;
+        pool.workers[i].index = i;
+        pool.workers[i].checks.lanes = MKSHA1LaneCount();
+        pthread_mutex_init(&pool.workers[i].deque.lock, NULL);
+    }
+    for (size_t i = 0; i < pool.workerCount; i++) {
+        pthread_create(&pool.workers[i].thread, NULL, MKBatchWorkerRun, &pool.workers[i]);
+    }
+
+    //Workers start on the first receipts while the rest of the input is still being read.
+    MKBatchJobList list = {NULL, 0, 0};
+    struct stat info;
+    int submitted;
+    if (strcmp(input, "-") == 0) {
+        submitted = MKBatchSubmitStream(&pool, &list, stdin);
+    } else if (stat(input, &info) == 0 && S_ISDIR(info.st_mode)) {
+        submitted = MKBatchSubmitDirectory(&pool, &list, input);
+    } else {
+        FILE *stream = fopen(input, "r");
+        submitted = stream && MKBatchSubmitStream(&pool, &list, stream);
+        if (stream) {
+            fclose(stream);
+        } else {
+            fprintf(stderr, "Could not open %s\n", input);
+        }
+    }
+    MKBatchPoolFinishInput(&pool);
+
+    size_t stolen = 0;
+    for (size_t i = 0; i < pool.workerCount; i++) {
+        pthread_join(pool.workers[i].thread, NULL);
+        stolen += pool.workers[i].stolen;
+    }
+    double elapsed = (double)(MKBatchNow() - start) / 1e9;
+
+    size_t resultCounts[sizeof(MKBatchResultNames) / sizeof(MKBatchResultNames[0])] = {0};
+    for (size_t i = 0; i < list.count; i++) {
+        MKBatchJob *job = list.jobs[i];
+        resultCounts[job->result]++;
+        if (printResults) {
+            if (job->path) {
+                printf("{\"file\":");
+                MKBatchPrintJSONString(job->path);
+                printf(",\"status\":\"%s\",\"transactions\":%zu}\n", MKBatchResultNames[job->result], job->transactionCount);
+            } else {
+                printf("{\"line\":%zu,\"status\":\"%s\",\"transactions\":%zu}\n", job->number, MKBatchResultNames[job->result], job->transactionCount);
+            }
+        }
+    }
+
+    fprintf(stderr, "%zu receipts in %.3f s on %zu threads: %.1f receipts/s (%zu stolen)\n", list.count, elapsed, pool.workerCount, elapsed > 0 ? (double)list.count / elapsed : 0.0, stolen);
+    for (size_t i = 0; i < sizeof(resultCounts) / sizeof(resultCounts[0]); i++) {
+        fprintf(stderr, "  %-13s %zu\n", MKBatchResultNames[i], resultCounts[i]);
+    }
+    MKBatchReportStages(&list);
+
+    for (size_t i = 0; i < list.count; i++) {
+        free(list.jobs[i]->path);
+        free(list.jobs[i]->encoded);
+        free(list.jobs[i]);
+    }
+    free(list.jobs);
+    for (size_t i = 0; i < pool.workerCount; i++) {
+        pthread_mutex_destroy(&pool.workers[i].deque.lock);
+        free(pool.workers[i].deque.jobs);
+    }
+    free(pool.workers);
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.condition);
+    MKReceiptVerifierFree(verifier);
+
+    return submitted ? 0 : 1;
+}
@@ -0,0 +1,1050 @@
+//
+//  MKReceiptBenchmark.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//Benchmark and fuzz regression suite for the receipt decoder.
+//
+//bench: decodes synthetic receipts of 1, 100, 10k and 100k transactions (or the sizes given with -s)
+//       and reports throughput, allocations per transaction and peak RSS for each stage:
+//         decode    MKReceiptPayloadDecode, what receiptsFromInAppPurchaseData: used to do
+//         index     decode + MKReceiptIndexBuild
+//         arena     index, with the payload and the index in one arena sized from the payload and released at once,
+//                   the way MKApplicationReceipt allocates
+//         dates     decode + MKReceiptDateParse of every transaction date
+//         pkcs7     d2i_PKCS7 + MKReceiptVerifierVerify + in place decode, the path for containers the parser rejects
+//         container MKReceiptContainerParse + MKReceiptVerifierVerifyContainer + in place decode, one after the other
+//         pipelined container, with the decode on a second thread while the signature is verified, what
+//                   applicationReceiptAtPath: does. All three sign with a root, intermediate and signing
+//                   certificate generated at start up, and embed all three
+//fuzz:  mutates small synthetic receipts with a fixed seed and decodes each one. Results are checked
+//       against a port of the original ASN1_get_object walker (strings and data only, integers are now
+//       read big endian and field 21 is new; untouched seeds must match it exactly), and folded into a digest that must match
+//       kMKFuzzExpectedDigest. A decoder change that alters any result changes the digest.
+//
+//Build and run on Linux from the repository root (add -fsanitize=address,undefined for fuzzing):
+//  cc -std=c99 -O2 -IM13MarketKit -pthread Tools/MKReceiptBenchmark.c M13MarketKit/MKReceiptDecoder.c M13MarketKit/MKReceiptArena.c M13MarketKit/MKReceiptIndex.c M13MarketKit/MKReceiptDate.c M13MarketKit/MKReceiptVerifier.c M13MarketKit/MKReceiptContainer.c -lcrypto -o MKReceiptBenchmark
+//  ./MKReceiptBenchmark [-s 1,100,10000,100000] [-n fuzz cases] [bench | fuzz]
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <openssl/evp.h>
+#include <openssl/pkcs7.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include "MKReceiptContainer.h"
+#include "MKReceiptDate.h"
+#include "MKReceiptDecoder.h"
+#include "MKReceiptIndex.h"
+#include "MKReceiptVerifier.h"
+
+#define kMKFuzzSeed 0x4D4B524346555A5AULL
+#define kMKFuzzDefaultCases 50000
+#define kMKFuzzExpectedDigest 0xdd68af6d3f6c2107ULL
+#define kMKBenchmarkMinimumSeconds 0.3
+
+//-------------------------------------------
+//Allocation counting
+//-------------------------------------------
+
+static size_t MKAllocationCount = 0;
+
+//Sanitizers replace the allocator themselves, so allocations are only counted without them.
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define kMKCountAllocations 1
+#else
+#define kMKCountAllocations 0
+#endif
+
+#if kMKCountAllocations
+//Count every allocation made by the decoder and OpenSSL by interposing the allocator.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size)
+{
+    MKAllocationCount++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    MKAllocationCount++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    MKAllocationCount++;
+    return __libc_realloc(pointer, size);
+}
+#endif
+
+static double MKBenchmarkNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static long MKPeakResidentKilobytes(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+//-------------------------------------------
+//Synthetic receipts
+//-------------------------------------------
+
+typedef struct {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+} MKBuffer;
+
+static void MKBufferAppend(MKBuffer *buffer, const void *bytes, size_t length)
+{
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 256;
+        while (capacity < buffer->length + length) {
+            capacity *= 2;
+        }
+        buffer->bytes = realloc(buffer->bytes, capacity);
+        if (!buffer->bytes) {
+            fprintf(stderr, "Out of memory.\n");
+            exit(2);
+        }
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+/**Appends a DER element with the given contents.*/
+static void MKBufferAppendElement(MKBuffer *buffer, uint8_t tag, const MKBuffer *contents)
+{
+    uint8_t header[6];
+    size_t headerLength = 0;
+    header[headerLength++] = tag;
+    if (contents->length < 0x80) {
+        header[headerLength++] = (uint8_t)contents->length;
+    } else {
+        size_t count = contents->length > 0xFFFFFF ? 4 : (contents->length > 0xFFFF ? 3 : (contents->length > 0xFF ? 2 : 1));
+        header[headerLength++] = (uint8_t)(0x80 | count);
+        for (size_t i = count; i-- > 0;) {
+            header[headerLength++] = (uint8_t)(contents->length >> (8 * i));
+        }
+    }
+    MKBufferAppend(buffer, header, headerLength);
+    MKBufferAppend(buffer, contents->bytes, contents->length);
+}
+
+static void MKBufferAppendInteger(MKBuffer *buffer, uint64_t value)
+{
+    uint8_t bytes[9];
+    size_t length = 0;
+    //Minimal big endian, with a leading zero if the top bit is set.
+    int started = 0;
+    for (int i = 7; i >= 0; i--) {
+        uint8_t byte = (uint8_t)(value >> (8 * i));
+        if (!started && byte == 0 && i > 0) {
+            continue;
+        }
+        if (!started && (byte & 0x80)) {
+            bytes[length++] = 0;
+        }
+        started = 1;
+        bytes[length++] = byte;
+    }
+    MKBuffer contents = {bytes, length, length};
+    MKBufferAppendElement(buffer, 0x02, &contents);
+}
+
+/**Appends SEQUENCE { type INTEGER, 1 INTEGER, value OCTET STRING }.*/
+static void MKBufferAppendAttribute(MKBuffer *buffer, uint64_t type, const MKBuffer *value)
+{
+    MKBuffer sequence = {NULL, 0, 0};
+    MKBufferAppendInteger(&sequence, type);
+    MKBufferAppendInteger(&sequence, 1);
+    MKBufferAppendElement(&sequence, 0x04, value);
+    MKBufferAppendElement(buffer, 0x30, &sequence);
+    free(sequence.bytes);
+}
+
+static void MKBufferAppendStringAttribute(MKBuffer *buffer, uint64_t type, uint8_t tag, const char *string)
+{
+    MKBuffer contents = {(uint8_t *)string, strlen(string), strlen(string)};
+    MKBuffer value = {NULL, 0, 0};
+    MKBufferAppendElement(&value, tag, &contents);
+    MKBufferAppendAttribute(buffer, type, &value);
+    free(value.bytes);
+}
+
+static void MKBufferAppendIntegerAttribute(MKBuffer *buffer, uint64_t type, uint64_t integer)
+{
+    MKBuffer value = {NULL, 0, 0};
+    MKBufferAppendInteger(&value, integer);
+    MKBufferAppendAttribute(buffer, type, &value);
+    free(value.bytes);
+}
+
+static void MKFormatDate(char *string, size_t size, int64_t seconds)
+{
+    time_t time = (time_t)seconds;
+    struct tm components;
+    gmtime_r(&time, &components);
+    strftime(string, size, "%Y-%m-%dT%H:%M:%SZ", &components);
+}
+
+/**Builds a receipt payload with the given number of in app purchases. Every seventh is canceled and every third is a subscription.*/
+static MKBuffer MKSyntheticPayload(size_t transactionCount)
+{
+    MKBuffer attributes = {NULL, 0, 0};
+    uint8_t opaque[16], hash[20];
+    memset(opaque, 0x01, sizeof(opaque));
+    memset(hash, 0x02, sizeof(hash));
+    MKBuffer opaqueValue = {opaque, sizeof(opaque), sizeof(opaque)};
+    MKBuffer hashValue = {hash, sizeof(hash), sizeof(hash)};
+
+    MKBufferAppendStringAttribute(&attributes, 2, 0x0C, "com.BrandonMcQuilkin.WhatsMyStageOn");
+    MKBufferAppendStringAttribute(&attributes, 3, 0x0C, "4.0.0");
+    MKBufferAppendAttribute(&attributes, 4, &opaqueValue);
+    MKBufferAppendAttribute(&attributes, 5, &hashValue);
+    MKBufferAppendStringAttribute(&attributes, 19, 0x0C, "1.0");
+
+    for (size_t i = 0; i < transactionCount; i++) {
+        char string[64];
+        int64_t purchased = 1402949884 + (int64_t)i * 3600;
+        MKBuffer fields = {NULL, 0, 0};
+        MKBufferAppendIntegerAttribute(&fields, 1701, 1 + i % 3);
+        snprintf(string, sizeof(string), "com.example.product%zu", i % 50);
+        MKBufferAppendStringAttribute(&fields, 1702, 0x0C, string);
+        snprintf(string, sizeof(string), "%zu", 1000000000 + i);
+        MKBufferAppendStringAttribute(&fields, 1703, 0x0C, string);
+        MKBufferAppendStringAttribute(&fields, 1705, 0x0C, string);
+        MKFormatDate(string, sizeof(string), purchased);
+        MKBufferAppendStringAttribute(&fields, 1704, 0x16, string);
+        MKBufferAppendStringAttribute(&fields, 1706, 0x16, string);
+        if (i % 3 == 0) {
+            MKFormatDate(string, sizeof(string), purchased + 30 * 86400);
+            MKBufferAppendStringAttribute(&fields, 1708, 0x16, string);
+        }
+        MKBufferAppendIntegerAttribute(&fields, 1711, 1000000 + i);
+        if (i % 7 == 0) {
+            MKFormatDate(string, sizeof(string), purchased + 86400);
+            MKBufferAppendStringAttribute(&fields, 1712, 0x16, string);
+        }
+
+        MKBuffer set = {NULL, 0, 0};
+        MKBufferAppendElement(&set, 0x31, &fields);
+        MKBufferAppendAttribute(&attributes, 17, &set);
+        free(fields.bytes);
+        free(set.bytes);
+    }
+
+    MKBuffer payload = {NULL, 0, 0};
+    MKBufferAppendElement(&payload, 0x31, &attributes);
+    free(attributes.bytes);
+    return payload;
+}
+
+//-------------------------------------------
+//Signing
+//-------------------------------------------
+
+/**A generated root, intermediate and signing certificate with their keys, standing in for Apple's.*/
+typedef struct {
+    EVP_PKEY *keys[3];
+    X509 *certificates[3];
+    uint8_t *certificateBytes;
+    size_t certificateLength;
+} MKSigningIdentity;
+
+/**The positions of the certificates in MKSigningIdentity.*/
+enum {
+    MKSigningRoot,
+    MKSigningIntermediate,
+    MKSigningLeaf
+};
+
+static EVP_PKEY *MKSigningKeyCreate(void)
+{
+    EVP_PKEY *key = NULL;
+    EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+    if (!context || EVP_PKEY_keygen_init(context) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(context, 2048) <= 0 || EVP_PKEY_keygen(context, &key) <= 0) {
+        key = NULL;
+    }
+    EVP_PKEY_CTX_free(context);
+    return key;
+}
+
+/**Creates a certificate for the key, issued by the given certificate and key, or self signed if there is no issuer.*/
+static X509 *MKSigningCertificateCreate(const char *commonName, long serial, int authority, EVP_PKEY *key, X509 *issuer, EVP_PKEY *issuerKey)
+{
+    X509 *certificate = X509_new();
+    if (!certificate) {
+        return NULL;
+    }
+    X509_set_version(certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), serial);
+    X509_gmtime_adj(X509_get_notBefore(certificate), -86400);
+    X509_gmtime_adj(X509_get_notAfter(certificate), 86400L * 365);
+    X509_NAME *name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)commonName, -1, -1, 0);
+    X509_set_issuer_name(certificate, issuer ? X509_get_subject_name(issuer) : name);
+    X509_set_pubkey(certificate, key);
+
+    X509V3_CTX extensionContext;
+    X509V3_set_ctx(&extensionContext, issuer ? issuer : certificate, certificate, NULL, NULL, 0);
+    X509_EXTENSION *constraints = X509V3_EXT_conf_nid(NULL, &extensionContext, NID_basic_constraints, authority ? "critical,CA:TRUE" : "critical,CA:FALSE");
+    int added = constraints && X509_add_ext(certificate, constraints, -1);
+    X509_EXTENSION_free(constraints);
+    if (!added || !X509_sign(certificate, issuerKey ? issuerKey : key, EVP_sha256())) {
+        X509_free(certificate);
+        return NULL;
+    }
+    return certificate;
+}
+
+static int MKSigningIdentityCreate(MKSigningIdentity *identity)
+{
+    static const char *commonNames[3] = {"MKReceiptBenchmark Root", "MKReceiptBenchmark Intermediate", "MKReceiptBenchmark Signer"};
+    memset(identity, 0, sizeof(MKSigningIdentity));
+    for (int i = MKSigningRoot; i <= MKSigningLeaf; i++) {
+        X509 *issuer = i == MKSigningRoot ? NULL : identity->certificates[i - 1];
+        EVP_PKEY *issuerKey = i == MKSigningRoot ? NULL : identity->keys[i - 1];
+        identity->keys[i] = MKSigningKeyCreate();
+        identity->certificates[i] = identity->keys[i] ? MKSigningCertificateCreate(commonNames[i], i + 1, i != MKSigningLeaf, identity->keys[i], issuer, issuerKey) : NULL;
+        if (!identity->certificates[i]) {
+            return 0;
+        }
+    }
+
+    unsigned char *der = NULL;
+    int length = i2d_X509(identity->certificates[MKSigningRoot], &der);
+    if (length <= 0) {
+        return 0;
+    }
+    identity->certificateBytes = der;
+    identity->certificateLength = (size_t)length;
+    return 1;
+}
+
+static void MKSigningIdentityFree(MKSigningIdentity *identity)
+{
+    OPENSSL_free(identity->certificateBytes);
+    for (int i = MKSigningRoot; i <= MKSigningLeaf; i++) {
+        X509_free(identity->certificates[i]);
+        EVP_PKEY_free(identity->keys[i]);
+    }
+}
+
+/**Wraps a payload in a PKCS #7 signed data container, without signed attributes and with the whole chain embedded, as in App Store receipts.*/
+static MKBuffer MKSignPayload(const MKSigningIdentity *identity, const MKBuffer *payload)
+{
+    MKBuffer container = {NULL, 0, 0};
+    BIO *input = BIO_new_mem_buf(payload->bytes, (int)payload->length);
+    STACK_OF(X509) *chain = sk_X509_new_null();
+    sk_X509_push(chain, identity->certificates[MKSigningIntermediate]);
+    sk_X509_push(chain, identity->certificates[MKSigningRoot]);
+    PKCS7 *p7 = PKCS7_sign(identity->certificates[MKSigningLeaf], identity->keys[MKSigningLeaf], chain, input, PKCS7_BINARY | PKCS7_NOATTR);
+    sk_X509_free(chain);
+    BIO_free(input);
+    unsigned char *der = NULL;
+    int length = p7 ? i2d_PKCS7(p7, &der) : 0;
+    if (length > 0) {
+        MKBufferAppend(&container, der, (size_t)length);
+    }
+    OPENSSL_free(der);
+    PKCS7_free(p7);
+    return container;
+}
+
+//-------------------------------------------
+//Benchmark
+//-------------------------------------------
+
+typedef enum {
+    MKStageDecode,
+    MKStageIndex,
+    MKStageArena,
+    MKStageDates,
+    MKStagePKCS7,
+    MKStageContainer,
+    MKStagePipelined,
+    MKStageCount
+} MKStage;
+
+static const char *MKStageNames[MKStageCount] = {"decode", "index", "arena", "dates", "pkcs7", "container", "pipelined"};
+
+typedef struct {
+    const MKBuffer *payload;
+    const MKBuffer *container;
+    const MKReceiptVerifier *verifier;
+} MKStageInput;
+
+static double MKDatesChecksum = 0.0;
+
+static void MKParseDate(const uint8_t *bytes, MKReceiptRange range)
+{
+    double seconds;
+    if (range.length && MKReceiptDateParse(MKReceiptRangeBytes(bytes, range), range.length, &seconds)) {
+        MKDatesChecksum += seconds;
+    }
+}
+
+typedef struct {
+    const uint8_t *bytes;
+    size_t length;
+    MKReceiptPayload payload;
+    MKReceiptDecodeStatus status;
+} MKSpeculativeDecode;
+
+static void *MKSpeculativeDecodeRun(void *argument)
+{
+    MKSpeculativeDecode *decode = argument;
+    decode->status = MKReceiptPayloadDecode(decode->bytes, decode->length, &decode->payload);
+    return NULL;
+}
+
+/**Verifies the container while its content is decoded on another thread. Returns the number of transactions decoded, or 0 on failure.*/
+static size_t MKRunPipelinedStage(const MKStageInput *input)
+{
+    MKReceiptContainer container;
+    if (!MKReceiptContainerParse(input->container->bytes, input->container->length, &container)) {
+        return 0;
+    }
+
+    MKSpeculativeDecode decode;
+    memset(&decode, 0, sizeof(decode));
+    decode.bytes = MKReceiptRangeBytes(input->container->bytes, container.content);
+    decode.length = container.content.length;
+    pthread_t thread;
+    int started = pthread_create(&thread, NULL, MKSpeculativeDecodeRun, &decode) == 0;
+    if (!started) {
+        MKSpeculativeDecodeRun(&decode);
+    }
+    int verified = MKReceiptVerifierVerifyContainer(input->verifier, input->container->bytes, input->container->length, &container);
+    if (started) {
+        pthread_join(thread, NULL);
+    }
+
+    size_t count = 0;
+    if (verified && decode.status == MKReceiptDecodeStatusSuccess) {
+        count = decode.payload.transactionCount ? decode.payload.transactionCount : 1;
+    }
+    MKReceiptPayloadFree(&decode.payload);
+    return count;
+}
+
+/**Decodes and indexes the payload in an arena, then releases it in one go. Returns the number of transactions decoded, or 0 on failure.*/
+static size_t MKRunArenaStage(const MKStageInput *input)
+{
+    MKReceiptArena *arena = MKReceiptArenaCreate(input->payload->length / 2);
+    if (!arena) {
+        return 0;
+    }
+
+    MKReceiptPayload payload;
+    size_t count = 0;
+    if (MKReceiptPayloadDecodeInArena(input->payload->bytes, input->payload->length, arena, &payload) == MKReceiptDecodeStatusSuccess) {
+        MKReceiptIndex index;
+        if (MKReceiptIndexBuild(&index, input->payload->bytes, &payload)) {
+            count = payload.transactionCount ? payload.transactionCount : 1;
+        }
+    }
+    MKReceiptPayloadFree(&payload);
+    return count;
+}
+
+/**Runs a stage once. Returns the number of transactions decoded, or 0 on failure.*/
+static size_t MKRunStage(MKStage stage, const MKStageInput *input)
+{
+    const uint8_t *bytes = input->payload->bytes;
+    size_t length = input->payload->length;
+    PKCS7 *p7 = NULL;
+
+    if (stage == MKStagePipelined) {
+        return MKRunPipelinedStage(input);
+    } else if (stage == MKStageArena) {
+        return MKRunArenaStage(input);
+    } else if (stage == MKStagePKCS7) {
+        const uint8_t *p = input->container->bytes;
+        p7 = d2i_PKCS7(NULL, &p, (long)input->container->length);
+        MKReceiptRange content;
+        if (!p7 || !MKReceiptVerifierVerify(input->verifier, p7) || !MKReceiptContainerLocateContent(input->container->bytes, input->container->length, &content)) {
+            PKCS7_free(p7);
+            return 0;
+        }
+        bytes = MKReceiptRangeBytes(input->container->bytes, content);
+        length = content.length;
+    } else if (stage == MKStageContainer) {
+        MKReceiptContainer container;
+        if (!MKReceiptContainerParse(input->container->bytes, input->container->length, &container) || !MKReceiptVerifierVerifyContainer(input->verifier, input->container->bytes, input->container->length, &container)) {
+            return 0;
+        }
+        bytes = MKReceiptRangeBytes(input->container->bytes, container.content);
+        length = container.content.length;
+    }
+
+    MKReceiptPayload payload;
+    size_t count = 0;
+    if (MKReceiptPayloadDecode(bytes, length, &payload) == MKReceiptDecodeStatusSuccess) {
+        count = payload.transactionCount ? payload.transactionCount : 1;
+        if (stage == MKStageIndex) {
+            MKReceiptIndex index;
+            if (MKReceiptIndexBuild(&index, bytes, &payload)) {
+                MKReceiptIndexFree(&index);
+            } else {
+                count = 0;
+            }
+        } else if (stage == MKStageDates) {
+            for (size_t i = 0; i < payload.transactionCount; i++) {
+                MKParseDate(bytes, payload.transactions[i].purchaseDate);
+                MKParseDate(bytes, payload.transactions[i].originalPurchaseDate);
+                MKParseDate(bytes, payload.transactions[i].subscriptionExpirationDate);
+                MKParseDate(bytes, payload.transactions[i].cancellationDate);
+            }
+        }
+    }
+    MKReceiptPayloadFree(&payload);
+    PKCS7_free(p7);
+    return count;
+}
+
+static int MKRunBenchmark(const size_t *sizes, size_t sizeCount)
+{
+    MKSigningIdentity identity;
+    if (!MKSigningIdentityCreate(&identity)) {
+        fprintf(stderr, "Could not create a signing identity.\n");
+        return 1;
+    }
+    MKReceiptVerifier *verifier = MKReceiptVerifierCreate(identity.certificateBytes, identity.certificateLength);
+    if (!verifier) {
+        fprintf(stderr, "Could not create a verifier.\n");
+        MKSigningIdentityFree(&identity);
+        return 1;
+    }
+
+    printf("%-12s %-10s %12s %14s %10s %12s %12s\n", "transactions", "stage", "payload KB", "txn/s", "MB/s", "allocs/txn", "peak RSS KB");
+    int failed = 0;
+    for (size_t s = 0; s < sizeCount; s++) {
+        MKBuffer payload = MKSyntheticPayload(sizes[s]);
+        MKBuffer container = MKSignPayload(&identity, &payload);
+        MKStageInput input = {&payload, &container, verifier};
+
+        for (int stage = 0; stage < MKStageCount; stage++) {
+            //The first run counts allocations, then repeat until the timing is stable.
+            size_t before = MKAllocationCount;
+            size_t transactions = MKRunStage((MKStage)stage, &input);
+            size_t allocations = MKAllocationCount - before;
+            if (transactions == 0) {
+                printf("%-12zu %-10s failed\n", sizes[s], MKStageNames[stage]);
+                failed = 1;
+                continue;
+            }
+
+            size_t iterations = 0;
+            double start = MKBenchmarkNow();
+            double elapsed = 0.0;
+            do {
+                MKRunStage((MKStage)stage, &input);
+                iterations++;
+                elapsed = MKBenchmarkNow() - start;
+            } while (elapsed < kMKBenchmarkMinimumSeconds);
+
+            double perSecond = (double)(transactions * iterations) / elapsed;
+            double bytesPerSecond = (double)(payload.length * iterations) / elapsed;
+            double allocationsPerTransaction = kMKCountAllocations ? (double)allocations / (double)transactions : -1.0;
+            printf("%-12zu %-10s %12.1f %14.0f %10.1f %12.2f %12ld\n", sizes[s], MKStageNames[stage], payload.length / 1024.0, perSecond, bytesPerSecond / (1024.0 * 1024.0), allocationsPerTransaction, MKPeakResidentKilobytes());
+        }
+
+        free(payload.bytes);
+        free(container.bytes);
+    }
+
+    MKReceiptVerifierFree(verifier);
+    MKSigningIdentityFree(&identity);
+    return failed;
+}
+
+//-------------------------------------------
+//Reference walker
+//-------------------------------------------
+
+//The original walker, ported from MKReceiptValidator.m with ASN1_get_object replaced by a bounds
+//checked reader. Any read the original would have made past the end marks the result unusable.
+
+typedef struct {
+    MKReceiptRange productIdentifier;
+    MKReceiptRange transactionIdentifier;
+    MKReceiptRange originalTransactionIdentifier;
+    MKReceiptRange purchaseDate;
+    MKReceiptRange originalPurchaseDate;
+    MKReceiptRange subscriptionExpirationDate;
+    MKReceiptRange cancellationDate;
+} MKReferenceTransaction;
+
+typedef struct {
+    MKReceiptRange bundleIdentifier;
+    MKReceiptRange bundleIdentifierData;
+    MKReceiptRange applicationVersion;
+    MKReceiptRange opaqueValue;
+    MKReceiptRange sha1Hash;
+    MKReceiptRange originalApplicationVersion;
+    MKReferenceTransaction *transactions;
+    size_t transactionCount;
+    /**0 if the original walker would have read out of bounds or stopped early.*/
+    int clean;
+} MKReferenceReceipt;
+
+/**Mirrors ASN1_get_object: the tag number without class, and the contents length.*/
+static int MKReferenceGetObject(const uint8_t **p, const uint8_t *end, int *type, size_t *length)
+{
+    const uint8_t *cursor = *p;
+    if (end - cursor < 2 || (cursor[0] & 0x1F) == 0x1F) {
+        return 0;
+    }
+    *type = cursor[0] & 0x1F;
+    size_t len = cursor[1];
+    cursor += 2;
+    if (len == 0x80) {
+        return 0;
+    }
+    if (len & 0x80) {
+        size_t count = len & 0x7F;
+        if (count > 4 || (size_t)(end - cursor) < count) {
+            return 0;
+        }
+        len = 0;
+        while (count--) {
+            len = (len << 8) | *cursor++;
+        }
+    }
+    if (len > (size_t)(end - cursor)) {
+        return 0;
+    }
+    *p = cursor;
+    *length = len;
+    return 1;
+}
+
+static MKReceiptRange MKReferenceRange(const uint8_t *base, const uint8_t *p, size_t length)
+{
+    MKReceiptRange range = {(uint32_t)(p - base), (uint32_t)length};
+    return range;
+}
+
+static void MKReferenceInAppPurchases(const uint8_t *base, const uint8_t *p, const uint8_t *end, MKReferenceReceipt *receipt)
+{
+    int type;
+    size_t length;
+    while (p < end) {
+        if (!MKReferenceGetObject(&p, end, &type, &length)) {
+            receipt->clean = 0;
+            return;
+        }
+        const uint8_t *setEnd = p + length;
+        if (type != 17) {
+            receipt->clean = 0;
+            return;
+        }
+        MKReferenceTransaction item;
+        memset(&item, 0, sizeof(item));
+
+        while (p < setEnd) {
+            if (!MKReferenceGetObject(&p, setEnd, &type, &length) || type != 16) {
+                receipt->clean = 0;
+                return;
+            }
+            const uint8_t *seqEnd = p + length;
+            int attributeType = 0;
+
+            if (!MKReferenceGetObject(&p, seqEnd, &type, &length)) {
+                receipt->clean = 0;
+                return;
+            }
+            if (type == 2) {
+                if (length == 1) {
+                    attributeType = p[0];
+                } else if (length == 2) {
+                    attributeType = p[0] * 0x100 + p[1];
+                }
+            }
+            p += length;
+            if (!MKReferenceGetObject(&p, seqEnd, &type, &length)) {
+                receipt->clean = 0;
+                return;
+            }
+            p += length;
+
+            if (attributeType == 1702 || attributeType == 1703 || attributeType == 1705 || attributeType == 1704 || attributeType == 1706 || attributeType == 1708 || attributeType == 1712) {
+                if (!MKReferenceGetObject(&p, seqEnd, &type, &length)) {
+                    receipt->clean = 0;
+                    return;
+                }
+                if (type == 4) {
+                    const uint8_t *string = p;
+                    int stringType;
+                    size_t stringLength;
+                    if (MKReferenceGetObject(&string, seqEnd, &stringType, &stringLength)) {
+                        MKReceiptRange range = MKReferenceRange(base, string, stringLength);
+                        if (stringType == 12 && attributeType == 1702) {
+                            item.productIdentifier = range;
+                        } else if (stringType == 12 && attributeType == 1703) {
+                            item.transactionIdentifier = range;
+                        } else if (stringType == 12 && attributeType == 1705) {
+                            item.originalTransactionIdentifier = range;
+                        } else if (stringType == 22 && attributeType == 1704) {
+                            item.purchaseDate = range;
+                        } else if (stringType == 22 && attributeType == 1706) {
+                            item.originalPurchaseDate = range;
+                        } else if (stringType == 22 && attributeType == 1708) {
+                            item.subscriptionExpirationDate = range;
+                        } else if (stringType == 22 && attributeType == 1712) {
+                            item.cancellationDate = range;
+                        }
+                    } else {
+                        receipt->clean = 0;
+                        return;
+                    }
+                }
+                p += length;
+            }
+            p = seqEnd;
+        }
+        p = setEnd;
+
+        MKReferenceTransaction *transactions = realloc(receipt->transactions, (receipt->transactionCount + 1) * sizeof(MKReferenceTransaction));
+        if (!transactions) {
+            receipt->clean = 0;
+            return;
+        }
+        receipt->transactions = transactions;
+        receipt->transactions[receipt->transactionCount++] = item;
+    }
+}
+
+static void MKReferenceDecode(const uint8_t *bytes, size_t length, MKReferenceReceipt *receipt)
+{
+    memset(receipt, 0, sizeof(MKReferenceReceipt));
+    receipt->clean = 1;
+    const uint8_t *p = bytes;
+    const uint8_t *end = bytes + length;
+    int type;
+    size_t objectLength;
+    if (!MKReferenceGetObject(&p, end, &type, &objectLength) || type != 17) {
+        receipt->clean = 0;
+        return;
+    }
+    //The original walked to the end of the buffer, not the end of the set.
+    while (p < end && receipt->clean) {
+        if (!MKReferenceGetObject(&p, end, &type, &objectLength) || type != 16) {
+            receipt->clean = 0;
+            return;
+        }
+        const uint8_t *seqEnd = p + objectLength;
+        int attributeType = 0;
+        if (!MKReferenceGetObject(&p, seqEnd, &type, &objectLength)) {
+            receipt->clean = 0;
+            return;
+        }
+        if (type == 2 && objectLength == 1) {
+            attributeType = p[0];
+        }
+        p += objectLength;
+        if (!MKReferenceGetObject(&p, seqEnd, &type, &objectLength)) {
+            receipt->clean = 0;
+            return;
+        }
+        p += objectLength;
+
+        if (attributeType == 2 || attributeType == 3 || attributeType == 4 || attributeType == 5 || attributeType == 17 || attributeType == 19) {
+            if (!MKReferenceGetObject(&p, seqEnd, &type, &objectLength)) {
+                receipt->clean = 0;
+                return;
+            }
+            if (type == 4) {
+                MKReceiptRange data = MKReferenceRange(bytes, p, objectLength);
+                if (attributeType == 2) {
+                    receipt->bundleIdentifierData = data;
+                } else if (attributeType == 4) {
+                    receipt->opaqueValue = data;
+                } else if (attributeType == 5) {
+                    receipt->sha1Hash = data;
+                }
+                if (attributeType == 2 || attributeType == 3 || attributeType == 19) {
+                    const uint8_t *string = p;
+                    int stringType;
+                    size_t stringLength;
+                    if (!MKReferenceGetObject(&string, seqEnd, &stringType, &stringLength)) {
+                        receipt->clean = 0;
+                        return;
+                    }
+                    if (stringType == 12) {
+                        MKReceiptRange range = MKReferenceRange(bytes, string, stringLength);
+                        if (attributeType == 2) {
+                            receipt->bundleIdentifier = range;
+                        } else if (attributeType == 3) {
+                            receipt->applicationVersion = range;
+                        } else {
+                            receipt->originalApplicationVersion = range;
+                        }
+                    }
+                }
+                if (attributeType == 17) {
+                    MKReferenceInAppPurchases(bytes, p, p + objectLength, receipt);
+                }
+            }
+            p += objectLength;
+        }
+        p = seqEnd;
+    }
+}
+
+//-------------------------------------------
+//Fuzzing
+//-------------------------------------------
+
+static uint64_t MKFuzzNext(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/**Applies one to four random mutations in place. Returns the new length, never more than capacity.*/
+static size_t MKFuzzMutate(uint8_t *bytes, size_t length, size_t capacity, uint64_t *state)
+{
+    int mutations = 1 + (int)(MKFuzzNext(state) % 4);
+    for (int m = 0; m < mutations && length > 0; m++) {
+        size_t position = (size_t)(MKFuzzNext(state) % length);
+        switch (MKFuzzNext(state) % 6) {
+            case 0:
+                //Flip a bit.
+                bytes[position] ^= (uint8_t)(1u << (MKFuzzNext(state) % 8));
+                break;
+            case 1:
+                //Replace a byte with an interesting value.
+            {
+                static const uint8_t values[] = {0x00, 0x01, 0x7F, 0x80, 0x81, 0x82, 0x84, 0xFF, 0x30, 0x31, 0x04, 0x02, 0x0C, 0x16};
+                bytes[position] = values[MKFuzzNext(state) % sizeof(values)];
+                break;
+            }
+            case 2:
+                //Truncate.
+                length = position;
+                break;
+            case 3:
+                //Delete a run of bytes.
+            {
+                size_t count = 1 + (size_t)(MKFuzzNext(state) % 8);
+                if (count > length - position) {
+                    count = length - position;
+                }
+                memmove(bytes + position, bytes + position + count, length - position - count);
+                length -= count;
+                break;
+            }
+            case 4:
+                //Duplicate a run of bytes.
+            {
+                size_t count = 1 + (size_t)(MKFuzzNext(state) % 16);
+                if (count > length - position) {
+                    count = length - position;
+                }
+                if (length + count <= capacity) {
+                    memmove(bytes + position + count, bytes + position, length - position);
+                    length += count;
+                }
+                break;
+            }
+            default:
+                //Randomize a byte.
+                bytes[position] = (uint8_t)MKFuzzNext(state);
+                break;
+        }
+    }
+    return length;
+}
+
+static uint64_t MKDigestUpdate(uint64_t digest, const void *bytes, size_t length)
+{
+    const uint8_t *p = bytes;
+    for (size_t i = 0; i < length; i++) {
+        digest ^= p[i];
+        digest *= 1099511628211ULL;
+    }
+    return digest;
+}
+
+static uint64_t MKDigestRange(uint64_t digest, MKReceiptRange range)
+{
+    uint32_t values[2] = {range.offset, range.length};
+    return MKDigestUpdate(digest, values, sizeof(values));
+}
+
+static int MKRangesMatch(MKReceiptRange a, MKReceiptRange b)
+{
+    return a.offset == b.offset && a.length == b.length;
+}
+
+static int MKRunFuzz(size_t caseCount)
+{
+    uint64_t state = kMKFuzzSeed;
+    uint64_t digest = 14695981039346656037ULL;
+    size_t decoded = 0, compared = 0, mismatched = 0, seedMismatched = 0;
+
+    MKBuffer seeds[4];
+    size_t seedSizes[4] = {0, 1, 3, 12};
+    size_t capacity = 0;
+    for (size_t i = 0; i < 4; i++) {
+        seeds[i] = MKSyntheticPayload(seedSizes[i]);
+        if (seeds[i].length > capacity) {
+            capacity = seeds[i].length;
+        }
+    }
+    capacity *= 2;
+    uint8_t *bytes = malloc(capacity);
+
+    for (size_t c = 0; c < caseCount; c++) {
+        //Case 0 to 3 are the untouched seeds, the reference must agree with them exactly.
+        const MKBuffer *seed = &seeds[c % 4];
+        memcpy(bytes, seed->bytes, seed->length);
+        size_t length = c < 4 ? seed->length : MKFuzzMutate(bytes, seed->length, capacity, &state);
+
+        //Decode from an exact size copy so the sanitizers catch any read past the end.
+        uint8_t *exact = malloc(length ? length : 1);
+        memcpy(exact, bytes, length);
+
+        MKReceiptPayload payload;
+        MKReceiptDecodeStatus status = MKReceiptPayloadDecode(exact, length, &payload);
+        digest = MKDigestUpdate(digest, &status, sizeof(status));
+        if (status == MKReceiptDecodeStatusSuccess) {
+            decoded++;
+            const MKReceiptRange ranges[] = {payload.bundleIdentifier, payload.bundleIdentifierData, payload.applicationVersion, payload.opaqueValue, payload.sha1Hash, payload.originalApplicationVersion, payload.receiptExpirationDate};
+            for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+                digest = MKDigestRange(digest, ranges[i]);
+            }
+            for (size_t i = 0; i < payload.transactionCount; i++) {
+                const MKReceiptTransaction *t = &payload.transactions[i];
+                const MKReceiptRange transactionRanges[] = {t->productIdentifier, t->transactionIdentifier, t->originalTransactionIdentifier, t->purchaseDate, t->originalPurchaseDate, t->subscriptionExpirationDate, t->cancellationDate};
+                for (size_t j = 0; j < sizeof(transactionRanges) / sizeof(transactionRanges[0]); j++) {
+                    digest = MKDigestRange(digest, transactionRanges[j]);
+                }
+                digest = MKDigestUpdate(digest, &t->quantity, sizeof(t->quantity));
+                digest = MKDigestUpdate(digest, &t->webOrderLineItemIdentifier, sizeof(t->webOrderLineItemIdentifier));
+            }
+
+            MKReferenceReceipt reference;
+            MKReferenceDecode(exact, length, &reference);
+            if (reference.clean) {
+                compared++;
+                int match = reference.transactionCount == payload.transactionCount && MKRangesMatch(reference.bundleIdentifier, payload.bundleIdentifier) && MKRangesMatch(reference.bundleIdentifierData, payload.bundleIdentifierData) && MKRangesMatch(reference.applicationVersion, payload.applicationVersion) && MKRangesMatch(reference.opaqueValue, payload.opaqueValue) && MKRangesMatch(reference.sha1Hash, payload.sha1Hash) && MKRangesMatch(reference.originalApplicationVersion, payload.originalApplicationVersion);
+                for (size_t i = 0; match && i < payload.transactionCount; i++) {
+                    const MKReceiptTransaction *t = &payload.transactions[i];
+                    const MKReferenceTransaction *r = &reference.transactions[i];
+                    match = MKRangesMatch(r->productIdentifier, t->productIdentifier) && MKRangesMatch(r->transactionIdentifier, t->transactionIdentifier) && MKRangesMatch(r->originalTransactionIdentifier, t->originalTransactionIdentifier) && MKRangesMatch(r->purchaseDate, t->purchaseDate) && MKRangesMatch(r->originalPurchaseDate, t->originalPurchaseDate) && MKRangesMatch(r->subscriptionExpirationDate, t->subscriptionExpirationDate) && MKRangesMatch(r->cancellationDate, t->cancellationDate);
+                }
+                if (!match) {
+                    //The decoder checks tags exactly and the walker ignored the class bits, so mutated
+                    //receipts may legitimately differ. The untouched seeds must always agree.
+                    mismatched++;
+                    if (c < 4) {
+                        fprintf(stderr, "Seed %zu differs from the reference walker.\n", c);
+                        seedMismatched++;
+                    }
+                }
+            }
+            free(reference.transactions);
+        }
+        MKReceiptPayloadFree(&payload);
+        free(exact);
+    }
+
+    free(bytes);
+    for (size_t i = 0; i < 4; i++) {
+        free(seeds[i].bytes);
+    }
+
+    printf("fuzz cases:   %zu (seed %#llx)\n", caseCount, (unsigned long long)kMKFuzzSeed);
+    printf("decoded:      %zu\n", decoded);
+    printf("compared:     %zu with the reference walker, %zu differ\n", compared, mismatched);
+    printf("digest:       %#018llx\n", (unsigned long long)digest);
+
+    int failed = seedMismatched > 0;
+    if (caseCount == kMKFuzzDefaultCases && digest != kMKFuzzExpectedDigest) {
+        printf("The digest does not match %#018llx, the decoder behaves differently.\n", (unsigned long long)kMKFuzzExpectedDigest);
+        failed = 1;
+    }
+    return failed;
+}
+
+//-------------------------------------------
+//Main
+//-------------------------------------------
+
+int main(int argc, char **argv)
+{
+    size_t sizes[16] = {1, 100, 10000, 100000};
+    size_t sizeCount = 4;
+    size_t caseCount = kMKFuzzDefaultCases;
+    int bench = 1, fuzz = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            sizeCount = 0;
+            char *cursor = argv[++i];
+            while (*cursor && sizeCount < sizeof(sizes) / sizeof(sizes[0])) {
+                sizes[sizeCount++] = strtoul(cursor, &cursor, 10);
+                if (*cursor == ',') {
+                    cursor++;
+                }
+            }
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            caseCount = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "bench") == 0) {
+            fuzz = 0;
+        } else if (strcmp(argv[i], "fuzz") == 0) {
+            bench = 0;
+        } else {
+            fprintf(stderr, "usage: %s [-s 1,100,10000,100000] [-n fuzz cases] [bench | fuzz]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int failed = 0;
+    if (fuzz) {
+        failed |= MKRunFuzz(caseCount);
+    }
+    if (bench) {
+        failed |= MKRunBenchmark(sizes, sizeCount);
+    }
+    return failed;
+}
@@ -0,0 +1,165 @@
+//
+//  MKReceiptDateBenchmark.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//Benchmarks MKReceiptDateParse against a strptime/timegm parser that follows the old
+//NSDateFormatter path (copy, upper case, then try each format in turn).
+//
+//Build and run on Linux from the repository root:
+//  cc -std=c99 -O2 -IM13MarketKit Tools/MKReceiptDateBenchmark.c M13MarketKit/MKReceiptDate.c -o MKReceiptDateBenchmark
+//  ./MKReceiptDateBenchmark [transaction count]
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "MKReceiptDate.h"
+
+#define kMKDatesPerTransaction 4
+#define kMKMaxDateLength 40
+
+static double MKBenchmarkNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**The baseline: a heap copy of the string, upper cased, then each format tried until one parses.*/
+static int MKBaselineParse(const char *string, double *seconds)
+{
+    static const char *formats[] = {"%Y-%m-%dT%H:%M:%S%z", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M:%SZ"};
+    size_t length = strlen(string);
+    char *copy = malloc(length + 1);
+    if (!copy) {
+        return 0;
+    }
+    for (size_t i = 0; i <= length; i++) {
+        copy[i] = (char)toupper((unsigned char)string[i]);
+    }
+
+    //Drop the fraction, strptime has no directive for it.
+    double fraction = 0.0;
+    char *dot = strchr(copy, '.');
+    if (dot) {
+        char *end = dot + 1;
+        fraction = strtod(dot, &end);
+        memmove(dot, end, strlen(end) + 1);
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]) && !result; i++) {
+        struct tm components;
+        memset(&components, 0, sizeof(components));
+        const char *end = strptime(copy, formats[i], &components);
+        if (end && *end == '\0') {
+            long offset = components.tm_gmtoff;
+            *seconds = (double)(timegm(&components) - offset) + fraction;
+            result = 1;
+        }
+    }
+    free(copy);
+    return result;
+}
+
+static void MKFormatDate(char *buffer, uint64_t seed)
+{
+    //Spread over 2009 to 2040, in the forms receipts and the information dictionary use.
+    time_t base = 1230768000 + (time_t)(seed % 1000000000ULL);
+    struct tm components;
+    gmtime_r(&base, &components);
+    size_t length = strftime(buffer, kMKMaxDateLength, "%Y-%m-%dT%H:%M:%S", &components);
+    switch (seed % 4) {
+        case 0:
+            snprintf(buffer + length, kMKMaxDateLength - length, "Z");
+            break;
+        case 1:
+            snprintf(buffer + length, kMKMaxDateLength - length, ".%03uZ", (unsigned)(seed % 1000));
+            break;
+        case 2:
+            snprintf(buffer + length, kMKMaxDateLength - length, "-07:00");
+            break;
+        default:
+            snprintf(buffer + length, kMKMaxDateLength - length, "+0530");
+            break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t transactionCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    size_t dateCount = transactionCount * kMKDatesPerTransaction;
+
+    char *dates = malloc(dateCount * kMKMaxDateLength);
+    size_t *lengths = malloc(dateCount * sizeof(size_t));
+    if (!dates || !lengths || dateCount == 0) {
+        fprintf(stderr, "Could not allocate the corpus.\n");
+        return 1;
+    }
+
+    uint64_t seed = 88172645463325252ULL;
+    for (size_t i = 0; i < dateCount; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        MKFormatDate(dates + i * kMKMaxDateLength, seed);
+        lengths[i] = strlen(dates + i * kMKMaxDateLength);
+    }
+
+    //Both parsers must agree on every date before the timings mean anything.
+    size_t mismatches = 0;
+    for (size_t i = 0; i < dateCount; i++) {
+        double a = 0.0, b = 0.0;
+        int parsedA = MKReceiptDateParse((const uint8_t *)(dates + i * kMKMaxDateLength), lengths[i], &a);
+        int parsedB = MKBaselineParse(dates + i * kMKMaxDateLength, &b);
+        if (parsedA != parsedB || (parsedA && (a - b > 1e-6 || b - a > 1e-6))) {
+            if (mismatches++ < 5) {
+                fprintf(stderr, "Mismatch: %s (%f, %f)\n", dates + i * kMKMaxDateLength, a, b);
+            }
+        }
+    }
+
+    double checksum = 0.0;
+    double start = MKBenchmarkNow();
+    for (size_t i = 0; i < dateCount; i++) {
+        double seconds = 0.0;
+        MKBaselineParse(dates + i * kMKMaxDateLength, &seconds);
+        checksum += seconds;
+    }
+    double baseline = MKBenchmarkNow() - start;
+
+    start = MKBenchmarkNow();
+    for (size_t i = 0; i < dateCount; i++) {
+        double seconds = 0.0;
+        MKReceiptDateParse((const uint8_t *)(dates + i * kMKMaxDateLength), lengths[i], &seconds);
+        checksum -= seconds;
+    }
+    double parser = MKBenchmarkNow() - start;
+
+    printf("transactions:       %zu (%zu dates)\n", transactionCount, dateCount);
+    printf("mismatches:         %zu\n", mismatches);
+    printf("baseline:           %8.1f ns/date  %10.0f dates/s\n", baseline * 1e9 / dateCount, dateCount / baseline);
+    printf("MKReceiptDateParse: %8.1f ns/date  %10.0f dates/s  (%.1fx)\n", parser * 1e9 / dateCount, dateCount / parser, baseline / parser);
+    printf("checksum:           %f\n", checksum);
+
+    free(dates);
+    free(lengths);
+    return mismatches ? 1 : 0;
+}
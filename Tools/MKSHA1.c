@@ -0,0 +1,274 @@
+//
+//  MKSHA1.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MKSHA1.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MK_SHA1_X86 1
+#include <immintrin.h>
+#endif
+
+//Every kernel works on lanes side by side: word t of the block of lane i is words[t * lanes + i], and
+//state word j of lane i is state[j * lanes + i]. A kernel adds the compressed block to every lane.
+typedef void (*MKSHA1Kernel)(uint32_t *state, const uint32_t *words);
+
+static const uint32_t MKSHA1InitialState[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+#define MKSHA1Rotate(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void MKSHA1CompressScalar(uint32_t *state, const uint32_t *words)
+{
+    uint32_t w[16];
+    memcpy(w, words, sizeof(w));
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int t = 0; t < 80; t++) {
+        if (t >= 16) {
+            uint32_t x = w[(t + 13) & 15] ^ w[(t + 8) & 15] ^ w[(t + 2) & 15] ^ w[t & 15];
+            w[t & 15] = MKSHA1Rotate(x, 1);
+        }
+        uint32_t f;
+        uint32_t k;
+        if (t < 20) {
+            f = d ^ (b & (c ^ d));
+            k = 0x5A827999;
+        } else if (t < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (t < 60) {
+            f = (b & c) | (d & (b | c));
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = MKSHA1Rotate(a, 5) + f + e + k + w[t & 15];
+        e = d;
+        d = c;
+        c = MKSHA1Rotate(b, 30);
+        b = a;
+        a = temp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+#ifdef MK_SHA1_X86
+
+//The vector kernels are the scalar rounds with every operation on a vector of lanes. SSE2 and AVX2 have no
+//rotate, so it is two shifts and an or. The four round functions are separate loops to keep branches out.
+#define MKSHA1VectorRounds(VEC, ADD, AND, OR, XOR, ROTATE, SET1, LOAD, STORE, lanes) \
+    VEC w[16]; \
+    for (int t = 0; t < 16; t++) { \
+        w[t] = LOAD(words + t * (lanes)); \
+    } \
+    VEC a = LOAD(state), b = LOAD(state + (lanes)), c = LOAD(state + 2 * (lanes)), d = LOAD(state + 3 * (lanes)), e = LOAD(state + 4 * (lanes)); \
+    VEC k; \
+    for (int t = 0; t < 80; t++) { \
+        if (t >= 16) { \
+            VEC x = XOR(XOR(w[(t + 13) & 15], w[(t + 8) & 15]), XOR(w[(t + 2) & 15], w[t & 15])); \
+            w[t & 15] = ROTATE(x, 1); \
+        } \
+        VEC f; \
+        if (t < 20) { \
+            f = XOR(d, AND(b, XOR(c, d))); \
+            k = SET1(0x5A827999); \
+        } else if (t < 40) { \
+            f = XOR(XOR(b, c), d); \
+            k = SET1(0x6ED9EBA1); \
+        } else if (t < 60) { \
+            f = OR(AND(b, c), AND(d, OR(b, c))); \
+            k = SET1((int)0x8F1BBCDC); \
+        } else { \
+            f = XOR(XOR(b, c), d); \
+            k = SET1((int)0xCA62C1D6); \
+        } \
+        VEC temp = ADD(ADD(ROTATE(a, 5), f), ADD(ADD(e, k), w[t & 15])); \
+        e = d; \
+        d = c; \
+        c = ROTATE(b, 30); \
+        b = a; \
+        a = temp; \
+    } \
+    STORE(state, ADD(LOAD(state), a)); \
+    STORE(state + (lanes), ADD(LOAD(state + (lanes)), b)); \
+    STORE(state + 2 * (lanes), ADD(LOAD(state + 2 * (lanes)), c)); \
+    STORE(state + 3 * (lanes), ADD(LOAD(state + 3 * (lanes)), d)); \
+    STORE(state + 4 * (lanes), ADD(LOAD(state + 4 * (lanes)), e));
+
+#define MKSHA1LoadSSE2(p) _mm_loadu_si128((const __m128i *)(p))
+#define MKSHA1StoreSSE2(p, x) _mm_storeu_si128((__m128i *)(p), x)
+#define MKSHA1RotateSSE2(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+
+/**Compresses a block in each of 4 lanes with SSE2.*/
+__attribute__((target("sse2")))
+static void MKSHA1CompressSSE2(uint32_t *state, const uint32_t *words)
+{
+    MKSHA1VectorRounds(__m128i, _mm_add_epi32, _mm_and_si128, _mm_or_si128, _mm_xor_si128, MKSHA1RotateSSE2, _mm_set1_epi32, MKSHA1LoadSSE2, MKSHA1StoreSSE2, 4)
+}
+
+#define MKSHA1LoadAVX2(p) _mm256_loadu_si256((const __m256i *)(p))
+#define MKSHA1StoreAVX2(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+#define MKSHA1RotateAVX2(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+
+/**Compresses a block in each of 8 lanes with AVX2.*/
+__attribute__((target("avx2")))
+static void MKSHA1CompressAVX2(uint32_t *state, const uint32_t *words)
+{
+    MKSHA1VectorRounds(__m256i, _mm256_add_epi32, _mm256_and_si256, _mm256_or_si256, _mm256_xor_si256, MKSHA1RotateAVX2, _mm256_set1_epi32, MKSHA1LoadAVX2, MKSHA1StoreAVX2, 8)
+}
+
+#define MKSHA1LoadAVX512(p) _mm512_loadu_si512((const void *)(p))
+#define MKSHA1StoreAVX512(p, x) _mm512_storeu_si512((void *)(p), x)
+
+/**Compresses a block in each of 16 lanes with AVX-512, which has a rotate.*/
+__attribute__((target("avx512f")))
+static void MKSHA1CompressAVX512(uint32_t *state, const uint32_t *words)
+{
+    MKSHA1VectorRounds(__m512i, _mm512_add_epi32, _mm512_and_si512, _mm512_or_si512, _mm512_xor_si512, _mm512_rol_epi32, _mm512_set1_epi32, MKSHA1LoadAVX512, MKSHA1StoreAVX512, 16)
+}
+
+#endif
+
+/**Fills in a block of the padded message: its bytes, the 0x80 after the last one, and the bit length at the end of the last block.*/
+static void MKSHA1LoadBlock(const MKSHA1Message *message, size_t length, size_t blockCount, size_t block, uint32_t *words, size_t lanes)
+{
+    uint8_t bytes[64] = {0};
+    size_t start = block * 64;
+
+    //Copy the part of each message part that falls in this block.
+    size_t offset = 0;
+    for (int i = 0; i < MKSHA1MaxParts && offset < start + 64; i++) {
+        size_t partLength = message->lengths[i];
+        if (partLength > 0 && offset + partLength > start) {
+            size_t from = start > offset ? start - offset : 0;
+            size_t to = offset + partLength < start + 64 ? partLength : start + 64 - offset;
+            memcpy(bytes + offset + from - start, message->parts[i] + from, to - from);
+        }
+        offset += partLength;
+    }
+    if (length >= start && length < start + 64) {
+        bytes[length - start] = 0x80;
+    }
+    if (block == blockCount - 1) {
+        uint64_t bitLength = (uint64_t)length * 8;
+        for (int i = 0; i < 8; i++) {
+            bytes[63 - i] = (uint8_t)(bitLength >> (8 * i));
+        }
+    }
+
+    for (int t = 0; t < 16; t++) {
+        words[t * lanes] = (uint32_t)bytes[4 * t] << 24 | (uint32_t)bytes[4 * t + 1] << 16 | (uint32_t)bytes[4 * t + 2] << 8 | bytes[4 * t + 3];
+    }
+}
+
+/**Hashes up to lanes messages with the kernel, block by block until the longest one is done.*/
+static void MKSHA1HashLanes(const MKSHA1Message *messages, size_t count, size_t lanes, MKSHA1Kernel kernel, uint8_t (*digests)[MKSHA1DigestLength])
+{
+    uint32_t state[5 * MKSHA1MaxLanes];
+    uint32_t next[5 * MKSHA1MaxLanes];
+    uint32_t words[16 * MKSHA1MaxLanes];
+    size_t lengths[MKSHA1MaxLanes];
+    size_t blockCounts[MKSHA1MaxLanes];
+    size_t maximumBlockCount = 0;
+
+    for (size_t i = 0; i < lanes; i++) {
+        for (int j = 0; j < 5; j++) {
+            state[j * lanes + i] = MKSHA1InitialState[j];
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        lengths[i] = messages[i].lengths[0] + messages[i].lengths[1] + messages[i].lengths[2];
+        //The message, the 0x80 byte and the 8 byte length, rounded up to whole blocks.
+        blockCounts[i] = (lengths[i] + 9 + 63) / 64;
+        if (blockCounts[i] > maximumBlockCount) {
+            maximumBlockCount = blockCounts[i];
+        }
+    }
+
+    memset(words, 0, sizeof(words));
+    for (size_t block = 0; block < maximumBlockCount; block++) {
+        for (size_t i = 0; i < count; i++) {
+            if (block < blockCounts[i]) {
+                MKSHA1LoadBlock(&messages[i], lengths[i], blockCounts[i], block, words + i, lanes);
+            }
+        }
+        memcpy(next, state, 5 * lanes * sizeof(uint32_t));
+        kernel(next, words);
+        //Lanes whose message is done, and unused lanes, keep their state.
+        for (size_t i = 0; i < count; i++) {
+            if (block < blockCounts[i]) {
+                for (int j = 0; j < 5; j++) {
+                    state[j * lanes + i] = next[j * lanes + i];
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        for (int j = 0; j < 5; j++) {
+            uint32_t value = state[j * lanes + i];
+            digests[i][4 * j] = (uint8_t)(value >> 24);
+            digests[i][4 * j + 1] = (uint8_t)(value >> 16);
+            digests[i][4 * j + 2] = (uint8_t)(value >> 8);
+            digests[i][4 * j + 3] = (uint8_t)value;
+        }
+    }
+}
+
+static MKSHA1Kernel MKSHA1SelectKernel(size_t *lanes)
+{
+#ifdef MK_SHA1_X86
+    if (__builtin_cpu_supports("avx512f")) {
+        *lanes = 16;
+        return MKSHA1CompressAVX512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        *lanes = 8;
+        return MKSHA1CompressAVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        *lanes = 4;
+        return MKSHA1CompressSSE2;
+    }
+#endif
+    *lanes = 1;
+    return MKSHA1CompressScalar;
+}
+
+size_t MKSHA1LaneCount(void)
+{
+    size_t lanes;
+    MKSHA1SelectKernel(&lanes);
+    return lanes;
+}
+
+void MKSHA1HashMessages(const MKSHA1Message *messages, size_t count, uint8_t (*digests)[MKSHA1DigestLength])
+{
+    size_t lanes;
+    MKSHA1Kernel kernel = MKSHA1SelectKernel(&lanes);
+    for (size_t i = 0; i < count; i += lanes) {
+        MKSHA1HashLanes(messages + i, count - i < lanes ? count - i : lanes, lanes, kernel, digests + i);
+    }
+}
+
+void MKSHA1HashMessagesScalar(const MKSHA1Message *messages, size_t count, uint8_t (*digests)[MKSHA1DigestLength])
+{
+    for (size_t i = 0; i < count; i++) {
+        MKSHA1HashLanes(messages + i, 1, 1, MKSHA1CompressScalar, digests + i);
+    }
+}
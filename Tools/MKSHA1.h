@@ -0,0 +1,56 @@
+//
+//  MKSHA1.h
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef M13MarketKit_MKSHA1_h
+#define M13MarketKit_MKSHA1_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MKSHA1DigestLength 20
+/**The most parts a message can be made of.*/
+#define MKSHA1MaxParts 3
+/**The most messages hashed side by side, the 32 bit lanes of an AVX-512 vector.*/
+#define MKSHA1MaxLanes 16
+
+/**A message hashed from its parts in turn, as if they were joined. Unused parts have a length of 0.*/
+typedef struct {
+    const uint8_t *parts[MKSHA1MaxParts];
+    size_t lengths[MKSHA1MaxParts];
+} MKSHA1Message;
+
+/**The number of messages MKSHA1HashMessages hashes side by side on this processor: 16 with AVX-512, 8 with AVX2, 4 with SSE2, otherwise 1.*/
+size_t MKSHA1LaneCount(void);
+
+/**Hashes each message with SHA-1. Messages are hashed MKSHA1LaneCount() at a time, one per 32 bit lane of a vector, so a batch of short messages costs about as much as one of them.
+ @note Messages of different lengths can share a batch, a lane is left as it is once its message is done.
+ @param messages The messages.
+ @param count The number of messages.
+ @param digests Receives the digest of each message.
+ */
+void MKSHA1HashMessages(const MKSHA1Message *messages, size_t count, uint8_t (*digests)[MKSHA1DigestLength]);
+
+/**Hashes exactly as MKSHA1HashMessages does, one message at a time. Kept as the reference the vector kernels are checked and measured against.*/
+void MKSHA1HashMessagesScalar(const MKSHA1Message *messages, size_t count, uint8_t (*digests)[MKSHA1DigestLength]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,243 @@
+//
+//  MKSHA1Benchmark.c
+//  M13MarketKit
+/*
+ Copyright (c) 2014 Brandon McQuilkin
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//Benchmarks the device hash check of the batch tool, after checking MKSHA1HashMessages against OpenSSL's SHA1:
+//every length up to 300 bytes split into three parts at every position of a 16 byte window, and batches of
+//messages of different lengths, must give the same digests.
+//
+//The check hashes the identifierForVendor bytes, the opaque value and the bundle identifier data of a receipt.
+//It is measured three ways: one EVP digest per receipt (MKReceiptVerifierCheckDeviceHash), the scalar kernel
+//one receipt at a time, and the vector kernels MKSHA1LaneCount() receipts at a time.
+//
+//Build and run on Linux from the repository root:
+//  cc -std=c99 -O2 -pthread -IM13MarketKit -ITools Tools/MKSHA1Benchmark.c Tools/MKSHA1.c M13MarketKit/MKReceiptVerifier.c M13MarketKit/MKReceiptContainer.c M13MarketKit/MKReceiptDate.c -lcrypto -o MKSHA1Benchmark
+//  ./MKSHA1Benchmark [bundle identifier ...]
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/crypto.h>
+#include <openssl/sha.h>
+
+#include "MKReceiptVerifier.h"
+#include "MKSHA1.h"
+
+#define kMKBenchmarkMinimumSeconds 0.3
+#define kMKBenchmarkReceiptCount 1024
+/**The length of the opaque value in the receipts seen so far.*/
+#define kMKBenchmarkOpaqueValueLength 16
+
+static double MKBenchmarkNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**Hashes the messages with MKSHA1HashMessages and reports whether every digest matches OpenSSL's.*/
+static int MKDigestsAgree(const MKSHA1Message *messages, size_t count, const uint8_t *bytes)
+{
+    uint8_t digests[MKSHA1MaxLanes * 2][MKSHA1DigestLength];
+    uint8_t scalarDigests[MKSHA1MaxLanes * 2][MKSHA1DigestLength];
+    MKSHA1HashMessages(messages, count, digests);
+    MKSHA1HashMessagesScalar(messages, count, scalarDigests);
+    for (size_t i = 0; i < count; i++) {
+        //The parts are consecutive slices of bytes, so the joined message is one range of it.
+        size_t length = messages[i].lengths[0] + messages[i].lengths[1] + messages[i].lengths[2];
+        uint8_t expected[SHA_DIGEST_LENGTH];
+        SHA1(messages[i].parts[0] ? messages[i].parts[0] : bytes, length, expected);
+        if (memcmp(digests[i], expected, SHA_DIGEST_LENGTH) != 0 || memcmp(scalarDigests[i], expected, SHA_DIGEST_LENGTH) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static MKSHA1Message MKMessageFromBytes(const uint8_t *bytes, size_t first, size_t second, size_t third)
+{
+    MKSHA1Message message = {{bytes, bytes + first, bytes + first + second}, {first, second, third}};
+    return message;
+}
+
+static int MKCheckKernels(void)
+{
+    uint8_t bytes[300];
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (uint8_t)(i * 151 + 7);
+    }
+
+    //Every length, with the parts split around every block boundary the padding can fall on.
+    for (size_t length = 0; length <= sizeof(bytes); length++) {
+        for (size_t first = 0; first <= 16 && first <= length; first++) {
+            for (size_t second = 0; second <= 16 && first + second <= length; second++) {
+                MKSHA1Message message = MKMessageFromBytes(bytes, first, second, length - first - second);
+                if (!MKDigestsAgree(&message, 1, bytes)) {
+                    fprintf(stderr, "Digests differ for length %zu split %zu + %zu\n", length, first, second);
+                    return 0;
+                }
+            }
+        }
+    }
+
+    //Full and partial batches of different lengths, so lanes finish on different blocks.
+    MKSHA1Message messages[MKSHA1MaxLanes * 2];
+    for (size_t count = 1; count <= MKSHA1MaxLanes * 2; count++) {
+        for (size_t seed = 0; seed < 64; seed++) {
+            for (size_t i = 0; i < count; i++) {
+                size_t length = (seed * 37 + i * 53) % sizeof(bytes);
+                messages[i] = MKMessageFromBytes(bytes, length / 3, length / 3, length - 2 * (length / 3));
+            }
+            if (!MKDigestsAgree(messages, count, bytes)) {
+                fprintf(stderr, "Digests differ in a batch of %zu\n", count);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+typedef struct {
+    uint8_t deviceIdentifier[MKReceiptDeviceIdentifierLength];
+    uint8_t opaqueValue[kMKBenchmarkOpaqueValueLength];
+    uint8_t *bundleIdentifierData;
+    size_t bundleIdentifierDataLength;
+    uint8_t hash[SHA_DIGEST_LENGTH];
+} MKBenchmarkReceipt;
+
+typedef size_t (*MKBenchmarkCheck)(const MKBenchmarkReceipt *receipts, size_t count);
+
+static size_t MKCheckEachWithEVP(const MKBenchmarkReceipt *receipts, size_t count)
+{
+    size_t matches = 0;
+    for (size_t i = 0; i < count; i++) {
+        matches += (size_t)MKReceiptVerifierCheckDeviceHash(receipts[i].deviceIdentifier, receipts[i].opaqueValue, kMKBenchmarkOpaqueValueLength, receipts[i].bundleIdentifierData, receipts[i].bundleIdentifierDataLength, receipts[i].hash, SHA_DIGEST_LENGTH);
+    }
+    return matches;
+}
+
+static size_t MKCheckWithKernel(const MKBenchmarkReceipt *receipts, size_t count, int scalar)
+{
+    MKSHA1Message messages[MKSHA1MaxLanes];
+    uint8_t digests[MKSHA1MaxLanes][MKSHA1DigestLength];
+    size_t matches = 0;
+    for (size_t i = 0; i < count; i += MKSHA1MaxLanes) {
+        size_t batch = count - i < MKSHA1MaxLanes ? count - i : MKSHA1MaxLanes;
+        for (size_t j = 0; j < batch; j++) {
+            const MKBenchmarkReceipt *receipt = &receipts[i + j];
+            MKSHA1Message message = {{receipt->deviceIdentifier, receipt->opaqueValue, receipt->bundleIdentifierData}, {MKReceiptDeviceIdentifierLength, kMKBenchmarkOpaqueValueLength, receipt->bundleIdentifierDataLength}};
+            messages[j] = message;
+        }
+        if (scalar) {
+            MKSHA1HashMessagesScalar(messages, batch, digests);
+        } else {
+            MKSHA1HashMessages(messages, batch, digests);
+        }
+        for (size_t j = 0; j < batch; j++) {
+            matches += CRYPTO_memcmp(digests[j], receipts[i + j].hash, SHA_DIGEST_LENGTH) == 0;
+        }
+    }
+    return matches;
+}
+
+static size_t MKCheckEachWithScalarKernel(const MKBenchmarkReceipt *receipts, size_t count)
+{
+    return MKCheckWithKernel(receipts, count, 1);
+}
+
+static size_t MKCheckInLanes(const MKBenchmarkReceipt *receipts, size_t count)
+{
+    return MKCheckWithKernel(receipts, count, 0);
+}
+
+/**Returns the receipts checked per second, or 0 if a check failed.*/
+static double MKMeasure(MKBenchmarkCheck check, const MKBenchmarkReceipt *receipts, size_t count)
+{
+    size_t iterations = 0;
+    double start = MKBenchmarkNow();
+    double elapsed = 0.0;
+    do {
+        if (check(receipts, count) != count) {
+            return 0.0;
+        }
+        iterations++;
+        elapsed = MKBenchmarkNow() - start;
+    } while (elapsed < kMKBenchmarkMinimumSeconds);
+    return (double)(count * iterations) / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    if (!MKCheckKernels()) {
+        return 1;
+    }
+    printf("kernels agree with SHA1 on every length up to 300 and every batch size up to %d, %zu lanes\n", MKSHA1MaxLanes * 2, MKSHA1LaneCount());
+
+    //Bundle identifiers that make the hashed input one, two and three blocks long.
+    const char *defaultBundleIdentifiers[] = {"com.app", "com.BrandonMcQuilkin.M13MarketKit", "com.example.a-bundle-identifier-long-enough-for-the-hashed-input-to-take-three-sha1-blocks"};
+    size_t identifierCount = argc > 1 ? (size_t)(argc - 1) : sizeof(defaultBundleIdentifiers) / sizeof(defaultBundleIdentifiers[0]);
+
+    MKBenchmarkReceipt *receipts = calloc(kMKBenchmarkReceiptCount, sizeof(MKBenchmarkReceipt));
+    if (!receipts) {
+        return 1;
+    }
+    printf("%-7s %16s %16s %16s %8s\n", "bytes", "EVP receipts/s", "scalar", "lanes", "speedup");
+    for (size_t n = 0; n < identifierCount; n++) {
+        const char *bundleIdentifier = argc > 1 ? argv[n + 1] : defaultBundleIdentifiers[n];
+        size_t identifierLength = strlen(bundleIdentifier);
+        //The bundle identifier data is the DER encoded UTF8String.
+        size_t dataLength = identifierLength + 2;
+        uint8_t *data = malloc(dataLength);
+        if (!data || identifierLength > 127) {
+            free(data);
+            free(receipts);
+            return 1;
+        }
+        data[0] = 0x0C;
+        data[1] = (uint8_t)identifierLength;
+        memcpy(data + 2, bundleIdentifier, identifierLength);
+
+        srand(1);
+        for (size_t i = 0; i < kMKBenchmarkReceiptCount; i++) {
+            MKBenchmarkReceipt *receipt = &receipts[i];
+            for (size_t j = 0; j < MKReceiptDeviceIdentifierLength; j++) {
+                receipt->deviceIdentifier[j] = (uint8_t)rand();
+            }
+            for (size_t j = 0; j < kMKBenchmarkOpaqueValueLength; j++) {
+                receipt->opaqueValue[j] = (uint8_t)rand();
+            }
+            receipt->bundleIdentifierData = data;
+            receipt->bundleIdentifierDataLength = dataLength;
+            SHA_CTX context;
+            SHA1_Init(&context);
+            SHA1_Update(&context, receipt->deviceIdentifier, MKReceiptDeviceIdentifierLength);
+            SHA1_Update(&context, receipt->opaqueValue, kMKBenchmarkOpaqueValueLength);
+            SHA1_Update(&context, data, dataLength);
+            SHA1_Final(receipt->hash, &context);
+        }
+
+        double evp = MKMeasure(MKCheckEachWithEVP, receipts, kMKBenchmarkReceiptCount);
+        double scalar = MKMeasure(MKCheckEachWithScalarKernel, receipts, kMKBenchmarkReceiptCount);
+        double lanes = MKMeasure(MKCheckInLanes, receipts, kMKBenchmarkReceiptCount);
+        printf("%-7zu %16.0f %16.0f %16.0f %7.2fx\n", MKReceiptDeviceIdentifierLength + kMKBenchmarkOpaqueValueLength + dataLength, evp, scalar, lanes, evp > 0 ? lanes / evp : 0.0);
+        free(data);
+    }
+    free(receipts);
+    return 0;
+}